@@ -1,6 +1,6 @@
 TEMPLATE  = lib
 CONFIG   += plugin
-QT       += core quick network
+QT       += core quick network websockets
 
 # === Version and build information ===========================================
 # If built in Buildroot use custom package version, otherwise Git
@@ -80,8 +80,39 @@ unix {
 QMAKE_SUBSTITUTES += spotify.json.in version.txt.in
 # output path must be included for the output file from QMAKE_SUBSTITUTES
 INCLUDEPATH += $$OUT_PWD
-HEADERS  += src/spotify.h
-SOURCES  += src/spotify.cpp
+HEADERS  += src/circuitbreaker.h \
+            src/httpclient.h \
+            src/imagecache.h \
+            src/latencyhistogram.h \
+            src/metadatacache.h \
+            src/playbackprogress.h \
+            src/playerstateprovider.h \
+            src/pollscheduler.h \
+            src/retrypolicy.h \
+            src/spotify.h \
+            src/spotifytypes.h \
+            src/stringpool.h \
+            src/telemetry.h \
+            src/throttledcontrol.h \
+            src/tokenmanager.h \
+            src/webapi.h \
+            src/websocketstateprovider.h
+SOURCES  += src/circuitbreaker.cpp \
+            src/httpclient.cpp \
+            src/imagecache.cpp \
+            src/latencyhistogram.cpp \
+            src/metadatacache.cpp \
+            src/playbackprogress.cpp \
+            src/pollscheduler.cpp \
+            src/retrypolicy.cpp \
+            src/spotify.cpp \
+            src/spotifytypes.cpp \
+            src/stringpool.cpp \
+            src/telemetry.cpp \
+            src/throttledcontrol.cpp \
+            src/tokenmanager.cpp \
+            src/webapi.cpp \
+            src/websocketstateprovider.cpp
 TARGET    = spotify
 
 # Configure destination path. DESTDIR is set in qmake-destination-path.pri
@@ -91,6 +122,13 @@ MOC_DIR = $$PWD/build/$$DESTINATION_PATH/moc
 RCC_DIR = $$PWD/build/$$DESTINATION_PATH/qrc
 UI_DIR = $$PWD/build/$$DESTINATION_PATH/ui
 
+# Unit tests and benchmarks: 'make check' builds and runs the tests/tests.pro project in the build directory. It is a
+# separate project because the tests are executables which must not depend on integrations.library or the plugin.
+TESTS_BUILD_DIR = $$OUT_PWD/tests
+check.commands = $(MKDIR) $$TESTS_BUILD_DIR && cd $$TESTS_BUILD_DIR && \
+                 $$QMAKE_QMAKE $$PWD/tests/tests.pro && $(MAKE) && $(MAKE) check
+QMAKE_EXTRA_TARGETS += check
+
 DISTFILES += \
     dependencies.cfg \
     spotify.json.in \
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "circuitbreaker.h"
+
+CircuitBreaker::CircuitBreaker(int failureThreshold, int coolDown, int maxCoolDown)
+    : m_failureThreshold(failureThreshold), m_coolDown(coolDown), m_maxCoolDown(maxCoolDown) {}
+
+bool CircuitBreaker::allow(const QString& endpoint) {
+    QHash<QString, Endpoint>::iterator iter = m_endpoints.find(endpoint);
+    if (iter == m_endpoints.end() || iter->state == CLOSED) {
+        return true;
+    }
+
+    // the probe counts as lost if it did not report back within the cool-down
+    if (iter->since.elapsed() >= iter->coolDown) {
+        iter->state = PROBING;
+        iter->since.start();
+        return true;
+    }
+    m_rejected++;
+    return false;
+}
+
+void CircuitBreaker::succeeded(const QString& endpoint) {
+    m_endpoints.remove(endpoint);
+}
+
+bool CircuitBreaker::failed(const QString& endpoint) {
+    Endpoint& stats = m_endpoints[endpoint];
+    stats.failures++;
+
+    if (stats.state == PROBING) {
+        stats.state = OPEN;
+        stats.coolDown = qMin(stats.coolDown * 2, m_maxCoolDown);
+        stats.since.start();
+        return false;
+    }
+    if (stats.state == CLOSED && stats.failures >= m_failureThreshold) {
+        stats.state = OPEN;
+        stats.coolDown = m_coolDown;
+        stats.since.start();
+        m_opened++;
+        return true;
+    }
+    return false;
+}
+
+int CircuitBreaker::retryIn(const QString& endpoint) const {
+    QHash<QString, Endpoint>::const_iterator iter = m_endpoints.constFind(endpoint);
+    if (iter == m_endpoints.constEnd() || iter->state == CLOSED) {
+        return 0;
+    }
+    return static_cast<int>(qMax<qint64>(0, iter->coolDown - iter->since.elapsed()));
+}
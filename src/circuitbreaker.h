@@ -0,0 +1,71 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// CIRCUIT BREAKER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Per-endpoint circuit breaker. After a number of failures in a row the endpoint is open: requests are not sent until
+/// the cool-down has passed. Then a single probe request is let through; if it fails too, the cool-down doubles.
+/// Any successful reply closes the breaker again.
+class CircuitBreaker {
+ public:
+    explicit CircuitBreaker(int failureThreshold = 5, int coolDown = 15000, int maxCoolDown = 300000);
+
+    // false while the endpoint is open, or while the probe after the cool-down is on its way
+    bool allow(const QString& endpoint);
+
+    void succeeded(const QString& endpoint);
+
+    // returns true if this failure opened the breaker
+    bool failed(const QString& endpoint);
+
+    // ms until the next request to the endpoint is allowed, 0 if it is allowed now
+    int retryIn(const QString& endpoint) const;
+
+    quint64 opened() const { return m_opened; }
+    quint64 rejected() const { return m_rejected; }
+
+ private:
+    enum State { CLOSED, OPEN, PROBING };
+
+    struct Endpoint {
+        State         state = CLOSED;
+        int           failures = 0;
+        int           coolDown = 0;
+        QElapsedTimer since;  // opened, or probe sent
+    };
+
+ private:
+    int                      m_failureThreshold;
+    int                      m_coolDown;
+    int                      m_maxCoolDown;
+    QHash<QString, Endpoint> m_endpoints;  // only endpoints which failed recently
+    quint64                  m_opened = 0;
+    quint64                  m_rejected = 0;
+};
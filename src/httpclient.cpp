@@ -0,0 +1,294 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "httpclient.h"
+
+#include "telemetry.h"
+
+// the HTTP/2 attributes were renamed in Qt 5.15, which deprecates the old names
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+static const QNetworkRequest::Attribute HTTP2_ALLOWED = QNetworkRequest::Http2AllowedAttribute;
+static const QNetworkRequest::Attribute HTTP2_USED = QNetworkRequest::Http2WasUsedAttribute;
+#else
+static const QNetworkRequest::Attribute HTTP2_ALLOWED = QNetworkRequest::HTTP2AllowedAttribute;
+static const QNetworkRequest::Attribute HTTP2_USED = QNetworkRequest::HTTP2WasUsedAttribute;
+#endif
+
+HttpClient::HttpClient(QObject* parent) : QObject(parent), m_manager(new QNetworkAccessManager(this)) {}
+
+void HttpClient::setMaxConcurrentRequests(int max) {
+    m_maxConcurrent = qMax(1, max);
+    dispatch();
+}
+
+void HttpClient::setMaxLowPriorityRequests(int max) {
+    m_maxLowPriority = qMax(1, max);
+    dispatch();
+}
+
+void HttpClient::warmUp(const QUrl& url) {
+#ifndef QT_NO_SSL
+    if (url.scheme() == "https") {
+        m_manager->connectToHostEncrypted(url.host(), static_cast<quint16>(url.port(443)));
+        return;
+    }
+#endif
+    m_manager->connectToHost(url.host(), static_cast<quint16>(url.port(80)));
+}
+
+quint64 HttpClient::send(Operation operation, const QNetworkRequest& request, const QByteArray& body,
+                         const ReplyHandler& handler, const QString& collapseKey) {
+    quint64 id = m_nextId++;
+    m_handlers.insert(id, handler);
+
+    // join an identical GET which is already queued or running; a conditional GET only joins one with the same ETag
+    QString sharedKey;
+    if (operation == GET) {
+        sharedKey = request.url().toString(QUrl::FullyEncoded) + " " + request.rawHeader("If-None-Match");
+    }
+    if (!sharedKey.isEmpty() && m_shared.contains(sharedKey)) {
+        quint64 flightId = m_shared.value(sharedKey);
+        Flight& flight = m_flights[flightId];
+        if (!flight.reply && request.priority() != QNetworkRequest::LowPriority) {
+            // somebody is waiting for the prefetch now
+            flight.lowPriority = false;
+            flight.request.setPriority(request.priority());
+        }
+        flight.callers.append(id);
+        m_callers.insert(id, flightId);
+        m_stats.coalesced++;
+        return id;
+    }
+
+    // replace the waiting request of the same kind, its callers get the reply of the newer one
+    if (!collapseKey.isEmpty() && m_waiting.contains(collapseKey)) {
+        quint64 flightId = m_waiting.value(collapseKey);
+        Flight& flight = m_flights[flightId];
+        flight.operation = operation;
+        flight.request = request;
+        flight.request.setAttribute(HTTP2_ALLOWED, true);
+        flight.body = body;
+        flight.lowPriority = request.priority() == QNetworkRequest::LowPriority;
+        flight.callers.append(id);
+        m_callers.insert(id, flightId);
+        m_stats.collapsed++;
+        return id;
+    }
+
+    Flight flight;
+    flight.operation = operation;
+    flight.request = request;
+    flight.body = body;
+    flight.sharedKey = sharedKey;
+    flight.collapseKey = collapseKey;
+    flight.callers.append(id);
+    flight.timer.start();
+    flight.lowPriority = request.priority() == QNetworkRequest::LowPriority;
+
+    // let Qt negotiate HTTP/2 via ALPN, so several requests can share one connection
+    flight.request.setAttribute(HTTP2_ALLOWED, true);
+
+    m_flights.insert(id, flight);
+    m_callers.insert(id, id);
+    m_queue.append(id);
+    if (!sharedKey.isEmpty()) {
+        m_shared.insert(sharedKey, id);
+    }
+    if (!collapseKey.isEmpty()) {
+        m_waiting.insert(collapseKey, id);
+    }
+    dispatch();
+
+    return id;
+}
+
+bool HttpClient::cancel(quint64 id) {
+    if (!m_callers.contains(id)) {
+        return false;
+    }
+    quint64 flightId = m_callers.take(id);
+    m_handlers.remove(id);
+    m_stats.cancelled++;
+
+    Flight& flight = m_flights[flightId];
+    flight.callers.removeOne(id);
+    if (!flight.callers.isEmpty()) {
+        return true;
+    }
+
+    // nobody is waiting for this request anymore
+    QNetworkReply* reply = flight.reply;
+    if (reply) {
+        // the finished handler cleans up, a new identical GET must not join the aborted one
+        if (m_shared.value(flight.sharedKey) == flightId) {
+            m_shared.remove(flight.sharedKey);
+        }
+        reply->abort();
+    } else {
+        m_queue.removeOne(flightId);
+        forget(flightId, m_flights.take(flightId));
+    }
+    return true;
+}
+
+HttpClient::Stats HttpClient::stats() const {
+    Stats stats = m_stats;
+    stats.inFlight = m_inFlight;
+    stats.queued = m_queue.size();
+    return stats;
+}
+
+void HttpClient::dispatch() {
+    int normalQueued = 0;
+    for (quint64 flightId : m_queue) {
+        if (!m_flights[flightId].lowPriority) {
+            normalQueued++;
+        }
+    }
+
+    for (int i = 0; i < m_queue.size() && m_inFlight < m_maxConcurrent;) {
+        // one request per collapse key on the wire
+        const Flight& flight = m_flights[m_queue.at(i)];
+        if (!flight.collapseKey.isEmpty() && m_sending.contains(flight.collapseKey)) {
+            i++;
+            continue;
+        }
+        // low priority requests go last, and never take all slots
+        if (flight.lowPriority && (normalQueued > 0 || m_lowPriorityInFlight >= m_maxLowPriority)) {
+            i++;
+            continue;
+        }
+        if (!flight.lowPriority) {
+            normalQueued--;
+        }
+        start(m_queue.takeAt(i));
+    }
+}
+
+void HttpClient::start(quint64 flightId) {
+    Flight& flight = m_flights[flightId];
+
+    QNetworkReply* reply = nullptr;
+    switch (flight.operation) {
+        case GET:
+            reply = m_manager->get(flight.request);
+            break;
+        case POST:
+            reply = m_manager->post(flight.request, flight.body);
+            break;
+        case PUT:
+            reply = m_manager->put(flight.request, flight.body);
+            break;
+    }
+    flight.reply = reply;
+
+    // from now on, a newer request with the same collapse key waits for this one
+    if (!flight.collapseKey.isEmpty()) {
+        m_waiting.remove(flight.collapseKey);
+        m_sending.insert(flight.collapseKey);
+    }
+
+    m_inFlight++;
+    m_stats.requests++;
+    if (flight.lowPriority) {
+        m_lowPriorityInFlight++;
+        m_stats.lowPriority++;
+    }
+
+    flight.queuedMs = flight.timer.restart();
+    QElapsedTimer sent = flight.timer;
+    bool          measured = m_telemetry && m_telemetry->isEnabled();
+
+    // encrypted() is only emitted when the reply had to complete a new TLS handshake
+    QObject::connect(reply, &QNetworkReply::encrypted, this, [=]() {
+        reply->setProperty("handshake", true);
+        reply->setProperty("handshakeMs", sent.elapsed());
+    });
+
+    // the headers arrived: time to first byte
+    if (measured) {
+        QObject::connect(reply, &QNetworkReply::metaDataChanged, this, [=]() {
+            if (!reply->property("firstByteMs").isValid()) {
+                reply->setProperty("firstByteMs", sent.elapsed());
+            }
+        });
+    }
+
+    QObject::connect(reply, &QNetworkReply::finished, this, [=]() {
+        if (reply->property("handshake").toBool()) {
+            m_stats.connectionsOpened++;
+        } else if (reply->attribute(QNetworkRequest::ConnectionEncryptedAttribute).toBool()) {
+            m_stats.connectionsReused++;
+        }
+        if (reply->attribute(HTTP2_USED).toBool()) {
+            m_stats.http2Replies++;
+        }
+
+        m_inFlight--;
+
+        // taken out first: handlers may send new requests
+        Flight     finished = m_flights.take(flightId);
+        QByteArray body = reply->readAll();
+        forget(flightId, finished);
+        if (finished.lowPriority) {
+            m_lowPriorityInFlight--;
+        }
+
+        if (measured) {
+            QVariant           handshakeMs = reply->property("handshakeMs");
+            QVariant           firstByteMs = reply->property("firstByteMs");
+            Telemetry::Request timing;
+            timing.statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            timing.queuedMs = finished.queuedMs;
+            timing.handshakeMs = handshakeMs.isValid() ? handshakeMs.toLongLong() : -1;
+            timing.firstByteMs = firstByteMs.isValid() ? firstByteMs.toLongLong() : -1;
+            timing.totalMs = sent.elapsed();
+            timing.bytesIn = body.size();
+            timing.bytesOut = finished.body.size();
+            QString endpoint = finished.request.attribute(EndpointAttribute).toString();
+            m_telemetry->recordRequest(endpoint.isEmpty() ? finished.request.url().path() : endpoint, timing);
+        }
+
+        for (quint64 caller : finished.callers) {
+            ReplyHandler handler = m_handlers.take(caller);
+            if (m_callers.remove(caller) > 0 && handler) {
+                handler(reply, body);
+            }
+        }
+        reply->deleteLater();
+
+        dispatch();
+    });
+}
+
+void HttpClient::forget(quint64 flightId, const Flight& flight) {
+    if (!flight.sharedKey.isEmpty() && m_shared.value(flight.sharedKey) == flightId) {
+        m_shared.remove(flight.sharedKey);
+    }
+    if (!flight.collapseKey.isEmpty()) {
+        if (m_waiting.value(flight.collapseKey) == flightId) {
+            m_waiting.remove(flight.collapseKey);
+        } else if (flight.reply) {
+            m_sending.remove(flight.collapseKey);
+        }
+    }
+}
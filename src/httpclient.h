@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSet>
+#include <QUrl>
+
+#include <functional>
+
+class Telemetry;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// HTTP CLIENT
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Long-lived HTTP client shared by all Spotify Web API calls of one integration instance.
+/// Connections are kept alive and reused by the single QNetworkAccessManager, HTTP/2 is allowed where the server and
+/// Qt support it, and the number of requests on the wire is capped. Requests above the cap wait in a FIFO queue.
+/// Every request gets a unique id which can be used to cancel it; a cancelled request never invokes its handler.
+///
+/// Identical GETs (same URL) which overlap share one network request, and every caller gets the reply. Requests with
+/// the same collapse key are sent one after another; a waiting one is replaced by a newer one, so only the latest
+/// value is sent.
+///
+/// Requests with QNetworkRequest::LowPriority (speculative prefetches) are only started while no other request waits,
+/// and only a few of them at a time. A normal request joining a waiting low priority GET lifts it to normal priority.
+class HttpClient : public QObject {
+    Q_OBJECT
+
+ public:
+    enum Operation { GET, POST, PUT };
+
+    // the reply body is read once and passed along, since a reply can be delivered to several callers
+    typedef std::function<void(QNetworkReply* reply, const QByteArray& body)> ReplyHandler;
+
+    struct Stats {
+        quint64 requests = 0;           // requests issued on the network
+        quint64 coalesced = 0;          // GETs served by an identical running one
+        quint64 collapsed = 0;          // waiting requests replaced by a newer one with the same collapse key
+        quint64 connectionsOpened = 0;  // replies which had to perform a new TLS handshake
+        quint64 connectionsReused = 0;  // encrypted replies served on an already established connection
+        quint64 http2Replies = 0;
+        quint64 cancelled = 0;
+        quint64 lowPriority = 0;        // requests issued with low priority
+        int     inFlight = 0;
+        int     queued = 0;
+    };
+
+    // endpoint name under which a request is recorded in the telemetry, the URL path if not set
+    static const QNetworkRequest::Attribute EndpointAttribute = QNetworkRequest::User;
+
+    explicit HttpClient(QObject* parent = nullptr);
+
+    // records the timings of every request while the telemetry is enabled
+    void setTelemetry(Telemetry* telemetry) { m_telemetry = telemetry; }
+
+    void setMaxConcurrentRequests(int max);
+    int  maxConcurrentRequests() const { return m_maxConcurrent; }
+
+    // low priority requests on the wire at the same time, within the overall maximum
+    void setMaxLowPriorityRequests(int max);
+
+    // Opens a connection to the host of the given URL in advance, so the first real request does not pay for the
+    // (TLS) handshake
+    void warmUp(const QUrl& url);
+
+    // Enqueues a request and returns its id. The handler is invoked once with the finished reply, which is deleted
+    // afterwards.
+    quint64 send(Operation operation, const QNetworkRequest& request, const QByteArray& body,
+                 const ReplyHandler& handler, const QString& collapseKey = QString());
+
+    // Drops a queued request or aborts a running one. Returns false if the request already completed. A request
+    // shared with other callers keeps running for them.
+    bool cancel(quint64 id);
+
+    Stats stats() const;
+
+ private:
+    // one network request and everybody waiting for its reply
+    struct Flight {
+        Operation       operation;
+        QNetworkRequest request;
+        QByteArray      body;
+        QString         sharedKey;  // GETs only
+        QString         collapseKey;
+        QList<quint64>  callers;
+        QNetworkReply*  reply = nullptr;
+        QElapsedTimer   timer;  // waiting in the queue, then on the wire
+        qint64          queuedMs = 0;
+        bool            lowPriority = false;
+    };
+
+    void dispatch();
+    void start(quint64 flightId);
+    void forget(quint64 flightId, const Flight& flight);
+
+ private:
+    QNetworkAccessManager*       m_manager;
+    QHash<quint64, Flight>       m_flights;
+    QList<quint64>               m_queue;
+    QHash<quint64, quint64>      m_callers;  // caller id -> flight id
+    QHash<quint64, ReplyHandler> m_handlers;
+    QHash<QString, quint64>      m_shared;   // URL -> flight of a queued or running GET
+    QHash<QString, quint64>      m_waiting;  // collapse key -> queued flight
+    QSet<QString>                m_sending;  // collapse keys with a request on the wire
+    quint64                      m_nextId = 1;
+    int                          m_maxConcurrent = 4;
+    int                          m_inFlight = 0;
+    int                          m_maxLowPriority = 1;
+    int                          m_lowPriorityInFlight = 0;
+    Stats                        m_stats;
+    Telemetry*                   m_telemetry = nullptr;
+};
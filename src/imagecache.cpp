@@ -0,0 +1,144 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "imagecache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMultiMap>
+#include <QSaveFile>
+#include <QUrl>
+
+ImageCache::ImageCache(const QString& directory, qint64 maxBytes, QObject* parent)
+    : QObject(parent), m_http(new HttpClient(this)), m_directory(directory), m_maxBytes(maxBytes) {
+    m_http->setMaxConcurrentRequests(MAX_CONCURRENT_DOWNLOADS);
+    QDir().mkpath(m_directory);
+
+    const QStringList files = QDir(m_directory).entryList(QStringList() << "*.jpg", QDir::Files);
+    for (const QString& file : files) {
+        m_files.insert(file);
+    }
+}
+
+QString ImageCache::resolve(const QString& url) {
+    if (url.isEmpty()) {
+        return url;
+    }
+
+    QString name = fileName(url);
+    if (m_files.contains(name)) {
+        m_stats.hits++;
+
+        // written to the modification time when pruning, not on every hit
+        m_used.insert(name, QDateTime::currentDateTimeUtc());
+        return QUrl::fromLocalFile(filePath(url)).toString();
+    }
+
+    // behind the queue art, which is needed sooner
+    m_stats.misses++;
+    prefetch(url, QNetworkRequest::LowPriority);
+    return url;
+}
+
+void ImageCache::prefetch(const QString& url, QNetworkRequest::Priority priority) {
+    if (url.isEmpty() || m_pending.contains(url) || m_files.contains(fileName(url))) {
+        return;
+    }
+
+    // the UI downloads whatever could not be fetched in time itself
+    if (m_pending.size() >= MAX_PENDING_DOWNLOADS) {
+        return;
+    }
+    m_pending.insert(url);
+
+    QNetworkRequest request;
+    request.setUrl(QUrl(url));
+    request.setPriority(priority);
+    m_http->send(HttpClient::GET, request, QByteArray(), [=](QNetworkReply* reply, const QByteArray& image) {
+        m_pending.remove(url);
+
+        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (reply->error() || statusCode != 200 || image.isEmpty()) {
+            return;
+        }
+
+        QSaveFile file(filePath(url));
+        if (!file.open(QIODevice::WriteOnly)) {
+            return;
+        }
+        file.write(image);
+        if (!file.commit()) {
+            return;
+        }
+        m_files.insert(fileName(url));
+        m_stats.downloads++;
+        m_stats.bytes += static_cast<quint64>(image.size());
+
+        if (++m_writesSincePrune >= PRUNE_INTERVAL) {
+            m_writesSincePrune = 0;
+            pruneDisk();
+        }
+    });
+}
+
+QString ImageCache::fileName(const QString& url) const {
+    QByteArray hash = QCryptographicHash::hash(url.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QString::fromLatin1(hash) + ".jpg";
+}
+
+QString ImageCache::filePath(const QString& url) const {
+    return m_directory + "/" + fileName(url);
+}
+
+void ImageCache::pruneDisk() {
+    QDir          dir(m_directory);
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.jpg", QDir::Files);
+
+    // the modification time is the LRU order of the disk cache, unless the file was used since the last prune
+    QMultiMap<QDateTime, QFileInfo> byUse;
+    qint64                          total = 0;
+    for (const QFileInfo& info : files) {
+        byUse.insert(m_used.value(info.fileName(), info.lastModified().toUTC()), info);
+        total += info.size();
+    }
+
+    // sorted least recently used first
+    for (QMultiMap<QDateTime, QFileInfo>::const_iterator it = byUse.constBegin();
+         it != byUse.constEnd() && total > m_maxBytes; ++it) {
+        total -= it.value().size();
+        QFile::remove(it.value().absoluteFilePath());
+        m_used.remove(it.value().fileName());
+        m_files.remove(it.value().fileName());
+    }
+
+    // keep the order of the remaining files across a restart
+    for (QHash<QString, QDateTime>::const_iterator it = m_used.constBegin(); it != m_used.constEnd(); ++it) {
+        QFile file(dir.filePath(it.key()));
+        if (file.open(QIODevice::ReadWrite | QIODevice::ExistingOnly)) {
+            file.setFileTime(it.value(), QFileDevice::FileModificationTime);
+        }
+    }
+    m_used.clear();
+}
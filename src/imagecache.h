@@ -0,0 +1,83 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include "httpclient.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// IMAGE CACHE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Disk cache of cover art, keyed by the image URL.
+/// Images are downloaded in the background with their own HTTP client, so they never hold up Web API requests. The
+/// cached files are listed once and then tracked in memory, so resolving a list of images needs no disk access. Hits
+/// are only remembered in memory; the directory is pruned least recently used first when it exceeds its size limit, and
+/// only then the modification times of the used files are updated, so the order survives a restart.
+class ImageCache : public QObject {
+    Q_OBJECT
+
+ public:
+    struct Stats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 downloads = 0;
+        quint64 bytes = 0;
+    };
+
+    explicit ImageCache(const QString& directory, qint64 maxBytes = 32 * 1024 * 1024, QObject* parent = nullptr);
+
+    // Local file URL of the image if it is cached. Otherwise the remote URL, which the UI downloads itself this time;
+    // the image is fetched into the cache at low priority, so the next list showing it gets the local file.
+    QString resolve(const QString& url);
+
+    // Downloads the image unless it is cached or already being downloaded, e.g. of the next tracks in the queue
+    void prefetch(const QString& url, QNetworkRequest::Priority priority = QNetworkRequest::NormalPriority);
+
+    Stats stats() const { return m_stats; }
+
+ private:
+    QString fileName(const QString& url) const;
+    QString filePath(const QString& url) const;
+    void    pruneDisk();
+
+ private:
+    static const int MAX_CONCURRENT_DOWNLOADS = 2;
+    static const int MAX_PENDING_DOWNLOADS = 32;
+    static const int PRUNE_INTERVAL = 20;
+
+    HttpClient*   m_http;
+    QString       m_directory;
+    qint64        m_maxBytes;
+    QSet<QString> m_pending;
+    QSet<QString> m_files;  // file names in the directory
+    int           m_writesSincePrune = 0;
+    Stats         m_stats;
+
+    // file name -> last hit since the last prune
+    QHash<QString, QDateTime> m_used;
+};
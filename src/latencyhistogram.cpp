@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram() : m_buckets(bucketLimits().size() + 1, 0) {}
+
+const QVector<qint64>& LatencyHistogram::bucketLimits() {
+    // milliseconds, the last bucket collects everything above
+    static const QVector<qint64> limits = {25, 50, 100, 200, 300, 500, 750, 1000, 2000, 5000, 10000};
+    return limits;
+}
+
+void LatencyHistogram::record(qint64 ms) {
+    const QVector<qint64>& limits = bucketLimits();
+
+    int bucket = 0;
+    while (bucket < limits.size() && ms > limits[bucket]) {
+        bucket++;
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += ms;
+    m_max = qMax(m_max, ms);
+}
+
+void LatencyHistogram::reset() {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+qint64 LatencyHistogram::percentile(int percent) const {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const QVector<qint64>& limits = bucketLimits();
+
+    quint64 target = (m_count * static_cast<quint64>(qBound(0, percent, 100)) + 99) / 100;
+    quint64 seen = 0;
+    for (int i = 0; i < m_buckets.size(); i++) {
+        seen += m_buckets[i];
+        if (seen >= target && seen > 0) {
+            return i < limits.size() ? limits[i] : m_max;
+        }
+    }
+    return m_max;
+}
+
+QString LatencyHistogram::toString() const {
+    return QString("n=%1 mean=%2 p50<=%3 p90<=%4 p99<=%5 max=%6")
+        .arg(m_count)
+        .arg(mean())
+        .arg(percentile(50))
+        .arg(percentile(90))
+        .arg(percentile(99))
+        .arg(m_max);
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// LATENCY HISTOGRAM
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Fixed bucket latency histogram. Recording is a few comparisons and no allocation, so it can stay enabled.
+class LatencyHistogram {
+ public:
+    LatencyHistogram();
+
+    void record(qint64 ms);
+    void reset();
+
+    quint64 count() const { return m_count; }
+    qint64  max() const { return m_max; }
+    qint64  mean() const { return m_count > 0 ? m_sum / static_cast<qint64>(m_count) : 0; }
+
+    // upper bound of the bucket containing the given percentile (0-100)
+    qint64 percentile(int percent) const;
+
+    // e.g. "n=12 mean=180 p50<=200 p90<=500 p99<=1000 max=734"
+    QString toString() const;
+
+    static const QVector<qint64>& bucketLimits();
+
+ private:
+    QVector<quint64> m_buckets;
+    quint64          m_count = 0;
+    qint64           m_sum = 0;
+    qint64           m_max = 0;
+};
@@ -0,0 +1,185 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "metadatacache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+static const char* TYPE_NAMES[MetadataCache::TYPE_COUNT] = {"track", "album", "artist", "playlist", "user_playlists"};
+
+// prune the disk cache only every few writes, listing the directory is not free
+static const int PRUNE_INTERVAL = 20;
+
+MetadataCache::MetadataCache(const QString& directory, int memoryBytes, qint64 diskBytes)
+    : m_directory(directory), m_memory(memoryBytes), m_diskBytes(diskBytes) {
+    QDir().mkpath(m_directory);
+}
+
+bool MetadataCache::lookup(Type type, const QString& id, Entry* entry) {
+    QString k = key(type, id);
+
+    Entry* cached = m_memory.object(k);
+    if (cached) {
+        m_stats.memoryHits++;
+        *entry = *cached;
+        return true;
+    }
+
+    if (readFile(type, id, entry)) {
+        m_stats.diskHits++;
+        m_memory.insert(k, new Entry(*entry), entry->body.size());
+        return true;
+    }
+
+    m_stats.misses++;
+    return false;
+}
+
+void MetadataCache::insert(Type type, const QString& id, const QByteArray& body, const QString& snapshotId,
+                           const QByteArray& etag) {
+    Entry* entry = new Entry;
+    entry->body = body;
+    entry->fetched = QDateTime::currentDateTimeUtc();
+    entry->snapshotId = snapshotId;
+    entry->etag = etag;
+
+    writeFile(type, id, *entry);
+
+    // QCache deletes entries which are bigger than the whole cache right away
+    m_memory.insert(key(type, id), entry, body.size());
+}
+
+void MetadataCache::remove(Type type, const QString& id) {
+    m_memory.remove(key(type, id));
+    QFile::remove(filePath(type, id));
+}
+
+void MetadataCache::touch(Type type, const QString& id) {
+    QDateTime now = QDateTime::currentDateTimeUtc();
+
+    Entry* cached = m_memory.object(key(type, id));
+    if (cached) {
+        cached->fetched = now;
+    }
+
+    // the modification time of the file is its fetch time: the body is not written again
+    QFile file(filePath(type, id));
+    if (file.open(QIODevice::ReadWrite | QIODevice::ExistingOnly)) {
+        file.setFileTime(now, QFileDevice::FileModificationTime);
+    }
+}
+
+void MetadataCache::notModified(Type type, const QString& id) {
+    m_stats.notModified++;
+    touch(type, id);
+}
+
+bool MetadataCache::isFresh(Type type, const Entry& entry) const {
+    return entry.fetched.isValid() && entry.fetched.secsTo(QDateTime::currentDateTimeUtc()) < ttl(type);
+}
+
+int MetadataCache::ttl(Type type) {
+    switch (type) {
+        case TRACK:
+        case ALBUM:
+        case ARTIST:
+            // released music hardly ever changes
+            return 7 * 24 * 3600;
+        case PLAYLIST:
+            // revalidated cheaply with the snapshot id
+            return 10 * 60;
+        default:
+            return 5 * 60;
+    }
+}
+
+QString MetadataCache::key(Type type, const QString& id) const {
+    return QString(TYPE_NAMES[type]) + ":" + id;
+}
+
+QString MetadataCache::filePath(Type type, const QString& id) const {
+    // Spotify IDs are base62, anything else is not used as file name
+    static const QRegularExpression INVALID("[^A-Za-z0-9_-]");
+    QString                         name = id;
+    name.replace(INVALID, "_");
+    return m_directory + "/" + TYPE_NAMES[type] + "_" + name + ".json";
+}
+
+void MetadataCache::writeFile(Type type, const QString& id, const Entry& entry) {
+    // written to a temporary file first: a power loss while writing must not leave a truncated body behind
+    QSaveFile file(filePath(type, id));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    // first line: snapshot id and ETag separated by a tab, followed by the reply body
+    file.write(entry.snapshotId.toUtf8());
+    file.write("\t");
+    file.write(entry.etag);
+    file.write("\n");
+    file.write(entry.body);
+    if (!file.commit()) {
+        return;
+    }
+
+    if (++m_writesSincePrune >= PRUNE_INTERVAL) {
+        m_writesSincePrune = 0;
+        pruneDisk();
+    }
+}
+
+bool MetadataCache::readFile(Type type, const QString& id, Entry* entry) {
+    QFile file(filePath(type, id));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray header = file.readLine();
+    if (header.endsWith('\n')) {
+        header.chop(1);
+    }
+    int tab = header.indexOf('\t');
+    entry->snapshotId = QString::fromUtf8(tab < 0 ? header : header.left(tab));
+    entry->etag = tab < 0 ? QByteArray() : header.mid(tab + 1);
+    entry->body = file.readAll();
+    entry->fetched = QFileInfo(file).lastModified().toUTC();
+    return !entry->body.isEmpty();
+}
+
+void MetadataCache::pruneDisk() {
+    QDir          dir(m_directory);
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Time);
+
+    qint64 total = 0;
+    for (const QFileInfo& info : files) {
+        total += info.size();
+    }
+
+    // sorted newest first: drop from the end
+    while (total > m_diskBytes && !files.isEmpty()) {
+        QFileInfo oldest = files.takeLast();
+        total -= oldest.size();
+        QFile::remove(oldest.absoluteFilePath());
+    }
+}
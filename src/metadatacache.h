@@ -0,0 +1,91 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QCache>
+#include <QDateTime>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// METADATA CACHE
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Two-tier cache of Web API reply bodies, keyed by object type and Spotify ID.
+/// The memory tier is an LRU bounded by the total size of the cached bodies. Every entry is also written to a file in
+/// the cache directory, so it survives a restart; the directory is pruned oldest-first when it exceeds its size limit.
+/// Entries older than the TTL of their type are still returned, but must be revalidated by the caller.
+class MetadataCache {
+ public:
+    enum Type { TRACK = 0, ALBUM, ARTIST, PLAYLIST, USER_PLAYLISTS, TYPE_COUNT };
+
+    struct Entry {
+        QByteArray body;
+        QDateTime  fetched;
+        QString    snapshotId;  // playlists only
+        QByteArray etag;        // for conditional requests, if the server sent one
+    };
+
+    struct Stats {
+        quint64 memoryHits = 0;
+        quint64 diskHits = 0;
+        quint64 misses = 0;
+        quint64 notModified = 0;  // revalidations answered with 304
+    };
+
+    explicit MetadataCache(const QString& directory, int memoryBytes = 2 * 1024 * 1024,
+                           qint64 diskBytes = 16 * 1024 * 1024);
+
+    bool lookup(Type type, const QString& id, Entry* entry);
+    void insert(Type type, const QString& id, const QByteArray& body, const QString& snapshotId = QString(),
+                const QByteArray& etag = QByteArray());
+
+    // drops the entry from both tiers, e.g. if its body cannot be decoded
+    void remove(Type type, const QString& id);
+
+    // the cached entry was confirmed to be up to date
+    void touch(Type type, const QString& id);
+
+    // the server answered a conditional request with 304
+    void notModified(Type type, const QString& id);
+
+    bool isFresh(Type type, const Entry& entry) const;
+
+    Stats stats() const { return m_stats; }
+
+    static int ttl(Type type);
+
+ private:
+    QString key(Type type, const QString& id) const;
+    QString filePath(Type type, const QString& id) const;
+    void    writeFile(Type type, const QString& id, const Entry& entry);
+    bool    readFile(Type type, const QString& id, Entry* entry);
+    void    pruneDisk();
+
+ private:
+    QString                m_directory;
+    QCache<QString, Entry> m_memory;
+    qint64                 m_diskBytes;
+    int                    m_writesSincePrune = 0;
+    Stats                  m_stats;
+};
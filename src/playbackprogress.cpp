@@ -0,0 +1,93 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "playbackprogress.h"
+
+PlaybackProgress::PlaybackProgress(QObject* parent) : QObject(parent), m_timer(new QTimer(this)) {
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(m_timer, &QTimer::timeout, this, &PlaybackProgress::onTimeout);
+}
+
+void PlaybackProgress::setGranularity(int ms) {
+    m_granularity = qMax(1000, ms);
+    if (m_timer->isActive()) {
+        schedule();
+    }
+}
+
+void PlaybackProgress::update(qint64 progressMs, qint64 durationMs, bool playing) {
+    m_progressMs = progressMs;
+    m_durationMs = durationMs;
+    m_playing = playing;
+    m_clock.start();
+
+    emitPosition();
+    schedule();
+}
+
+void PlaybackProgress::stop() {
+    m_timer->stop();
+    m_playing = false;
+    m_progressMs = 0;
+    m_durationMs = 0;
+    m_emitted = -1;
+}
+
+qint64 PlaybackProgress::position() const {
+    qint64 ms = m_progressMs;
+    if (m_playing && m_clock.isValid()) {
+        ms += m_clock.elapsed();
+    }
+    return m_durationMs > 0 ? qMin(ms, m_durationMs) : ms;
+}
+
+void PlaybackProgress::onTimeout() {
+    m_wakeups++;
+    emitPosition();
+    schedule();
+}
+
+void PlaybackProgress::emitPosition() {
+    // rounded down to the granularity
+    qint64 step = position() / m_granularity * m_granularity;
+    int    seconds = static_cast<int>(step / 1000);
+    if (seconds != m_emitted) {
+        m_emitted = seconds;
+        emit positionChanged(seconds);
+    }
+}
+
+void PlaybackProgress::schedule() {
+    qint64 now = position();
+    if (!m_playing || (m_durationMs > 0 && now >= m_durationMs)) {
+        m_timer->stop();
+        return;
+    }
+
+    // wake up exactly when the next step is reached
+    qint64 next = (now / m_granularity + 1) * m_granularity;
+    if (m_durationMs > 0) {
+        next = qMin(next, m_durationMs);
+    }
+    m_timer->start(static_cast<int>(qMax<qint64>(1, next - now)));
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// PLAYBACK PROGRESS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Position in the current track, interpolated with a monotonic clock from the last progress reported by the API.
+/// The position is computed when needed instead of counted up. positionChanged() is emitted only when the position
+/// crosses a multiple of the granularity, and no timer runs while playback is paused.
+class PlaybackProgress : public QObject {
+    Q_OBJECT
+
+ public:
+    explicit PlaybackProgress(QObject* parent = nullptr);
+
+    void setGranularity(int ms);
+    int  granularity() const { return m_granularity; }
+
+    // progress reported by the API, snaps the interpolated position
+    void update(qint64 progressMs, qint64 durationMs, bool playing);
+
+    // nothing is playing anymore
+    void stop();
+
+    qint64 position() const;
+    qint64 remaining() const { return qMax<qint64>(0, m_durationMs - position()); }
+
+    quint64 wakeups() const { return m_wakeups; }
+
+ signals:
+    void positionChanged(int seconds);
+
+ private slots:
+    void onTimeout();
+
+ private:
+    void emitPosition();
+    void schedule();
+
+ private:
+    QTimer*       m_timer;
+    QElapsedTimer m_clock;  // started when the progress was received
+    qint64        m_progressMs = 0;
+    qint64        m_durationMs = 0;
+    bool          m_playing = false;
+    int           m_granularity = 1000;
+    int           m_emitted = -1;
+    quint64       m_wakeups = 0;
+};
@@ -0,0 +1,64 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// PLAYER STATE PROVIDER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Source of player state updates. A provider either asks for the state to be fetched with GET /v1/me/player, as the
+/// poll scheduler does, or delivers the state itself as soon as it changes, as a push connection does.
+class PlayerStateProvider : public QObject {
+    Q_OBJECT
+
+ public:
+    enum PlayerState { UNKNOWN = 0, PLAYING, PAUSED, IDLE, NO_DEVICE, STATE_COUNT };
+
+    explicit PlayerStateProvider(QObject* parent = nullptr) : QObject(parent) {}
+
+    virtual void start() = 0;
+    virtual void stop() = 0;
+    virtual bool isActive() const = 0;
+
+    // a user command was sent: the result should be visible quickly
+    virtual void commandSent() {}
+
+    // the state which was just shown. remainingMs is the time left in the current track, or -1 if unknown
+    virtual void playerStateReceived(PlayerState state, int remainingMs = -1) {
+        Q_UNUSED(state)
+        Q_UNUSED(remainingMs)
+    }
+
+ signals:
+    // the state has to be fetched with GET /v1/me/player
+    void fetchRequested();
+
+    // the state in the format of /v1/me/player; empty if nothing is playing
+    void stateReceived(const QByteArray& body);
+
+    // a push provider is (no longer) able to deliver states, another provider has to take over in the meantime
+    void connectedChanged(bool connected);
+};
@@ -0,0 +1,147 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "pollscheduler.h"
+
+PollScheduler::PollScheduler(QObject* parent) : PlayerStateProvider(parent), m_timer(new QTimer(this)) {
+    m_timer->setSingleShot(true);
+    QObject::connect(m_timer, &QTimer::timeout, this, &PollScheduler::onTimeout);
+}
+
+void PollScheduler::start() {
+    m_state = UNKNOWN;
+    m_stateReceived = true;
+    m_backoff = 0;
+    m_fastPolls = 0;
+    m_remainingMs = -1;
+
+    // first poll right away
+    m_interval = 0;
+    m_timer->start(0);
+}
+
+void PollScheduler::stop() {
+    m_timer->stop();
+}
+
+void PollScheduler::commandSent() {
+    m_fastPolls = FAST_POLLS;
+    m_backoff = 0;
+    if (m_timer->isActive()) {
+        reschedule();
+    }
+}
+
+void PollScheduler::playerStateReceived(PlayerState state, int remainingMs) {
+    if (state != m_state || state == PLAYING) {
+        m_backoff = 0;
+    }
+    m_state = state;
+    m_remainingMs = remainingMs;
+    m_stateReceived = true;
+    if (m_timer->isActive()) {
+        reschedule();
+    }
+}
+
+void PollScheduler::rateLimited(int retryAfterSeconds) {
+    m_backoff++;
+    pause(qMax(1, retryAfterSeconds) * 1000);
+}
+
+void PollScheduler::pause(int ms) {
+    QDateTime until = QDateTime::currentDateTimeUtc().addMSecs(ms);
+    if (!m_pausedUntil.isValid() || until > m_pausedUntil) {
+        m_pausedUntil = until;
+    }
+    if (m_timer->isActive()) {
+        reschedule();
+    }
+}
+
+const char* PollScheduler::stateName(PlayerState state) {
+    switch (state) {
+        case PLAYING:
+            return "playing";
+        case PAUSED:
+            return "paused";
+        case IDLE:
+            return "idle";
+        case NO_DEVICE:
+            return "no_device";
+        default:
+            return "unknown";
+    }
+}
+
+void PollScheduler::onTimeout() {
+    m_hits[m_state]++;
+
+    // a poll without answer (empty reply, network error) counts as idle
+    if (!m_stateReceived) {
+        m_state = IDLE;
+        m_backoff++;
+    } else if (m_state != PLAYING && m_fastPolls == 0) {
+        m_backoff++;
+    }
+    m_stateReceived = false;
+    if (m_fastPolls > 0) {
+        m_fastPolls--;
+    }
+
+    // fallback in case no state is reported for this poll
+    reschedule();
+
+    emit fetchRequested();
+}
+
+void PollScheduler::reschedule() {
+    int interval;
+
+    if (m_fastPolls > 0) {
+        interval = FAST_INTERVAL;
+    } else if (m_state == PLAYING || m_state == UNKNOWN) {
+        interval = PLAYING_INTERVAL;
+        if (m_remainingMs >= 0 && m_remainingMs + TRACK_END_MARGIN < interval) {
+            // catch the track change as soon as it happens
+            interval = m_remainingMs + TRACK_END_MARGIN;
+        }
+    } else {
+        qint64 backoff = static_cast<qint64>(BACKOFF_BASE_INTERVAL) << qMin(m_backoff, 4);
+        interval = static_cast<int>(qMin<qint64>(backoff, BACKOFF_MAX_INTERVAL));
+    }
+
+    if (m_pausedUntil.isValid()) {
+        qint64 wait = QDateTime::currentDateTimeUtc().msecsTo(m_pausedUntil);
+        if (wait > 0) {
+            interval = qMax(interval, static_cast<int>(wait));
+        } else {
+            m_pausedUntil = QDateTime();
+        }
+    }
+
+    if (interval != m_interval) {
+        m_interval = interval;
+        emit intervalChanged(interval);
+    }
+    m_timer->start(interval);
+}
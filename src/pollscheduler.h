@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QDateTime>
+#include <QTimer>
+
+#include "playerstateprovider.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// POLL SCHEDULER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Player state provider which polls, deciding when the player state is fetched next.
+/// - a few fast polls right after a user command
+/// - one poll right after the expected end of the current track
+/// - exponential back off while paused, idle or without an active device
+/// - never earlier than a Retry-After received with a 429 response, or while polling is paused
+class PollScheduler : public PlayerStateProvider {
+    Q_OBJECT
+
+ public:
+    explicit PollScheduler(QObject* parent = nullptr);
+
+    void start() override;
+    void stop() override;
+    bool isActive() const override { return m_timer->isActive(); }
+
+    void commandSent() override;
+    void playerStateReceived(PlayerState state, int remainingMs = -1) override;
+
+    // the server asked to slow down
+    void rateLimited(int retryAfterSeconds);
+
+    // no polls for the given time, e.g. while the API is down
+    void pause(int ms);
+
+    int     currentInterval() const { return m_interval; }
+    quint64 hits(PlayerState state) const { return m_hits[state]; }
+
+    static const char* stateName(PlayerState state);
+
+ signals:
+    void intervalChanged(int interval);
+
+ private slots:
+    void onTimeout();
+
+ private:
+    void reschedule();
+
+ private:
+    static const int FAST_INTERVAL = 1000;
+    static const int FAST_POLLS = 3;
+    static const int PLAYING_INTERVAL = 10000;
+    static const int BACKOFF_BASE_INTERVAL = 15000;
+    static const int BACKOFF_MAX_INTERVAL = 120000;
+    static const int TRACK_END_MARGIN = 500;
+
+    QTimer*     m_timer;
+    PlayerState m_state = UNKNOWN;
+    bool        m_stateReceived = true;
+    int         m_remainingMs = -1;
+    int         m_fastPolls = 0;
+    int         m_backoff = 0;
+    int         m_interval = FAST_INTERVAL;
+    QDateTime   m_pausedUntil;
+    quint64     m_hits[STATE_COUNT] = {};
+};
@@ -0,0 +1,68 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "retrypolicy.h"
+
+#include <QRandomGenerator>
+
+RetryPolicy::RetryPolicy(int maxRetries, int baseDelay, int maxDelay)
+    : m_maxRetries(maxRetries), m_baseDelay(baseDelay), m_maxDelay(maxDelay) {}
+
+int RetryPolicy::delay(QNetworkReply* reply, int attempt) const {
+    if (attempt >= m_maxRetries) {
+        return -1;
+    }
+
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode == 429) {
+        int retryAfter = qMax(1, reply->rawHeader("Retry-After").toInt()) * 1000;
+        return retryAfter <= m_maxDelay ? retryAfter : -1;
+    }
+    if (!isFailure(reply) || statusCode == 501) {
+        return -1;
+    }
+
+    int backoff = static_cast<int>(qMin<qint64>(static_cast<qint64>(m_baseDelay) << attempt, m_maxDelay));
+    return static_cast<int>(QRandomGenerator::global()->bounded(backoff + 1));
+}
+
+bool RetryPolicy::notSent(QNetworkReply* reply) {
+    switch (reply->error()) {
+        case QNetworkReply::ConnectionRefusedError:
+        case QNetworkReply::HostNotFoundError:
+        case QNetworkReply::TemporaryNetworkFailureError:
+        case QNetworkReply::NetworkSessionFailedError:
+        case QNetworkReply::UnknownNetworkError:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool RetryPolicy::isFailure(QNetworkReply* reply) {
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode == 0) {
+        // aborted by the client, e.g. superseded by a newer request
+        return reply->error() != QNetworkReply::OperationCanceledError;
+    }
+    return statusCode >= 500;
+}
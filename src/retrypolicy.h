@@ -0,0 +1,51 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QNetworkReply>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// RETRY POLICY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Decides if and when a failed request is sent again. Network errors and server errors (5xx) are retried with an
+/// exponential backoff and full jitter, so remotes which lost the connection at the same time do not come back in
+/// lockstep. A 429 is retried after its Retry-After, unless that is longer than the maximum delay.
+class RetryPolicy {
+ public:
+    explicit RetryPolicy(int maxRetries = 3, int baseDelay = 500, int maxDelay = 8000);
+
+    // delay in ms before attempt + 1 of the request, or -1 if it must not be retried
+    int delay(QNetworkReply* reply, int attempt) const;
+
+    // the request never reached the server, so even a request which is not idempotent can be sent again
+    static bool notSent(QNetworkReply* reply);
+
+    // the server is unreachable or broken; 4xx replies are the fault of the request and do not count
+    static bool isFailure(QNetworkReply* reply);
+
+ private:
+    int m_maxRetries;
+    int m_baseDelay;
+    int m_maxDelay;
+};
@@ -22,9 +22,30 @@
 
 #include "spotify.h"
 
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QUrlQuery>
+
+// Item types and command lists shared by all browse and search items. QString and QStringList are implicitly shared:
+// an item only keeps a reference, where a literal would be converted into a new copy for every item.
+static const QString     TYPE_ALBUM = QStringLiteral("album");
+static const QString     TYPE_ARTIST = QStringLiteral("artist");
+static const QString     TYPE_DEVICE = QStringLiteral("device");
+static const QString     TYPE_PLAYLIST = QStringLiteral("playlist");
+static const QString     TYPE_TRACK = QStringLiteral("track");
+static const QStringList TRACK_COMMANDS = {"PLAY", "SONGRADIO", "QUEUE"};
+static const QStringList ARTIST_COMMANDS = {"ARTISTRADIO"};
+static const QStringList PLAYLIST_COMMANDS = {"PLAY", "PLAYLISTRADIO", "QUEUE"};
+static const QStringList USER_PLAYLIST_COMMANDS = {"PLAY", "PLAYLISTRADIO"};
+static const QStringList DEVICE_COMMANDS = {"PLAY"};
 
 SpotifyPlugin::SpotifyPlugin() : Plugin("yio.plugin.spotify", USE_WORKER_THREAD) {}
 
@@ -38,7 +59,20 @@ Integration* SpotifyPlugin::createIntegration(const QVariantMap& config, Entitie
 
 Spotify::Spotify(const QVariantMap& config, EntitiesInterface* entities, NotificationsInterface* notifications,
                  YioAPIInterface* api, ConfigInterface* configObj, Plugin* plugin)
-    : Integration(config, entities, notifications, api, configObj, plugin) {
+    : Integration(config, entities, notifications, api, configObj, plugin),
+      m_http(new HttpClient(this)),
+      m_cache(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/spotify"),
+      m_telemetry(new Telemetry(this)) {
+    // seconds between progress updates
+    int progressGranularity = 1;
+
+    // request telemetry, logged every interval (seconds) and on disconnect
+    bool telemetry = false;
+    int  telemetryInterval = 0;
+
+    // push connection for player states, e.g. ws://host:port/ of a local stand-in; polled if not set
+    QString stateUrl;
+
     for (QVariantMap::const_iterator iter = config.begin(); iter != config.end(); ++iter) {
         if (iter.key() == Integration::OBJ_DATA) {
             QVariantMap map = iter.value().toMap();
@@ -47,16 +81,82 @@ Spotify::Spotify(const QVariantMap& config, EntitiesInterface* entities, Notific
             //            m_accessToken   = map.value("access_token").toString();
             m_refreshToken = map.value("refresh_token").toString();
             m_entityId = map.value("entity_id").toString();
+            progressGranularity = map.value("progress_granularity", progressGranularity).toInt();
+            m_apiURL = map.value("api_url", m_apiURL).toString();
+            m_accountsURL = map.value("accounts_url", m_accountsURL).toString();
+            telemetry = map.value("telemetry", telemetry).toBool();
+            telemetryInterval = map.value("telemetry_interval", telemetryInterval).toInt();
+            stateUrl = map.value("state_url").toString();
         }
     }
 
-    m_pollingTimer = new QTimer(this);
-    m_pollingTimer->setInterval(4000);
-    QObject::connect(m_pollingTimer, &QTimer::timeout, this, &Spotify::onPollingTimerTimeout);
+    m_telemetry->setEnabled(telemetry);
+    m_telemetry->setReportInterval(telemetryInterval * 1000);
+    m_http->setTelemetry(m_telemetry);
+    m_http->setMaxLowPriorityRequests(PREFETCH_CONCURRENCY);
+    QObject::connect(m_telemetry, &Telemetry::reported, this, [=](const QVariantMap& snapshot) {
+        QByteArray json = QJsonDocument::fromVariant(snapshot).toJson(QJsonDocument::Compact);
+        qCDebug(m_logCategory).noquote() << "Telemetry:" << json;
+    });
+
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/spotify";
+    m_tokens = new TokenManager(m_http, m_accountsURL + "/api/token", m_clientId, m_clientSecret, m_refreshToken,
+                                dataDir + "/token.ini", m_logCategory, this);
+    RetryPolicy    retry(RETRY_MAX, RETRY_BASE_DELAY, RETRY_MAX_DELAY);
+    CircuitBreaker breakers(BREAKER_THRESHOLD, BREAKER_COOL_DOWN, BREAKER_MAX_COOL_DOWN);
+    m_api = new WebApi(m_http, m_tokens, m_telemetry, m_apiURL, retry, breakers, m_logCategory, this);
+    m_playerSnapshotPath = dataDir + "/player.snapshot";
+    m_images = new ImageCache(dataDir + "/images", IMAGE_CACHE_SIZE, this);
+
+    m_pollScheduler = new PollScheduler(this);
+    QObject::connect(m_pollScheduler, &PlayerStateProvider::fetchRequested, this, &Spotify::onPollingTimerTimeout);
+    QObject::connect(m_pollScheduler, &PollScheduler::intervalChanged, this,
+                     [=](int interval) { qCDebug(m_logCategory) << "Polling interval:" << interval; });
+    QObject::connect(m_api, &WebApi::rateLimited, m_pollScheduler, &PollScheduler::rateLimited);
+
+    if (!stateUrl.isEmpty()) {
+        WebSocketStateProvider::TokenSource token = [=]() { return m_tokens->accessToken(); };
+        m_pushProvider = new WebSocketStateProvider(QUrl(stateUrl), token, this);
+        QObject::connect(m_pushProvider, &PlayerStateProvider::fetchRequested, this, &Spotify::getCurrentPlayer);
+        QObject::connect(m_pushProvider, &PlayerStateProvider::stateReceived, this, [=](const QByteArray& body) {
+            m_pushedStates++;
+            handlePlayerReply(body.isEmpty() ? 204 : 200, body);
+        });
+        QObject::connect(m_pushProvider, &PlayerStateProvider::connectedChanged, this,
+                         &Spotify::onPushConnectedChanged);
+    }
 
-    m_progressBarTimer = new QTimer(this);
-    m_progressBarTimer->setInterval(1000);
-    QObject::connect(m_progressBarTimer, &QTimer::timeout, this, &Spotify::onProgressBarTimerTimeout);
+    // wait for a pause in typing before searching
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(SEARCH_DEBOUNCE);
+    QObject::connect(m_searchTimer, &QTimer::timeout, this, [=]() { search(m_pendingSearch); });
+    m_searchCache.setMaxCost(SEARCH_CACHE_SIZE);
+
+    // start polling as soon as there is a token; the push connection needs it too. A refresh for a request which was
+    // still running at disconnect() must not wake them up in standby.
+    QObject::connect(m_tokens, &TokenManager::tokenReady, this, [=]() {
+        if (!m_connected) {
+            return;
+        }
+        if (m_pushProvider && !m_pushProvider->isActive()) {
+            m_pushProvider->start();
+        }
+        if (!m_pushConnected && !m_pollScheduler->isActive()) {
+            m_pollScheduler->start();
+        }
+    });
+
+    m_volumeControl = new ThrottledControl(VOLUME_THROTTLE, [=](int volume) {
+        putRequest("/v1/me/player/volume?volume_percent=" + QString::number(volume), "", nullptr, "volume");
+    }, this);
+    m_seekControl = new ThrottledControl(SEEK_THROTTLE, [=](int positionMs) {
+        putRequest("/v1/me/player/seek?position_ms=" + QString::number(positionMs), "", nullptr, "seek");
+    }, this);
+
+    m_progress = new PlaybackProgress(this);
+    m_progress->setGranularity(progressGranularity * 1000);
+    QObject::connect(m_progress, &PlaybackProgress::positionChanged, this, &Spotify::onProgressChanged);
 
     // add available entity
     QStringList supportedFeatures;
@@ -90,17 +190,99 @@ Spotify::Spotify(const QVariantMap& config, EntitiesInterface* entities, Notific
 
 void Spotify::connect() {
     setState(CONNECTED);
+    m_connected = true;
+
+    // open the connection to the Web API while the token is being refreshed
+    m_http->warmUp(QUrl(m_apiURL));
+    m_connectedTime.start();
+    m_renderPending = true;
+    m_livePending = true;
+
+    if (m_startup) {
+        m_startup = false;
+
+        // show the last known player state right away, the first poll reconciles it
+        if (restorePlayer()) {
+            qCDebug(m_logCategory) << "Cold start: player snapshot restored after" << m_connectedTime.elapsed() << "ms";
+        }
+
+        // load the playlists into the memory cache, so the browse model can be shown without disk access
+        MetadataCache::Entry playlists;
+        m_cache.lookup(MetadataCache::USER_PLAYLISTS, "me", &playlists);
+    } else if (m_player.state >= 0) {
+        // standby wake: the entity still shows the last state
+        m_renderPending = false;
+        qCDebug(m_logCategory) << "Standby wake: last player state still shown";
+    }
+
+    // a stored token which is still valid is used right away, otherwise a new one is requested
+    m_tokens->start();
+
+    // speaker selection works from the cached list, it is fetched once the token is there
+    refreshDevices(false);
 
-    // get a new access token
-    refreshAccessToken();
+    // commands given while the connection was gone, e.g. right before standby
+    m_api->replayOffline();
 
     qCDebug(m_logCategory) << "STARTING SPOTIFY";
 }
 
 void Spotify::disconnect() {
     setState(DISCONNECTED);
-    m_pollingTimer->stop();
-    m_progressBarTimer->stop();
+    m_connected = false;
+    m_tokens->stop();
+    m_pollScheduler->stop();
+    if (m_pushProvider) {
+        m_pushProvider->stop();
+        m_pushConnected = false;
+    }
+    m_progress->stop();
+
+    // waiting retries would send requests, and refresh the token for them, in standby
+    m_api->cancelRetries();
+
+    HttpClient::Stats stats = m_http->stats();
+    qCDebug(m_logCategory) << "HTTP requests:" << stats.requests << "connections opened:" << stats.connectionsOpened
+                           << "reused:" << stats.connectionsReused << "HTTP/2:" << stats.http2Replies;
+    qCDebug(m_logCategory) << "HTTP requests coalesced:" << stats.coalesced << "collapsed:" << stats.collapsed;
+    if (m_connectedTime.isValid() && m_connectedTime.elapsed() > 0) {
+        qCDebug(m_logCategory) << "HTTP requests per second:" << stats.requests * 1000.0 / m_connectedTime.elapsed();
+    }
+    m_telemetry->report();
+    WebApi::Stats apiStats = m_api->stats();
+    qCDebug(m_logCategory) << "Retries:" << apiStats.retries << "circuit breakers opened:" << m_api->breakers().opened()
+                           << "requests held back:" << m_api->breakers().rejected()
+                           << "offline commands replayed:" << apiStats.offlineReplayed
+                           << "dropped:" << apiStats.offlineDropped;
+    qCDebug(m_logCategory) << "Token refreshes:" << m_tokens->refreshes()
+                           << "requests waiting for a token:" << m_tokens->parked();
+    qCDebug(m_logCategory) << "Attribute updates emitted:" << m_updatesEmitted << "suppressed:" << m_updatesSuppressed;
+    qCDebug(m_logCategory) << "Reply handling on worker thread (ms):" << apiStats.handlerNs / 1000000
+                           << "entity and model updates on main thread (ms):" << m_mainThreadNs / 1000000;
+
+    qCDebug(m_logCategory) << "Progress timer wakeups:" << m_progress->wakeups();
+    qCDebug(m_logCategory) << "Volume changes:" << m_volumeControl->changes() << "sent:" << m_volumeControl->sent()
+                           << "seek changes:" << m_seekControl->changes() << "sent:" << m_seekControl->sent();
+
+    ImageCache::Stats imageStats = m_images->stats();
+    qCDebug(m_logCategory) << "Image cache hits:" << imageStats.hits << "misses:" << imageStats.misses
+                           << "downloads:" << imageStats.downloads << "bytes:" << imageStats.bytes;
+
+    MetadataCache::Stats cacheStats = m_cache.stats();
+    qCDebug(m_logCategory) << "Metadata cache memory hits:" << cacheStats.memoryHits
+                           << "disk hits:" << cacheStats.diskHits << "misses:" << cacheStats.misses
+                           << "not modified:" << cacheStats.notModified << "prefetched:" << m_prefetched
+                           << "low priority requests:" << stats.lowPriority
+                           << "interned string bytes:" << m_internedBytes;
+    qCDebug(m_logCategory) << "Player polls:" << m_polls << "bytes:" << m_pollBytes
+                           << "parse time (us):" << m_pollParseNs / 1000 << "empty:" << m_pollsEmpty
+                           << "unchanged:" << m_pollsUnchanged << "pushed:" << m_pushedStates;
+    qCDebug(m_logCategory) << "Play/queue latency (ms):" << m_commandLatency.toString();
+    for (int i = PollScheduler::UNKNOWN; i < PollScheduler::STATE_COUNT; i++) {
+        PollScheduler::PlayerState state = static_cast<PollScheduler::PlayerState>(i);
+        qCDebug(m_logCategory) << "Polls while" << PollScheduler::stateName(state) << ":"
+                               << m_pollScheduler->hits(state);
+    }
 }
 
 void Spotify::enterStandby() {
@@ -111,497 +293,780 @@ void Spotify::leaveStandby() {
     connect();
 }
 
-void Spotify::refreshAccessToken() {
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
-    QNetworkRequest        request;
+void Spotify::search(QString query) {
+    search(query, "album,artist,playlist,track", "20", "0");
+}
+
+void Spotify::search(QString query, QString type) {
+    search(query, type, "20", "0");
+}
+
+void Spotify::search(QString query, QString type, QString limit, QString offset) {
+    QString url = "/v1/search";
+    QString key = searchKey(query, type, limit, offset);
+
+    // the hits of the previous search are not of interest anymore
+    cancelPrefetch();
 
-    QObject* context = new QObject(this);
+    SpotifySearchResult* cached = m_searchCache.object(key);
+    if (cached) {
+        // drop a running search for an older query
+        m_api->cancelSuperseded("search");
+        showSearchResult(key, *cached);
+        prefetchSearchHits(*cached);
+        return;
+    }
 
-    QObject::connect(manager, &QNetworkAccessManager::finished, context, [=](QNetworkReply* reply) {
-        if (reply->error()) {
-            qCWarning(m_logCategory) << "Refresh token:" << reply->errorString();
-            //            qCWarning(m_logCategory) << reply->readAll();
+    QUrlQuery urlQuery;
+    urlQuery.addQueryItem("q", query);
+    urlQuery.addQueryItem("type", type);
+    urlQuery.addQueryItem("limit", limit);
+    urlQuery.addQueryItem("offset", offset);
+
+    // a newer search makes the result of a still running one obsolete
+    getRequest(url, "?" + urlQuery.toString(QUrl::FullyEncoded), "search", [=](const QByteArray& body) {
+        QElapsedTimer timer;
+        timer.start();
+        SpotifySearchResult* result = new SpotifySearchResult;
+        if (!SpotifyDecoder::decodeSearchResult(body, result)) {
+            qCWarning(m_logCategory) << "Invalid search result";
+            delete result;
+            return;
         }
+        m_telemetry->recordDecode(url, timer.nsecsElapsed());
+        m_searchCache.insert(key, result);
+        showSearchResult(key, *result);
+        prefetchSearchHits(*result);
+    });
+}
 
-        QString answer = reply->readAll();
+void Spotify::prefetchSearchHits(const SpotifySearchResult& result) {
+    for (int i = 0; i < result.albums.size() && i < PREFETCH_TOP_HITS; i++) {
+        prefetchMetadata(MetadataCache::ALBUM, "/v1/albums/", result.albums[i].id);
+    }
+    for (int i = 0; i < result.playlists.size() && i < PREFETCH_TOP_HITS; i++) {
+        prefetchMetadata(MetadataCache::PLAYLIST, "/v1/playlists/", result.playlists[i].id);
+    }
+}
 
-        // convert to json
-        QJsonParseError parseerror;
-        QJsonDocument   doc = QJsonDocument::fromJson(answer.toUtf8(), &parseerror);
-        if (parseerror.error != QJsonParseError::NoError) {
-            qCWarning(m_logCategory) << "JSON error : " << parseerror.errorString();
+void Spotify::prefetchMetadata(MetadataCache::Type type, const QString& url, const QString& id) {
+    // also loads an entry from disk into memory
+    MetadataCache::Entry entry;
+    bool                 cached = m_cache.lookup(type, id, &entry);
+    if (cached && m_cache.isFresh(type, entry)) {
+        return;
+    }
+
+    // the same URL as getAlbum() and getPlaylist(): opening the hit joins a prefetch which is still running
+    QString          key = "prefetch:" + id;
+    WebApi::ReplyHandler store = [=](int statusCode, const QByteArray& body, const QByteArray& etag) {
+        m_prefetchKeys.removeOne(key);
+        if (statusCode == 304) {
+            m_cache.notModified(type, id);
+            return;
+        }
+        if (body.isEmpty()) {
             return;
         }
-        QVariantMap map = doc.toVariant().toMap();
+        QString snapshotId = type == MetadataCache::PLAYLIST ? SpotifyDecoder::decodeSnapshotId(body) : QString();
+        m_cache.insert(type, id, body, snapshotId, etag);
+        m_prefetched++;
+    };
+    m_prefetchKeys.append(key);
+    m_api->get(url, id, key, cached ? entry.etag : QByteArray(), store, nullptr, QNetworkRequest::LowPriority);
+}
 
-        // store the refresh and acccess tokens
-        if (map.contains("access_token")) {
-            if (m_accessToken != map.value("access_token").toString()) {
-                qCDebug(m_logCategory) << "Got new access token";
-            }
-            m_accessToken = map.value("access_token").toString();
+void Spotify::cancelPrefetch() {
+    for (const QString& key : m_prefetchKeys) {
+        m_api->cancelSuperseded(key);
+    }
+    m_prefetchKeys.clear();
+}
+
+void Spotify::scheduleSearch(const QString& query) {
+    // the reply for the previous query must not replace the preview below, or show up after the query was cleared
+    m_api->cancelSuperseded("search");
+
+    if (query.trimmed().isEmpty()) {
+        m_searchTimer->stop();
+        return;
+    }
+    m_pendingSearch = query;
+
+    // show the result of the longest already searched prefix until the real result arrives
+    QString type = "album,artist,playlist,track";
+    for (int length = query.length(); length > 0; length--) {
+        QString              key = searchKey(query.left(length), type, "20", "0");
+        SpotifySearchResult* cached = m_searchCache.object(key);
+        if (cached) {
+            showSearchResult(key, *cached);
+            break;
         }
+    }
 
-        if (map.contains("expires_in")) {
-            m_tokenExpire = map.value("expires_in").toInt();
+    m_searchTimer->start();
+}
+
+QString Spotify::searchKey(const QString& query, const QString& type, const QString& limit, const QString& offset) {
+    return query.simplified().toLower() + "|" + type + "|" + limit + "|" + offset;
+}
+
+void Spotify::showSearchResult(const QString& key, const SpotifySearchResult& result) {
+    // the same result is already displayed
+    if (key == m_shownSearch) {
+        return;
+    }
+    m_shownSearch = key;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // artist, album and owner names repeat across the categories
+    StringPool strings;
+
+    // get the albums
+    SearchModelList* albums = new SearchModelList();
+    for (const SpotifyAlbum& album : result.albums) {
+        albums->append(SearchModelListItem(album.id, TYPE_ALBUM, album.name, strings.intern(album.artist),
+                                           imageFor(album.images, IMAGE_SIZE_LARGE), QVariant()));
+    }
+
+    // get the tracks
+    SearchModelList* tracks = new SearchModelList();
+    for (const SpotifyTrack& track : result.tracks) {
+        tracks->append(SearchModelListItem(track.id, TYPE_TRACK, track.name, strings.intern(track.albumName),
+                                           imageFor(track.albumImages, IMAGE_SIZE_SMALL), TRACK_COMMANDS));
+    }
+
+    // get the artists
+    SearchModelList* artists = new SearchModelList();
+    for (const SpotifyArtist& artist : result.artists) {
+        artists->append(SearchModelListItem(artist.id, TYPE_ARTIST, strings.intern(artist.name), "",
+                                            imageFor(artist.images, IMAGE_SIZE_SMALL), ARTIST_COMMANDS));
+    }
+
+    // get the playlists
+    SearchModelList* playlists = new SearchModelList();
+    for (const SpotifyPlaylist& playlist : result.playlists) {
+        playlists->append(SearchModelListItem(playlist.id, TYPE_PLAYLIST, playlist.name, strings.intern(playlist.owner),
+                                              imageFor(playlist.images, IMAGE_SIZE_LARGE), PLAYLIST_COMMANDS));
+    }
+    m_internedBytes += strings.takeSavedBytes();
+
+    SearchModelItem* ialbums = new SearchModelItem("albums", albums);
+    SearchModelItem* itracks = new SearchModelItem("tracks", tracks);
+    SearchModelItem* iartists = new SearchModelItem("artists", artists);
+    SearchModelItem* iplaylists = new SearchModelItem("playlists", playlists);
+
+    SearchModel* model = new SearchModel();
+
+    model->append(ialbums);
+    model->append(itracks);
+    model->append(iartists);
+    model->append(iplaylists);
+    m_telemetry->recordBuild("/v1/search", timer.nsecsElapsed());
+
+    // the category lists are used by QML too: they move to the main thread together with the model
+    for (SearchModelList* list : {albums, tracks, artists, playlists}) {
+        list->setParent(model);
+    }
+
+    // update the entity
+    model->moveToThread(QCoreApplication::instance()->thread());
+    withEntity([=](EntityInterface* entity) {
+        MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
+        me->setSearchModel(model);
+    });
+}
+
+void Spotify::getAlbum(QString id) {
+    QString url = "/v1/albums/";
+    QString endpoint = WebApi::endpointName(url + id);
+
+    getCached(MetadataCache::ALBUM, id, url, id, "browse", true, [=](const QByteArray& body) {
+        qCDebug(m_logCategory) << "GET ALBUM";
+        QElapsedTimer timer;
+        timer.start();
+        SpotifyAlbum album;
+        if (!SpotifyDecoder::decodeAlbum(body, &album)) {
+            qCWarning(m_logCategory) << "Invalid album" << id;
+            return false;
         }
+        m_telemetry->recordDecode(endpoint, timer.nsecsElapsed());
+        timer.start();
 
-        if (map.contains("refresh_token")) {
-            m_refreshToken = map.value("refresh_token").toString();
+        BrowseModel* model = new BrowseModel(nullptr, album.id, album.name, album.artist, TYPE_ALBUM,
+                                             imageFor(album.images, IMAGE_SIZE_LARGE), TRACK_COMMANDS);
+
+        // add tracks to album, most of them by the album artist
+        StringPool strings;
+        strings.intern(album.artist);
+        for (const SpotifyTrack& track : album.tracks) {
+            model->addItem(track.id, track.name, strings.intern(track.artist), TYPE_TRACK, "", TRACK_COMMANDS);
         }
+        m_internedBytes += strings.takeSavedBytes();
+        m_telemetry->recordBuild(endpoint, timer.nsecsElapsed());
 
-        // start timer with the expire date on the access token
-        m_tokenTimeOutTimer = new QTimer(this);
-        m_tokenTimeOutTimer->setSingleShot(true);
+        showBrowseModel(model);
+        return true;
+    });
 
-        // connect the token timeout timer to the function that handles the timeout
-        QObject::connect(m_tokenTimeOutTimer, &QTimer::timeout, this, &Spotify::onTokenTimeOut);
+    // after the request above, which took over a running prefetch of this album
+    cancelPrefetch();
+}
 
-        // get the token 60 seconds before expiry
-        qCDebug(m_logCategory) << "Token expiry time:" << m_tokenExpire;
-        if (m_tokenExpire >= 60) {
-            m_tokenExpire = m_tokenExpire - 60;
+void Spotify::getPlaylist(QString id, int offset) {
+    QString url = "/v1/playlists/";
+    QString endpoint = WebApi::endpointName(url + id);
+
+    getCached(MetadataCache::PLAYLIST, id, url, id, "browse", true, [=](const QByteArray& body) {
+        qCDebug(m_logCategory) << "GET PLAYLIST";
+        QElapsedTimer timer;
+        timer.start();
+        SpotifyPlaylist playlist;
+        if (!SpotifyDecoder::decodePlaylist(body, &playlist)) {
+            qCWarning(m_logCategory) << "Invalid playlist" << id;
+            return false;
         }
-        if (m_tokenExpire > 0) {
-            m_tokenTimeOutTimer->start(m_tokenExpire * 1000);
+        m_telemetry->recordDecode(endpoint, timer.nsecsElapsed());
+        timer.start();
+
+        BrowseModel* model = new BrowseModel(nullptr, playlist.id, playlist.name, playlist.owner, TYPE_PLAYLIST,
+                                             imageFor(playlist.images, IMAGE_SIZE_LARGE), TRACK_COMMANDS);
+
+        // one pool for all pages: artists repeat throughout a playlist
+        QSharedPointer<StringPool> strings(new StringPool());
 
-            // start polling
-            m_pollingTimer->start();
+        // add the first page of tracks to playlist; a later window starts with a link back instead
+        QString next = playlist.tracksNext;
+        if (offset == 0) {
+            for (const SpotifyTrack& track : playlist.tracks) {
+                model->addItem(track.id, track.name, strings->intern(track.artist), TYPE_TRACK, "", TRACK_COMMANDS);
+            }
+        } else {
+            BrowseItem back = windowLink(id, offset - BROWSE_WINDOW_PAGES * PLAYLIST_PAGE_SIZE, "Previous tracks");
+            model->addItem(back.id, back.title, back.subtitle, back.type, back.image, back.commands);
+            QString limit = QString::number(PLAYLIST_PAGE_SIZE);
+            next = QString("%1%2%3/tracks?offset=%4&limit=%5").arg(m_apiURL, url, id, QString::number(offset), limit);
         }
+        m_internedBytes += strings->takeSavedBytes();
+        m_telemetry->recordBuild(endpoint, timer.nsecsElapsed());
+
+        int generation = showBrowseModel(model);
 
-        reply->deleteLater();
-        context->deleteLater();
-        manager->deleteLater();
+        // the remaining tracks are appended page by page
+        PageDecoder decode = [=](const QByteArray& body, QVector<BrowseItem>* items) {
+            SpotifyTrackPage page;
+            if (!SpotifyDecoder::decodePlaylistTrackPage(body, &page)) {
+                return QString();
+            }
+            items->reserve(page.items.size());
+            for (const SpotifyTrack& track : page.items) {
+                items->append({track.id, track.name, strings->intern(track.artist), TYPE_TRACK, "", TRACK_COMMANDS});
+            }
+            m_internedBytes += strings->takeSavedBytes();
+            return page.next;
+        };
+        appendPages(generation, model, next, offset == 0 ? 1 : 0, decode, id);
+        return true;
     });
 
-    QObject::connect(
-        manager, &QNetworkAccessManager::networkAccessibleChanged, context,
-        [=](QNetworkAccessManager::NetworkAccessibility accessibility) { qCDebug(m_logCategory) << accessibility; });
+    // after the request above, which took over a running prefetch of this playlist
+    cancelPrefetch();
+}
 
-    QByteArray postData;
-    postData.append("grant_type=refresh_token&");
-    postData.append("refresh_token=");
-    postData.append(m_refreshToken);
+void Spotify::getUserPlaylists(int offset) {
+    QString url = "/v1/me/playlists/";
+    QString endpoint = WebApi::endpointName(url);
 
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    PageDecoder decode = [=](const QByteArray& body, QVector<BrowseItem>* items) {
+        SpotifyPlaylistPage next;
+        if (!SpotifyDecoder::decodePlaylistPage(body, &next)) {
+            return QString();
+        }
+        items->reserve(next.items.size());
+        for (const SpotifyPlaylist& playlist : next.items) {
+            QString image = imageFor(playlist.images, IMAGE_SIZE_LARGE);
+            items->append({playlist.id, playlist.name, "", TYPE_PLAYLIST, image, USER_PLAYLIST_COMMANDS});
+        }
+        return next.next;
+    };
+
+    // only the first window is cached, later ones are loaded page by page like the rest of the first one
+    if (offset > 0) {
+        BrowseModel* model = new BrowseModel(nullptr, "", "", "", TYPE_PLAYLIST, "", QStringList());
+        BrowseItem   back = windowLink("user", offset - BROWSE_WINDOW_PAGES * USER_PLAYLISTS_PAGE_SIZE, "Previous");
+        model->addItem(back.id, back.title, back.subtitle, back.type, back.image, back.commands);
+
+        int     generation = showBrowseModel(model);
+        QString next = QString("%1%2?offset=%3&limit=%4").arg(m_apiURL, url).arg(offset).arg(USER_PLAYLISTS_PAGE_SIZE);
+        appendPages(generation, model, next, 0, decode, "user");
+        cancelPrefetch();
+        return;
+    }
 
-    QString header_auth;
-    header_auth.append(m_clientId).append(":").append(m_clientSecret);
+    QString params = "?limit=" + QString::number(USER_PLAYLISTS_PAGE_SIZE);
+    getCached(MetadataCache::USER_PLAYLISTS, "me", url, params, "browse", true, [=](const QByteArray& body) {
+        qCDebug(m_logCategory) << "GET USERS PLAYLIST";
+        QElapsedTimer timer;
+        timer.start();
+        SpotifyPlaylistPage page;
+        if (!SpotifyDecoder::decodePlaylistPage(body, &page)) {
+            qCWarning(m_logCategory) << "Invalid user playlists";
+            return false;
+        }
+        m_telemetry->recordDecode(endpoint, timer.nsecsElapsed());
+        timer.start();
 
-    request.setRawHeader("Authorization", "Basic " + header_auth.toUtf8().toBase64());
-    request.setUrl(QUrl("https://accounts.spotify.com/api/token"));
+        BrowseModel* model = new BrowseModel(nullptr, "", "", "", TYPE_PLAYLIST, "", QStringList());
 
-    manager->post(request, postData);
-}
+        // add playlists to model
+        for (const SpotifyPlaylist& playlist : page.items) {
+            model->addItem(playlist.id, playlist.name, "", TYPE_PLAYLIST, imageFor(playlist.images, IMAGE_SIZE_LARGE),
+                           USER_PLAYLIST_COMMANDS);
+        }
+        m_telemetry->recordBuild(endpoint, timer.nsecsElapsed());
 
-void Spotify::search(QString query) {
-    search(query, "album,artist,playlist,track", "20", "0");
-}
+        int generation = showBrowseModel(model);
+        appendPages(generation, model, page.next, 1, decode, "user");
+        return true;
+    });
 
-void Spotify::search(QString query, QString type) {
-    search(query, type, "20", "0");
+    cancelPrefetch();
 }
 
-void Spotify::search(QString query, QString type, QString limit, QString offset) {
-    QString url = "/v1/search";
+int Spotify::showBrowseModel(BrowseModel* model) {
+    model->moveToThread(QCoreApplication::instance()->thread());
+    withEntity([=](EntityInterface* entity) {
+        MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
+        me->setBrowseModel(model);
+    });
 
-    query.replace(" ", "%20");
-
-    QObject* context = new QObject(this);
-
-    QObject::connect(this, &Spotify::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            // get the albums
-            SearchModelList* albums = new SearchModelList();
-
-            if (map.contains("albums")) {
-                QVariantList map_albums = map.value("albums").toMap().value("items").toList();
-
-                QStringList commands = {"PLAY", "ARTISTRADIO"};
-
-                for (int i = 0; i < map_albums.length(); i++) {
-                    QString id = map_albums[i].toMap().value("id").toString();
-                    QString title = map_albums[i].toMap().value("name").toString();
-                    QString subtitle =
-                        map_albums[i].toMap().value("artists").toList()[0].toMap().value("name").toString();
-                    QString image = "";
-                    if (map_albums[i].toMap().contains("images") &&
-                        map_albums[i].toMap().value("images").toList().length() > 0) {
-                        QVariantList images = map_albums[i].toMap().value("images").toList();
-                        for (int k = 0; k < images.length(); k++) {
-                            if (images[k].toMap().value("width").toInt() == 300) {
-                                image = images[k].toMap().value("url").toString();
-                            }
-                        }
-                        if (image == "") {
-                            image = map_albums[i].toMap().value("images").toList()[0].toMap().value("url").toString();
-                        }
-                    }
-
-                    SearchModelListItem item = SearchModelListItem(id, "album", title, subtitle, image, QVariant());
-                    albums->append(item);
-                }
-            }
+    // stops loading further pages into the previous model
+    return ++m_browseGeneration;
+}
 
-            // get the tracks
-            SearchModelList* tracks = new SearchModelList();
-
-            if (map.contains("tracks")) {
-                QVariantList map_tracks = map.value("tracks").toMap().value("items").toList();
-
-                QStringList commands = {"PLAY", "SONGRADIO", "QUEUE"};
-
-                for (int i = 0; i < map_tracks.length(); i++) {
-                    QString id = map_tracks[i].toMap().value("id").toString();
-                    QString title = map_tracks[i].toMap().value("name").toString();
-                    QString subtitle = map_tracks[i].toMap().value("album").toMap().value("name").toString();
-                    QString image = "";
-                    if (map_tracks[i].toMap().value("album").toMap().contains("images") &&
-                        map_tracks[i].toMap().value("album").toMap().value("images").toList().length() > 0) {
-                        QVariantList images = map_tracks[i].toMap().value("album").toMap().value("images").toList();
-                        for (int k = 0; k < images.length(); k++) {
-                            if (images[k].toMap().value("width").toInt() == 64) {
-                                image = images[k].toMap().value("url").toString();
-                            }
-                        }
-                        if (image == "") {
-                            image = map_tracks[i]
-                                        .toMap()
-                                        .value("album")
-                                        .toMap()
-                                        .value("images")
-                                        .toList()[0]
-                                        .toMap()
-                                        .value("url")
-                                        .toString();
-                        }
-                    }
-
-                    SearchModelListItem item = SearchModelListItem(id, "track", title, subtitle, image, commands);
-                    tracks->append(item);
-                }
+void Spotify::appendPages(int generation, QPointer<BrowseModel> model, const QString& next, int pages,
+                          const PageDecoder& decode, const QString& windowKey) {
+    if (next.isEmpty()) {
+        return;
+    }
+    if (pages >= BROWSE_WINDOW_PAGES) {
+        // the next window is only loaded on demand, and replaces this one
+        int        offset = QUrlQuery(QUrl(next)).queryItemValue("offset").toInt();
+        BrowseItem more = windowLink(windowKey, offset, "More");
+        withEntity([=](EntityInterface*) {
+            if (model) {
+                model->addItem(more.id, more.title, more.subtitle, more.type, more.image, more.commands);
             }
+        });
+        return;
+    }
 
-            // get the artists
-            SearchModelList* artists = new SearchModelList();
-
-            if (map.contains("artists")) {
-                QVariantList map_artists = map.value("artists").toMap().value("items").toList();
-
-                QStringList commands = {"ARTISTRADIO"};
-
-                for (int i = 0; i < map_artists.length(); i++) {
-                    QString id = map_artists[i].toMap().value("id").toString();
-                    QString title = map_artists[i].toMap().value("name").toString();
-                    QString subtitle = "";
-                    QString image = "";
-                    if (map_artists[i].toMap().contains("images") &&
-                        map_artists[i].toMap().value("images").toList().length() > 0) {
-                        QVariantList images = map_artists[i].toMap().value("images").toList();
-                        for (int k = 0; k < images.length(); k++) {
-                            if (images[k].toMap().value("width").toInt() == 64) {
-                                image = images[k].toMap().value("url").toString();
-                            }
-                        }
-                        if (image == "") {
-                            image = map_artists[i].toMap().value("images").toList()[0].toMap().value("url").toString();
-                        }
-                    }
-
-                    SearchModelListItem item = SearchModelListItem(id, "artist", title, subtitle, image, commands);
-                    artists->append(item);
-                }
+    // next is an absolute URL
+    QString path = next.startsWith(m_apiURL) ? next.mid(m_apiURL.length()) : next;
+
+    // give the UI time to render the current page before the next one arrives
+    QTimer::singleShot(BROWSE_PAGE_DELAY, this, [=]() {
+        if (generation != m_browseGeneration) {
+            return;
+        }
+        getRequest(path, "", "browse-page", [=](const QByteArray& body) {
+            if (generation != m_browseGeneration) {
+                return;
             }
+            QVector<BrowseItem> items;
+            QString             following = decode(body, &items);
 
-            // get the playlists
-            SearchModelList* playlists = new SearchModelList();
-
-            if (map.contains("playlists")) {
-                QVariantList map_playlists = map.value("playlists").toMap().value("items").toList();
-
-                QStringList commands = {"PLAY", "PLAYLISTRADIO", "QUEUE"};
-
-                for (int i = 0; i < map_playlists.length(); i++) {
-                    QString id = map_playlists[i].toMap().value("id").toString();
-                    QString title = map_playlists[i].toMap().value("name").toString();
-                    QString subtitle = map_playlists[i].toMap().value("owner").toMap().value("display_name").toString();
-                    QString image = "";
-                    if (map_playlists[i].toMap().contains("images") &&
-                        map_playlists[i].toMap().value("images").toList().length() > 0) {
-                        QVariantList images = map_playlists[i].toMap().value("images").toList();
-                        for (int k = 0; k < images.length(); k++) {
-                            if (images[k].toMap().value("width").toInt() == 300) {
-                                image = images[k].toMap().value("url").toString();
-                            }
-                        }
-                        if (image == "") {
-                            image =
-                                map_playlists[i].toMap().value("images").toList()[0].toMap().value("url").toString();
-                        }
-                    }
-
-                    SearchModelListItem item = SearchModelListItem(id, "playlist", title, subtitle, image, commands);
-                    playlists->append(item);
+            // the model belongs to the main thread, it may be gone by the time the items arrive
+            withEntity([=](EntityInterface*) {
+                if (!model) {
+                    return;
                 }
-            }
+                for (const BrowseItem& item : items) {
+                    model->addItem(item.id, item.title, item.subtitle, item.type, item.image, item.commands);
+                }
+            });
+            appendPages(generation, model, following, pages + 1, decode, windowKey);
+        });
+    });
+}
 
-            SearchModelItem* ialbums = new SearchModelItem("albums", albums);
-            SearchModelItem* itracks = new SearchModelItem("tracks", tracks);
-            SearchModelItem* iartists = new SearchModelItem("artists", artists);
-            SearchModelItem* iplaylists = new SearchModelItem("playlists", playlists);
+BrowseItem Spotify::windowLink(const QString& windowKey, int offset, const QString& title) {
+    offset = qMax(0, offset);
+    QString subtitle = QString("From #%1").arg(offset + 1);
+    return {windowKey + "@" + QString::number(offset), title, subtitle, TYPE_PLAYLIST, "", QStringList()};
+}
 
-            SearchModel* m_model = new SearchModel();
+void Spotify::getCurrentPlayer() {
+    QString url = "/v1/me/player";
 
-            m_model->append(ialbums);
-            m_model->append(itracks);
-            m_model->append(iartists);
-            m_model->append(iplaylists);
+    // the API is down: no polls until the circuit breaker lets the next probe through
+    int wait = m_api->retryIn(url);
+    if (wait > 0) {
+        m_pollScheduler->pause(wait);
+        return;
+    }
 
-            // update the entity
-            EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-            if (entity) {
-                MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                me->setSearchModel(m_model);
-            }
-        }
-        context->deleteLater();
+    m_api->get(url, "", "player", QByteArray(), [=](int statusCode, const QByteArray& body, const QByteArray&) {
+        m_polls++;
+        m_pollBytes += static_cast<quint64>(body.size());
+        handlePlayerReply(statusCode, body);
     });
+}
+
+void Spotify::handlePlayerReply(int statusCode, const QByteArray& body) {
+    // nothing is playing and there is no active device
+    if (statusCode == 204 || body.isEmpty()) {
+        m_pollsEmpty++;
+        m_lastPlayerBody.clear();
+        handlePlayerState(SpotifyPlayerState());
+        return;
+    }
+
+    // a paused or idle player answers with the same body every time: nothing to parse
+    if (body == m_lastPlayerBody) {
+        m_pollsUnchanged++;
+        m_pollScheduler->playerStateReceived(m_lastPollState, static_cast<int>(m_progress->remaining()));
+        return;
+    }
+
+    QElapsedTimer parsing;
+    parsing.start();
+    SpotifyPlayerState player;
+    bool               valid = SpotifyDecoder::decodePlayerState(body, &player);
+    qint64             parseNs = parsing.nsecsElapsed();
+    m_pollParseNs += parseNs;
+    m_telemetry->recordDecode("/v1/me/player", parseNs);
+    if (!valid) {
+        qCWarning(m_logCategory) << "Invalid player state";
+        return;
+    }
+
+    // the body can only stand for the shown state if no change by the user overrode it
+    bool settling = m_volumeControl->isSettling() || m_seekControl->isSettling();
+    m_lastPlayerBody = settling ? QByteArray() : body;
 
-    getRequest(url, "?q=" + query + "&type=" + type + "&limit=" + limit + "&offset=" + offset);
+    handlePlayerState(player);
 }
 
-void Spotify::getAlbum(QString id) {
-    QString url = "/v1/albums/";
+void Spotify::onPushConnectedChanged(bool connected) {
+    m_pushConnected = connected;
+    if (connected) {
+        // states arrive as they change: one fetch to be in sync, no polls from now on
+        qCDebug(m_logCategory) << "Player state push connected, polling stopped";
+        m_pollScheduler->stop();
+        getCurrentPlayer();
+    } else if (m_tokens->isValid()) {
+        qCDebug(m_logCategory) << "Player state push lost, polling";
+        m_pollScheduler->start();
+    }
+}
 
-    QObject* context = new QObject(this);
-
-    QObject::connect(this, &Spotify::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            qCDebug(m_logCategory) << "GET ALBUM";
-            QString id = map.value("id").toString();
-            QString title = map.value("name").toString();
-            QString subtitle = map.value("artists").toList()[0].toMap().value("name").toString();
-            QString type = "album";
-            QString image = "";
-            if (map.contains("images") && map.value("images").toList().length() > 0) {
-                QVariantList images = map.value("images").toList();
-                for (int k = 0; k < images.length(); k++) {
-                    if (images[k].toMap().value("width").toInt() == 300) {
-                        image = images[k].toMap().value("url").toString();
-                    }
-                }
-                if (image == "") {
-                    image = map.value("images").toList()[0].toMap().value("url").toString();
-                }
-            }
+void Spotify::handlePlayerState(const SpotifyPlayerState& player) {
+    // the position is interpolated locally until the next poll, a seek on its way is not undone by an older state
+    if (player.hasItem && !m_seekControl->isSettling()) {
+        m_progress->update(player.progressMs, player.item.durationMs, player.isPlaying);
+    } else if (!player.hasItem) {
+        m_progress->stop();
+    }
 
-            QStringList commands = {"PLAY", "SONGRADIO", "QUEUE"};
+    // let the scheduler know what the player is doing, the next poll follows right after the track change
+    if (player.hasItem) {
+        m_lastPollState = player.isPlaying ? PollScheduler::PLAYING : PollScheduler::PAUSED;
+        m_pollScheduler->playerStateReceived(m_lastPollState, static_cast<int>(m_progress->remaining()));
+    } else {
+        m_lastPollState = player.hasDevice ? PollScheduler::IDLE : PollScheduler::NO_DEVICE;
+        m_pollScheduler->playerStateReceived(m_lastPollState);
+    }
 
-            BrowseModel* album = new BrowseModel(nullptr, id, title, subtitle, type, image, commands);
+    PlayerSnapshot next;
+    if (player.hasItem) {
+        next.trackId = player.item.id;
+        next.title = player.item.name;
+        next.artist = player.item.artist;
+        next.image = SpotifyDecoder::imageUrl(player.item.albumImages, IMAGE_SIZE_PLAYER);
+        next.duration = player.item.durationMs / 1000;
+        next.deviceId = player.device.id;
+        next.device = player.device.name;
+        next.volume = m_volumeControl->reconcile(player.device.volume);
+        next.state = player.isPlaying ? MediaPlayerDef::PLAYING : MediaPlayerDef::IDLE;
+    } else {
+        next.state = MediaPlayerDef::OFF;
+    }
 
-            // add tracks to album
-            QVariantList tracks = map.value("tracks").toMap().value("items").toList();
-            for (int i = 0; i < tracks.length(); i++) {
-                album->addItem(tracks[i].toMap().value("id").toString(), tracks[i].toMap().value("name").toString(),
-                               tracks[i].toMap().value("artists").toList()[0].toMap().value("name").toString(), "track",
-                               "", commands);
-            }
+    // the art of the following tracks is fetched while this one plays
+    if (!next.trackId.isEmpty() && next.trackId != m_player.trackId) {
+        prefetchQueueImages();
+    }
 
-            // update the entity
-            EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-            if (entity) {
-                MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                me->setBrowseModel(album);
+    // a device which was not there when the list was fetched
+    if (!next.deviceId.isEmpty() && next.deviceId != m_player.deviceId) {
+        bool known = false;
+        for (const SpotifyDevice& device : m_devices) {
+            if (device.id == next.deviceId) {
+                known = true;
+                break;
             }
         }
-        context->deleteLater();
-    });
-    getRequest(url, id);
+        if (!known) {
+            refreshDevices(false);
+        }
+    }
+
+    updatePlayer(next);
 }
 
-void Spotify::getPlaylist(QString id) {
-    QString url = "/v1/playlists/";
+void Spotify::showDevices() {
+    // the cached list is shown right away, the fetched one replaces it if it is different
+    if (m_devicesFetched.isValid()) {
+        showBrowseModel(deviceModel());
+        if (m_devicesFetched.elapsed() < DEVICE_LIST_MAX_AGE) {
+            return;
+        }
+    }
+    refreshDevices(true);
+}
 
-    QObject* context = new QObject(this);
-
-    QObject::connect(this, &Spotify::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            qCDebug(m_logCategory) << "GET PLAYLIST";
-            QString id = map.value("id").toString();
-            QString title = map.value("name").toString();
-            QString subtitle = map.value("owner").toMap().value("display_name").toString();
-            QString type = "playlist";
-            QString image = "";
-            if (map.contains("images") && map.value("images").toList().length() > 0) {
-                QVariantList images = map.value("images").toList();
-                for (int k = 0; k < images.length(); k++) {
-                    if (images[k].toMap().value("width").toInt() == 300) {
-                        image = images[k].toMap().value("url").toString();
-                    }
-                }
-                if (image == "") {
-                    image = map.value("images").toList()[0].toMap().value("url").toString();
-                }
-            }
+void Spotify::refreshDevices(bool show) {
+    // the list is only shown if nothing else was browsed in the meantime
+    int generation = m_browseGeneration;
 
-            QStringList commands = {"PLAY", "SONGRADIO", "QUEUE"};
-
-            BrowseModel* album = new BrowseModel(nullptr, id, title, subtitle, type, image, commands);
-
-            // add tracks to playlist
-            QVariantList tracks = map.value("tracks").toMap().value("items").toList();
-            for (int i = 0; i < tracks.length(); i++) {
-                album->addItem(tracks[i].toMap().value("track").toMap().value("id").toString(),
-                               tracks[i].toMap().value("track").toMap().value("name").toString(),
-                               tracks[i]
-                                   .toMap()
-                                   .value("track")
-                                   .toMap()
-                                   .value("artists")
-                                   .toList()[0]
-                                   .toMap()
-                                   .value("name")
-                                   .toString(),
-                               "track", "", commands);
-            }
+    getRequest("/v1/me/player/devices", "", "devices", [=](const QByteArray& body) {
+        m_devicesFetched.start();
+        if (body == m_devicesBody) {
+            return;
+        }
 
-            // update the entity
-            EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-            if (entity) {
-                MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                me->setBrowseModel(album);
-            }
+        QVector<SpotifyDevice> devices;
+        if (!SpotifyDecoder::decodeDevices(body, &devices)) {
+            qCWarning(m_logCategory) << "Invalid device list";
+            return;
+        }
+        m_devices = devices;
+        m_devicesBody = body;
+
+        if (show && generation == m_browseGeneration) {
+            showBrowseModel(deviceModel());
         }
-        context->deleteLater();
     });
-    getRequest(url, id);
 }
 
-void Spotify::getUserPlaylists() {
-    QString url = "/v1/me/playlists/";
+BrowseModel* Spotify::deviceModel() const {
+    BrowseModel* model = new BrowseModel(nullptr, "devices", "Devices", "", TYPE_DEVICE, "", QStringList());
 
-    QObject* context = new QObject(this);
-
-    QObject::connect(this, &Spotify::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            qCDebug(m_logCategory) << "GET USERS PLAYLIST";
-            QString     id = "";
-            QString     title = "";
-            QString     subtitle = "";
-            QString     type = "playlist";
-            QString     image = "";
-            QStringList commands = {};
-
-            BrowseModel* album = new BrowseModel(nullptr, id, title, subtitle, type, image, commands);
-
-            // add playlists to model
-            QVariantList playlists = map.value("items").toList();
-
-            for (int i = 0; i < playlists.length(); i++) {
-                if (playlists[i].toMap().contains("images") &&
-                    playlists[i].toMap().value("images").toList().length() > 0) {
-                    image = "";
-                    QVariantList images = playlists[i].toMap().value("images").toList();
-                    for (int k = 0; k < images.length(); k++) {
-                        if (images[k].toMap().value("width").toInt() == 300) {
-                            image = images[k].toMap().value("url").toString();
-                        }
-                    }
-                    if (image == "") {
-                        image = playlists[i].toMap().value("images").toList()[0].toMap().value("url").toString();
-                    }
-                }
+    for (const SpotifyDevice& device : m_devices) {
+        QString subtitle = device.id == m_player.deviceId ? device.type + " (active)" : device.type;
+        model->addItem(device.id, device.name, subtitle, TYPE_DEVICE, "", DEVICE_COMMANDS);
+    }
+    return model;
+}
 
-                QStringList commands = {"PLAY", "PLAYLISTRADIO"};
-                album->addItem(playlists[i].toMap().value("id").toString(),
-                               playlists[i].toMap().value("name").toString(), "", type, image, commands);
-            }
+void Spotify::transferPlayback(const QString& deviceId) {
+    bool playing = m_player.state == MediaPlayerDef::PLAYING;
 
-            // update the entity
-            EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-            if (entity) {
-                MediaPlayerInterface* me = static_cast<MediaPlayerInterface*>(entity->getSpecificInterface());
-                me->setBrowseModel(album);
-            }
+    // the player is shown on the new device right away, the next poll confirms it
+    PlayerSnapshot next = m_player;
+    next.deviceId = deviceId;
+    for (const SpotifyDevice& device : m_devices) {
+        if (device.id == deviceId) {
+            next.device = device.name;
+            next.volume = device.volume;
+        }
+    }
+    updatePlayer(next);
+
+    // the next poll must be parsed even if the transfer fails and the reply is the same as before
+    m_lastPlayerBody.clear();
+
+    QVariantMap rMap;
+    rMap.insert("device_ids", QStringList(deviceId));
+    rMap.insert("play", playing);
+    QString message = QJsonDocument::fromVariant(rMap).toJson(QJsonDocument::JsonFormat::Compact);
+    qCDebug(m_logCategory) << "TRANSFER PLAYBACK" << message;
+
+    StatusHandler onTransferred = [=](int statusCode) {
+        // the device is gone: fetch the list again, the next poll shows where playback really is
+        if (statusCode == 0 || statusCode >= 400) {
+            refreshDevices(false);
+        }
+    };
+    putRequest("/v1/me/player", message, onTransferred, "transfer");
+}
+
+void Spotify::prefetchQueueImages() {
+    getRequest("/v1/me/player/queue", "", "queue", [=](const QByteArray& body) {
+        QVector<SpotifyTrack> queue;
+        if (!SpotifyDecoder::decodeQueue(body, &queue)) {
+            return;
+        }
+        for (int i = 0; i < queue.size() && i < QUEUE_IMAGE_PREFETCH; i++) {
+            m_images->prefetch(SpotifyDecoder::imageUrl(queue[i].albumImages, IMAGE_SIZE_PLAYER));
         }
-        context->deleteLater();
     });
-    getRequest(url, "");
 }
 
-void Spotify::getCurrentPlayer() {
-    QString url = "/v1/me/player";
+QString Spotify::imageFor(const SpotifyImages& images, int width) {
+    return m_images->resolve(SpotifyDecoder::imageUrl(images, width));
+}
 
-    QObject* context = new QObject(this);
-
-    QObject::connect(this, &Spotify::requestReady, context, [=](const QVariantMap& map, const QString& rUrl) {
-        if (rUrl == url) {
-            EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-            if (entity) {
-                if (map.contains("item")) {
-                    // get the image
-                    //                attr.insert("image",
-                    //                map.value("item").toMap().value("album").toMap().value("images").toList()[0].toMap().value("url").toString());
-                    // get the image
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIAIMAGE, map.value("item")
-                                                                              .toMap()
-                                                                              .value("album")
-                                                                              .toMap()
-                                                                              .value("images")
-                                                                              .toList()[0]
-                                                                              .toMap()
-                                                                              .value("url")
-                                                                              .toString());
-
-                    // get the device
-                    entity->updateAttrByIndex(MediaPlayerDef::SOURCE,
-                                              map.value("device").toMap().value("name").toString());
-
-                    // get the volume
-                    entity->updateAttrByIndex(MediaPlayerDef::VOLUME,
-                                              map.value("device").toMap().value("volume_percent").toInt());
-
-                    // get the track title
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIATITLE,
-                                              map.value("item").toMap().value("name").toString());
-
-                    // get the artist
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIAARTIST,
-                                              map.value("item").toMap().value("name").toString());
-
-                    // get the state
-                    if (map.value("is_playing").toBool()) {
-                        entity->updateAttrByIndex(MediaPlayerDef::STATE, MediaPlayerDef::PLAYING);
-                        m_progressBarTimer->start();
-                    } else {
-                        entity->updateAttrByIndex(MediaPlayerDef::STATE, MediaPlayerDef::IDLE);
-                        m_progressBarTimer->stop();
-                    }
-
-                    // update progress
-                    entity->updateAttrByIndex(
-                        MediaPlayerDef::MEDIADURATION,
-                        static_cast<int>(map.value("item").toMap().value("duration_ms").toInt() / 1000));
-                    //                    entity->updateAttrByIndex(MediaPlayerDef::MEDIAPROGRESS,
-                    //                                              static_cast<int>(map.value("progress_ms").toInt() /
-                    //                                              1000));
-                    m_progressBarPosition = map.value("progress_ms").toInt() / 1000;
-
-                } else {
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIAIMAGE, "");
-                    entity->updateAttrByIndex(MediaPlayerDef::SOURCE, "");
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIATITLE, "");
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIAARTIST, "");
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIADURATION, 0);
-                    entity->updateAttrByIndex(MediaPlayerDef::MEDIAPROGRESS, 0);
-                    entity->updateAttrByIndex(MediaPlayerDef::STATE, MediaPlayerDef::OFF);
-                }
-            }
+void Spotify::setVolume(int volume) {
+    volume = qBound(0, volume, 100);
+    if (m_muted && volume > 0) {
+        m_muted = false;
+        withEntity([=](EntityInterface* entity) { entity->updateAttrByIndex(MediaPlayerDef::MUTED, false); });
+    }
+
+    // shown right away; the snapshot is updated too, so the next poll does not send it again
+    m_player.volume = volume;
+    withEntity([=](EntityInterface* entity) { entity->updateAttrByIndex(MediaPlayerDef::VOLUME, volume); });
+    m_volumeControl->set(volume);
+}
+
+void Spotify::setMuted(bool muted) {
+    // the Web API has no mute: it is volume 0, restoring the previous volume afterwards
+    if (!muted) {
+        // any volume above 0 unmutes
+        setVolume(m_volumeBeforeMute > 0 ? m_volumeBeforeMute : VOLUME_STEP);
+        return;
+    }
+    m_volumeBeforeMute = m_player.volume;
+    setVolume(0);
+    m_muted = true;
+    withEntity([=](EntityInterface* entity) { entity->updateAttrByIndex(MediaPlayerDef::MUTED, true); });
+}
+
+void Spotify::seek(int seconds) {
+    qint64 positionMs = qMax(0, seconds) * 1000LL;
+    m_progress->update(positionMs, m_player.duration * 1000LL, m_player.state == MediaPlayerDef::PLAYING);
+    m_seekControl->set(static_cast<int>(positionMs));
+}
+
+void Spotify::updatePlayer(const PlayerSnapshot& next, bool live) {
+    // the diff is computed here, only the changed attributes are sent to the main thread
+    QVector<QPair<int, QVariant>> changes;
+
+    // a new track changes all media attributes at once
+    if (next.trackId != m_player.trackId || next.title != m_player.title) {
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIATITLE, next.title));
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIAARTIST, next.artist));
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIAIMAGE, m_images->resolve(next.image)));
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIADURATION, next.duration));
+    } else {
+        if (next.artist != m_player.artist) {
+            changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIAARTIST, next.artist));
         }
-        context->deleteLater();
-    });
+        if (next.image != m_player.image) {
+            changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIAIMAGE, m_images->resolve(next.image)));
+        }
+        if (next.duration != m_player.duration) {
+            changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIADURATION, next.duration));
+        }
+    }
+
+    if (next.deviceId != m_player.deviceId || next.device != m_player.device) {
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::SOURCE, next.device));
+    }
+
+    if (next.volume != m_player.volume && next.state != MediaPlayerDef::OFF) {
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::VOLUME, next.volume));
+    }
+
+    if (next.state != m_player.state) {
+        if (next.state == MediaPlayerDef::OFF) {
+            changes.append(qMakePair<int, QVariant>(MediaPlayerDef::MEDIAPROGRESS, 0));
+        }
+        changes.append(qMakePair<int, QVariant>(MediaPlayerDef::STATE, next.state));
+    }
+
+    if (!changes.isEmpty()) {
+        withEntity([=](EntityInterface* entity) {
+            for (const QPair<int, QVariant>& change : changes) {
+                entity->updateAttrByIndex(change.first, change.second);
+            }
+        });
+    }
+
+    if (m_renderPending && !changes.isEmpty()) {
+        m_renderPending = false;
+        qCDebug(m_logCategory) << "Time to first render:" << m_connectedTime.elapsed() << "ms"
+                               << (live ? "(live)" : "(snapshot)");
+    }
+    if (live && m_livePending) {
+        m_livePending = false;
+        qCDebug(m_logCategory) << "Time to first live player state:" << m_connectedTime.elapsed() << "ms";
+    }
+
+    m_updatesEmitted += changes.size();
+    m_updatesSuppressed += qMax(0, PlayerSnapshot::ATTRIBUTE_COUNT - changes.size());
+    m_player = next;
+
+    if (live && !changes.isEmpty()) {
+        storePlayer();
+    }
+}
+
+bool Spotify::restorePlayer() {
+    QFile file(m_playerSnapshotPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32     version;
+    stream >> version;
+    if (version != PLAYER_SNAPSHOT_VERSION) {
+        return false;
+    }
+
+    PlayerSnapshot snapshot;
+    stream >> snapshot.trackId >> snapshot.title >> snapshot.artist >> snapshot.image >> snapshot.deviceId >>
+        snapshot.device >> snapshot.volume >> snapshot.duration >> snapshot.state;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    // whatever played before is not necessarily still playing
+    if (snapshot.state == MediaPlayerDef::PLAYING) {
+        snapshot.state = MediaPlayerDef::IDLE;
+    }
+    updatePlayer(snapshot, false);
+    return true;
+}
+
+void Spotify::storePlayer() {
+    QSaveFile file(m_playerSnapshotPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << PLAYER_SNAPSHOT_VERSION << m_player.trackId << m_player.title << m_player.artist << m_player.image
+           << m_player.deviceId << m_player.device << m_player.volume << m_player.duration << m_player.state;
+    file.commit();
+}
 
-    getRequest(url, "");
+void Spotify::withEntity(const std::function<void(EntityInterface* entity)>& function) {
+    EntitiesInterface*   entities = m_entities;
+    QString              entityId = m_entityId;
+    std::atomic<qint64>* mainThreadNs = &m_mainThreadNs;
+
+    auto apply = [=]() {
+        QElapsedTimer timer;
+        timer.start();
+        EntityInterface* entity = static_cast<EntityInterface*>(entities->getEntityInterface(entityId));
+        if (entity) {
+            function(entity);
+        }
+        *mainThreadNs += timer.nsecsElapsed();
+    };
+
+    QCoreApplication* app = QCoreApplication::instance();
+    if (QThread::currentThread() == app->thread()) {
+        apply();
+    } else {
+        QMetaObject::invokeMethod(app, apply, Qt::QueuedConnection);
+    }
 }
 
 void Spotify::sendCommand(const QString& type, const QString& entityId, int command, const QVariant& param) {
@@ -609,130 +1074,84 @@ void Spotify::sendCommand(const QString& type, const QString& entityId, int comm
         return;
     }
 
+    // player commands change the state: poll fast for a short while to pick up the result
+    if (command != MediaPlayerDef::C_SEARCH && command != MediaPlayerDef::C_GETALBUM &&
+        command != MediaPlayerDef::C_GETPLAYLIST) {
+        m_pollScheduler->commandSent();
+    }
+
     if (command == MediaPlayerDef::C_PLAY) {
-        putRequest("/v1/me/player/play", "");  // normal play without browsing
+        putRequest("/v1/me/player/play", "", nullptr, "playback");  // normal play without browsing
     } else if (command == MediaPlayerDef::C_PLAY_ITEM) {
         if (param == "") {
-            putRequest("/v1/me/player/play", "");
-        } else {
-            if (param.toMap().contains("type")) {
-                if (param.toMap().value("type").toString() == "track") {
-                    QString  url = "/v1/tracks/";
-                    QObject* context = new QObject(this);
-                    QObject::connect(this, &Spotify::requestReady, context,
-                                     [=](const QVariantMap& map, const QString& rUrl) {
-                                         if (rUrl == url) {
-                                             qCDebug(m_logCategory) << "PLAY MEDIA" << map.value("uri").toString();
-                                             QVariantMap rMap;
-                                             QStringList rList;
-                                             rList.append(map.value("uri").toString());
-                                             rMap.insert("uris", rList);
-                                             QJsonDocument doc = QJsonDocument::fromVariant(rMap);
-                                             QString       message = doc.toJson(QJsonDocument::JsonFormat::Compact);
-                                             qCDebug(m_logCategory) << message;
-                                             putRequest("/v1/me/player/play", message);
-                                         }
-                                         context->deleteLater();
-                                     });
-                    getRequest(url, param.toMap().value("id").toString());
-                } else if (param.toMap().value("type").toString() == "album") {
-                    QString  url = "/v1/albums/";
-                    QObject* context = new QObject(this);
-                    QObject::connect(this, &Spotify::requestReady, context,
-                                     [=](const QVariantMap& map, const QString& rUrl) {
-                                         if (rUrl == url) {
-                                             QString url = "/v1/me/player/play";
-                                             qCDebug(m_logCategory) << "PLAY MEDIA" << map.value("uri").toString();
-                                             QVariantMap rMap;
-                                             rMap.insert("context_uri", map.value("uri").toString());
-                                             QJsonDocument doc = QJsonDocument::fromVariant(rMap);
-                                             QString       message = doc.toJson(QJsonDocument::JsonFormat::Compact);
-                                             qCDebug(m_logCategory) << message;
-                                             putRequest("/v1/me/player/play", message);
-                                         }
-                                         context->deleteLater();
-                                     });
-                    getRequest(url, param.toMap().value("id").toString());
-                } else if (param.toMap().value("type").toString() == "artist") {
-                    QString  url = "/v1/artists/";
-                    QObject* context = new QObject(this);
-                    QObject::connect(this, &Spotify::requestReady, context,
-                                     [=](const QVariantMap& map, const QString& rUrl) {
-                                         if (rUrl == url) {
-                                             QString url = "/v1/me/player/play";
-                                             qCDebug(m_logCategory) << "PLAY MEDIA" << map.value("uri").toString();
-                                             QVariantMap rMap;
-                                             rMap.insert("context_uri", map.value("uri").toString());
-                                             QJsonDocument doc = QJsonDocument::fromVariant(rMap);
-                                             QString       message = doc.toJson(QJsonDocument::JsonFormat::Compact);
-                                             qCDebug(m_logCategory) << message;
-                                             putRequest("/v1/me/player/play", message);
-                                         }
-                                         context->deleteLater();
-                                     });
-                    getRequest(url, param.toMap().value("id").toString());
-                } else if (param.toMap().value("type").toString() == "playlist") {
-                    QString  url = "/v1/playlists/";
-                    QObject* context = new QObject(this);
-                    QObject::connect(this, &Spotify::requestReady, context,
-                                     [=](const QVariantMap& map, const QString& rUrl) {
-                                         if (rUrl == url) {
-                                             QString url = "/v1/me/player/play";
-                                             qCDebug(m_logCategory) << "PLAY MEDIA" << map.value("uri").toString();
-                                             QVariantMap rMap;
-                                             rMap.insert("context_uri", map.value("uri").toString());
-                                             QJsonDocument doc = QJsonDocument::fromVariant(rMap);
-                                             QString       message = doc.toJson(QJsonDocument::JsonFormat::Compact);
-                                             qCDebug(m_logCategory) << message;
-                                             putRequest("/v1/me/player/play", message);
-                                         }
-                                         context->deleteLater();
-                                     });
-                    getRequest(url, param.toMap().value("id").toString());
-                }
+            putRequest("/v1/me/player/play", "", nullptr, "playback");
+        } else if (param.type() == QVariant::List || param.toMap().contains("ids")) {
+            // several tracks start with one request, the offset selects the item to play first
+            sendItems(commandItems(param), true, param.toMap().value("offset", -1).toInt());
+        } else if (param.toMap().value("type") == "device") {
+            transferPlayback(param.toMap().value("id").toString());
+        } else if (param.toMap().contains("type")) {
+            QString itemType = param.toMap().value("type").toString();
+            QString uri = itemUri(itemType, param.toMap().value("id").toString());
+
+            QVariantMap rMap;
+            if (itemType == "track") {
+                rMap.insert("uris", QStringList(uri));
+            } else if (itemType == "album" || itemType == "artist" || itemType == "playlist") {
+                rMap.insert("context_uri", uri);
+            } else {
+                return;
             }
+            QJsonDocument doc = QJsonDocument::fromVariant(rMap);
+            QString       message = doc.toJson(QJsonDocument::JsonFormat::Compact);
+            qCDebug(m_logCategory) << "PLAY MEDIA" << message;
+
+            QElapsedTimer timer;
+            timer.start();
+            StatusHandler recordLatency = [=](int) { m_commandLatency.record(timer.elapsed()); };
+            putRequest("/v1/me/player/play", message, recordLatency, "playback");
         }
     } else if (command == MediaPlayerDef::C_QUEUE) {
-        if (param.toMap().contains("type")) {
-            if (param.toMap().value("type").toString() == "track") {
-                QString  url = "/v1/tracks/";
-                QObject* context = new QObject(this);
-                QObject::connect(this, &Spotify::requestReady, context,
-                                 [=](const QVariantMap& map, const QString& rUrl) {
-                                     if (rUrl == url) {
-                                         qCDebug(m_logCategory) << "QUEUE MEDIA" << map.value("uri").toString();
-                                         QString message = "?uri=" + map.value("uri").toString();
-                                         postRequest("/v1/me/player/queue", message);
-                                     }
-                                     context->deleteLater();
-                                 });
-                getRequest(url, param.toMap().value("id").toString());
-            }
-        }
+        sendItems(commandItems(param), false);
     } else if (command == MediaPlayerDef::C_PAUSE) {
-        putRequest("/v1/me/player/pause", "");
+        putRequest("/v1/me/player/pause", "", nullptr, "playback");
     } else if (command == MediaPlayerDef::C_NEXT) {
         postRequest("/v1/me/player/next", "");
     } else if (command == MediaPlayerDef::C_PREVIOUS) {
         postRequest("/v1/me/player/previous", "");
     } else if (command == MediaPlayerDef::C_VOLUME_SET) {
-        putRequest("/v1/me/player/volume?volume_percent=" + param.toString(), "");
+        setVolume(param.toInt());
+    } else if (command == MediaPlayerDef::C_VOLUME_UP) {
+        setVolume(m_player.volume + VOLUME_STEP);
+    } else if (command == MediaPlayerDef::C_VOLUME_DOWN) {
+        setVolume(m_player.volume - VOLUME_STEP);
+    } else if (command == MediaPlayerDef::C_MUTE) {
+        setMuted(!m_muted);
+    } else if (command == MediaPlayerDef::C_SEEK) {
+        seek(param.toInt());
     } else if (command == MediaPlayerDef::C_SEARCH) {
-        search(param.toString());
+        scheduleSearch(param.toString());
     } else if (command == MediaPlayerDef::C_GETALBUM) {
         getAlbum(param.toString());
     } else if (command == MediaPlayerDef::C_GETPLAYLIST) {
-        if (param.toString() == "user") {
-            getUserPlaylists();
+        // "<id>@<offset>" opens a later window of a long list, see appendPages()
+        QString id = param.toString().section('@', 0, 0);
+        int     offset = param.toString().section('@', 1, 1).toInt();
+        if (id == "user") {
+            getUserPlaylists(offset);
+        } else if (id == "devices") {
+            showDevices();
         } else {
-            getPlaylist(param.toString());
+            getPlaylist(id, offset);
         }
     }
 }
 
 void Spotify::updateEntity(const QString& entity_id, const QVariantMap& attr) {
-    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(entity_id));
-    if (entity) {
+    if (entity_id != m_entityId) {
+        return;
+    }
+    withEntity([=](EntityInterface* entity) {
         // update the media player
         entity->updateAttrByIndex(MediaPlayerDef::Attributes::STATE, attr.value("state").toInt());
         entity->updateAttrByIndex(MediaPlayerDef::Attributes::SOURCE, attr.value("device").toString());
@@ -740,163 +1159,281 @@ void Spotify::updateEntity(const QString& entity_id, const QVariantMap& attr) {
         entity->updateAttrByIndex(MediaPlayerDef::Attributes::MEDIATITLE, attr.value("title").toString());
         entity->updateAttrByIndex(MediaPlayerDef::Attributes::MEDIAARTIST, attr.value("artist").toString());
         entity->updateAttrByIndex(MediaPlayerDef::Attributes::MEDIAIMAGE, attr.value("image").toString());
-    }
+    });
 }
 
-void Spotify::getRequest(const QString& url, const QString& params) {
-    if (m_accessToken.isNull() || m_accessToken.isEmpty()) {
-        qCWarning(m_logCategory) << "No access token available";
-        return;
-    }
-
-    // create new networkacces manager and request
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
-    QNetworkRequest        request;
+quint64 Spotify::getRequest(const QString& url, const QString& params, const QString& supersedeKey,
+                            const BodyHandler& handler) {
+    return m_api->get(url, params, supersedeKey, QByteArray(), [=](int, const QByteArray& body, const QByteArray&) {
+        if (!body.isEmpty() && handler) {
+            handler(body);
+        }
+    });
+}
 
-    QObject* context = new QObject(this);
+void Spotify::getCached(MetadataCache::Type type, const QString& id, const QString& url, const QString& params,
+                        const QString& supersedeKey, bool revalidate, const CachedBodyHandler& handler,
+                        const StatusHandler& failed) {
+    MetadataCache::Entry entry;
+    bool                 cached = m_cache.lookup(type, id, &entry);
+    if (cached) {
+        // the cached content replaces whatever a running request of the same kind would show
+        m_api->cancelSuperseded(supersedeKey);
+        if (!handler(entry.body)) {
+            qCWarning(m_logCategory) << "Dropping undecodable cache entry" << id;
+            m_cache.remove(type, id);
+            cached = false;
+        } else if (!revalidate || m_cache.isFresh(type, entry)) {
+            return;
+        }
+    }
 
-    // connect to finish signal
-    QObject::connect(manager, &QNetworkAccessManager::finished, context, [=](QNetworkReply* reply) {
-        if (reply->error()) {
-            QString errorString = reply->errorString();
-            qCWarning(m_logCategory) << errorString;
-            if (errorString == "Host requires authentication") {
-                refreshAccessToken();
+    WebApi::ReplyHandler store = [=](int statusCode, const QByteArray& body, const QByteArray& etag) {
+        // the cached version is still current
+        if (statusCode == 304) {
+            m_cache.notModified(type, id);
+            return;
+        }
+        if (body.isEmpty()) {
+            if (failed) {
+                failed(statusCode);
             }
+            return;
         }
 
-        QString     answer = reply->readAll();
-        QVariantMap map;
-        if (answer != "") {
-            // convert to json
-            QJsonParseError parseerror;
-            QJsonDocument   doc = QJsonDocument::fromJson(answer.toUtf8(), &parseerror);
-            if (parseerror.error != QJsonParseError::NoError) {
-                qCWarning(m_logCategory) << "JSON error : " << parseerror.errorString();
-                return;
-            }
+        QString snapshotId = type == MetadataCache::PLAYLIST ? SpotifyDecoder::decodeSnapshotId(body) : QString();
+        m_cache.insert(type, id, body, snapshotId, etag);
 
-            // createa a map object
-            map = doc.toVariant().toMap();
-            emit requestReady(map, url);
+        // the cached version is already shown: only show it again if it changed
+        if ((!cached || body != entry.body) && !handler(body)) {
+            m_cache.remove(type, id);
+            if (failed) {
+                failed(statusCode);
+            }
         }
+    };
 
-        reply->deleteLater();
-        context->deleteLater();
-        manager->deleteLater();
-    });
+    // revalidated with a conditional request if the server sent an ETag
+    if (cached && !entry.etag.isEmpty()) {
+        m_api->get(url, params, supersedeKey, entry.etag, store, failed);
+        return;
+    }
 
-    QObject::connect(
-        manager, &QNetworkAccessManager::networkAccessibleChanged, context,
-        [=](QNetworkAccessManager::NetworkAccessibility accessibility) { qCDebug(m_logCategory) << accessibility; });
+    if (cached && type == MetadataCache::PLAYLIST && !entry.snapshotId.isEmpty()) {
+        // a playlist is only downloaded again if its snapshot changed
+        WebApi::ReplyHandler compare = [=](int, const QByteArray& body, const QByteArray&) {
+            if (SpotifyDecoder::decodeSnapshotId(body) == entry.snapshotId) {
+                m_cache.touch(type, id);
+            } else {
+                m_api->get(url, params, supersedeKey, QByteArray(), store, failed);
+            }
+        };
+        m_api->get(url, id + "?fields=snapshot_id", supersedeKey, QByteArray(), compare, failed);
+        return;
+    }
 
-    // set headers
-    request.setRawHeader("Content-Type", "application/json");
-    request.setRawHeader("Authorization", "Bearer " + m_accessToken.toLocal8Bit());
+    m_api->get(url, params, supersedeKey, QByteArray(), store, failed);
+}
 
-    // set the URL
-    // url = "/v1/me/player"
-    // params = "?q=stringquery&limit=20"
-    request.setUrl(QUrl(m_apiURL + url + params));
+QVariantList Spotify::commandItems(const QVariant& param) {
+    // a list of items
+    if (param.type() == QVariant::List) {
+        return param.toList();
+    }
 
-    // send the get request
-    manager->get(request);
+    // several ids of the same type
+    QVariantMap  map = param.toMap();
+    QVariantList items;
+    if (map.contains("ids")) {
+        for (const QVariant& id : map.value("ids").toList()) {
+            QVariantMap item;
+            item.insert("type", map.value("type"));
+            item.insert("id", id);
+            items.append(item);
+        }
+    } else if (map.contains("type")) {
+        items.append(map);
+    }
+    return items;
 }
 
-void Spotify::postRequest(const QString& url, const QString& params) {
-    if (m_accessToken.isNull() || m_accessToken.isEmpty()) {
-        qCWarning(m_logCategory) << "No access token available";
+void Spotify::sendItems(const QVariantList& items, bool play, int offset) {
+    // the whole batch is laid out before anything is sent, so the tracks keep the order of the selection
+    QSharedPointer<QueueBatch> batch(new QueueBatch);
+    batch->play = play;
+    batch->offset = offset;
+    bool playable = false;
+    for (const QVariant& item : items) {
+        QueueItem queued;
+        queued.type = item.toMap().value("type").toString();
+        queued.id = item.toMap().value("id").toString();
+        if (queued.type == "track") {
+            queued.uris.append(itemUri(queued.type, queued.id));
+            queued.resolved = true;
+        } else if (queued.type != "album" && queued.type != "playlist") {
+            // kept without tracks, so the offset still points at the selected item
+            qCWarning(m_logCategory) << "Cannot play or queue" << queued.type << queued.id;
+            queued.resolved = true;
+        }
+        playable = playable || queued.type == "track" || !queued.resolved;
+        batch->items.append(queued);
+    }
+    if (!playable) {
         return;
     }
+    qCDebug(m_logCategory) << (play ? "PLAY MEDIA" : "QUEUE MEDIA") << batch->items.size() << "items";
 
-    // create new networkacces manager and request
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
-    QNetworkRequest        request;
-
-    QObject* context = new QObject(this);
-
-    // connect to finish signal
-    QObject::connect(manager, &QNetworkAccessManager::finished, context, [=](QNetworkReply* reply) {
-        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        if (statusCode != 204) {
-            qCWarning(m_logCategory) << "ERROR WITH POST REQUEST " << statusCode;
+    batch->timer.start();
+    for (int i = 0; i < batch->items.size(); i++) {
+        if (!batch->items.at(i).resolved) {
+            resolveQueueItem(batch, i);
         }
-        reply->deleteLater();
-        context->deleteLater();
-        manager->deleteLater();
-    });
-
-    QObject::connect(
-        manager, &QNetworkAccessManager::networkAccessibleChanged, context,
-        [=](QNetworkAccessManager::NetworkAccessibility accessibility) { qCDebug(m_logCategory) << accessibility; });
-
-    // set headers
-    request.setRawHeader("Content-Type", "application/json");
-    request.setRawHeader("Authorization", "Bearer " + m_accessToken.toLocal8Bit());
-
-    // set the URL
-    // url = "/v1/me/player"
-    // params = "?q=stringquery&limit=20"
-    request.setUrl(QUrl(m_apiURL + url + params));
+    }
+    pumpQueue(batch);
+}
 
-    // send the get request
-    manager->post(request, "");
+void Spotify::resolveQueueItem(QSharedPointer<QueueBatch> batch, int index) {
+    auto resolved = [=](const QStringList& uris) {
+        QueueItem& item = batch->items[index];
+        if (item.resolved) {
+            return;
+        }
+        item.uris = uris;
+        item.resolved = true;
+        pumpQueue(batch);
+    };
+    // the items after it are not held up
+    StatusHandler failed = [=](int statusCode) {
+        qCWarning(m_logCategory) << "Skipping" << batch->items.at(index).type << batch->items.at(index).id
+                                 << statusCode;
+        resolved(QStringList());
+    };
+
+    // the tracks come from the metadata cache if the album or playlist was browsed before
+    QString id = batch->items.at(index).id;
+    if (batch->items.at(index).type == "album") {
+        CachedBodyHandler onAlbum = [=](const QByteArray& body) {
+            SpotifyAlbum album;
+            if (!SpotifyDecoder::decodeAlbum(body, &album)) {
+                return false;
+            }
+            QStringList uris;
+            for (const SpotifyTrack& track : album.tracks) {
+                uris.append(track.uri);
+            }
+            resolved(uris);
+            return true;
+        };
+        getCached(MetadataCache::ALBUM, id, "/v1/albums/", id, "", false, onAlbum, failed);
+    } else {
+        CachedBodyHandler onPlaylist = [=](const QByteArray& body) {
+            SpotifyPlaylist playlist;
+            if (!SpotifyDecoder::decodePlaylist(body, &playlist)) {
+                return false;
+            }
+            QStringList uris;
+            for (const SpotifyTrack& track : playlist.tracks) {
+                uris.append(track.uri);
+            }
+            resolved(uris);
+            return true;
+        };
+        getCached(MetadataCache::PLAYLIST, id, "/v1/playlists/", id, "", false, onPlaylist, failed);
+    }
 }
 
-void Spotify::putRequest(const QString& url, const QString& params) {
-    if (m_accessToken.isNull() || m_accessToken.isEmpty()) {
-        qCWarning(m_logCategory) << "No access token available";
+void Spotify::pumpQueue(QSharedPointer<QueueBatch> batch) {
+    if (batch->play) {
+        playBatch(batch);
         return;
     }
 
-    // create new networkacces manager and request
-    QNetworkAccessManager* manager = new QNetworkAccessManager(this);
-    QNetworkRequest        request;
-
-    QObject* context = new QObject(this);
-
-    // connect to finish signal
-    QObject::connect(manager, &QNetworkAccessManager::finished, context, [=](QNetworkReply* reply) {
-        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        if (statusCode != 204) {
-            qCWarning(m_logCategory) << "ERROR WITH PUT REQUEST " << statusCode << reply->readAll();
+    // keep a few on the wire, in order, leaving room for other requests
+    while (batch->inFlight < QUEUE_CONCURRENCY && batch->item < batch->items.size()) {
+        const QueueItem& item = batch->items.at(batch->item);
+        if (!item.resolved) {
+            // sent as soon as its tracks are known
+            return;
         }
-        reply->deleteLater();
-        context->deleteLater();
-        manager->deleteLater();
-    });
+        if (batch->track < item.uris.size()) {
+            QString uri = item.uris.at(batch->track++);
+            batch->inFlight++;
+            postRequest("/v1/me/player/queue", "?uri=" + uri, [=](int) {
+                batch->inFlight--;
+                pumpQueue(batch);
+            });
+            continue;
+        }
+        batch->item++;
+        batch->track = 0;
+    }
+    if (batch->inFlight == 0 && batch->item >= batch->items.size()) {
+        m_commandLatency.record(batch->timer.elapsed());
+    }
+}
 
-    QObject::connect(
-        manager, &QNetworkAccessManager::networkAccessibleChanged, context,
-        [=](QNetworkAccessManager::NetworkAccessibility accessibility) { qCDebug(m_logCategory) << accessibility; });
+void Spotify::playBatch(QSharedPointer<QueueBatch> batch) {
+    // sent once, when all albums and playlists are resolved
+    if (batch->item >= batch->items.size()) {
+        return;
+    }
+    for (const QueueItem& item : batch->items) {
+        if (!item.resolved) {
+            return;
+        }
+    }
+    batch->item = batch->items.size();
+
+    // the offset selects the first track of the selected item
+    QStringList uris;
+    int         position = -1;
+    for (int i = 0; i < batch->items.size(); i++) {
+        if (i == batch->offset) {
+            position = uris.size();
+        }
+        uris.append(batch->items.at(i).uris);
+    }
+    if (uris.isEmpty()) {
+        qCWarning(m_logCategory) << "Nothing to play";
+        return;
+    }
 
-    // set headers
-    request.setRawHeader("Content-Type", "application/json");
-    request.setRawHeader("Authorization", "Bearer " + m_accessToken.toLocal8Bit());
+    QVariantMap rMap;
+    rMap.insert("uris", uris);
+    if (position >= 0 && position < uris.size()) {
+        QVariantMap offset;
+        offset.insert("position", position);
+        rMap.insert("offset", offset);
+    }
+    QString message = QJsonDocument::fromVariant(rMap).toJson(QJsonDocument::JsonFormat::Compact);
+    qCDebug(m_logCategory) << "PLAY MEDIA" << uris.size() << "tracks";
 
-    // set the URL
-    // url = "/v1/me/player"
-    request.setUrl(QUrl(m_apiURL + url));
+    StatusHandler recordLatency = [=](int) { m_commandLatency.record(batch->timer.elapsed()); };
+    putRequest("/v1/me/player/play", message, recordLatency, "playback");
+}
 
-    QByteArray data = params.toUtf8();
+QString Spotify::itemUri(const QString& type, const QString& id) {
+    // browse and search items may already carry the full URI
+    if (id.startsWith("spotify:")) {
+        return id;
+    }
+    return "spotify:" + type + ":" + id;
+}
 
-    // send the get request
-    manager->put(request, data);
+void Spotify::postRequest(const QString& url, const QString& params, const StatusHandler& handler,
+                          const QString& collapseKey) {
+    m_api->post(url, params, handler, collapseKey);
 }
 
-void Spotify::onTokenTimeOut() {
-    // get a new access token
-    refreshAccessToken();
+void Spotify::putRequest(const QString& url, const QString& params, const StatusHandler& handler,
+                         const QString& collapseKey) {
+    m_api->put(url, params, handler, collapseKey);
 }
 
 void Spotify::onPollingTimerTimeout() {
     getCurrentPlayer();
 }
 
-void Spotify::onProgressBarTimerTimeout() {
-    EntityInterface* entity = static_cast<EntityInterface*>(m_entities->getEntityInterface(m_entityId));
-    if (entity) {
-        m_progressBarPosition++;
-        entity->updateAttrByIndex(MediaPlayerDef::MEDIAPROGRESS, m_progressBarPosition);
-    }
+void Spotify::onProgressChanged(int position) {
+    withEntity([=](EntityInterface* entity) { entity->updateAttrByIndex(MediaPlayerDef::MEDIAPROGRESS, position); });
 }
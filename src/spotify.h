@@ -22,10 +22,30 @@
 
 #pragma once
 
-#include <QNetworkAccessManager>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QNetworkReply>
+#include <QPointer>
+#include <QSharedPointer>
 #include <QTimer>
 
+#include <atomic>
+#include <functional>
+
+#include "httpclient.h"
+#include "imagecache.h"
+#include "latencyhistogram.h"
+#include "metadatacache.h"
+#include "playbackprogress.h"
+#include "pollscheduler.h"
+#include "spotifytypes.h"
+#include "stringpool.h"
+#include "telemetry.h"
+#include "throttledcontrol.h"
+#include "tokenmanager.h"
+#include "webapi.h"
+#include "websocketstateprovider.h"
 #include "yio-interface/entities/mediaplayerinterface.h"
 #include "yio-model/mediaplayer/albummodel_mediaplayer.h"
 #include "yio-model/mediaplayer/searchmodel_mediaplayer.h"
@@ -36,7 +56,59 @@
 //// SPOTIFY FACTORY
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-const bool USE_WORKER_THREAD = false;
+// networking, decoding and model building run on a worker thread, only finished models and attribute changes are handed
+// to the main thread
+const bool USE_WORKER_THREAD = true;
+
+// Paginated browse models show a window of this many pages, loaded one after another. A link at the end of the window
+// opens the next one, which replaces it; a link at the top goes back.
+const int BROWSE_WINDOW_PAGES = 5;
+const int BROWSE_PAGE_DELAY = 250;
+const int PLAYLIST_PAGE_SIZE = 100;
+const int USER_PLAYLISTS_PAGE_SIZE = 50;
+
+// search as you type
+const int SEARCH_DEBOUNCE = 300;
+const int SEARCH_CACHE_SIZE = 32;
+
+// requested cover art widths for the 480x800 display: now playing, large tiles and list thumbnails
+const int IMAGE_SIZE_PLAYER = 480;
+const int IMAGE_SIZE_LARGE = 300;
+const int IMAGE_SIZE_SMALL = 64;
+
+// cover art kept on disk, and how many tracks of the queue get their art prefetched
+const qint64 IMAGE_CACHE_SIZE = 32 * 1024 * 1024;
+const int    QUEUE_IMAGE_PREFETCH = 2;
+
+// albums and playlists among the top search hits whose metadata is fetched in the background, and how many of these
+// requests are on the wire at the same time
+const int PREFETCH_TOP_HITS = 2;
+const int PREFETCH_CONCURRENCY = 2;
+
+// queue requests on the wire at the same time when queueing several tracks: they leave in order, the small window
+// bounds how far the server could take them out of order
+const int QUEUE_CONCURRENCY = 3;
+
+// volume and seek changes sent at most once per interval, volume up/down step
+const int VOLUME_THROTTLE = 250;
+const int SEEK_THROTTLE = 500;
+const int VOLUME_STEP = 5;
+
+// a cached device list older than this is fetched again when the device list is opened
+const int DEVICE_LIST_MAX_AGE = 30000;
+
+// failed idempotent requests are retried with a jittered exponential backoff
+const int RETRY_MAX = 3;
+const int RETRY_BASE_DELAY = 500;
+const int RETRY_MAX_DELAY = 8000;
+
+// an endpoint failing this many times in a row is not called until the cool-down has passed
+const int BREAKER_THRESHOLD = 5;
+const int BREAKER_COOL_DOWN = 15000;
+const int BREAKER_MAX_COOL_DOWN = 300000;
+
+// format of the player snapshot file
+const quint32 PLAYER_SNAPSHOT_VERSION = 1;
 
 class SpotifyPlugin : public Plugin {
     Q_OBJECT
@@ -57,6 +129,31 @@ class SpotifyPlugin : public Plugin {
 //// SPOTIFY CLASS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/// Compact copy of the last player state pushed to the entity, used to send only changed attributes
+struct PlayerSnapshot {
+    static const int ATTRIBUTE_COUNT = 7;
+
+    QString trackId;
+    QString title;
+    QString artist;
+    QString image;
+    QString deviceId;
+    QString device;
+    int     volume = 0;
+    int     duration = 0;
+    int     state = -1;
+};
+
+/// Browse list entry, decoded on the worker thread and added to the model on the main thread
+struct BrowseItem {
+    QString     id;
+    QString     title;
+    QString     subtitle;
+    QString     type;
+    QString     image;
+    QStringList commands;
+};
+
 class Spotify : public Integration {
     Q_OBJECT
 
@@ -72,31 +169,134 @@ class Spotify : public Integration {
     void enterStandby() override;
     void leaveStandby() override;
 
- signals:
-    void requestReady(const QVariantMap& obj, const QString& url);
-
  private:
     // Spotify API calls
     void search(QString query);
     void search(QString query, QString type);
     void search(QString query, QString type, QString limit, QString offset);
+
+    // search as you type: debounced, showing cached results of a prefix right away
+    void           scheduleSearch(const QString& query);
+    void           showSearchResult(const QString& key, const SpotifySearchResult& result);
+    static QString searchKey(const QString& query, const QString& type, const QString& limit, const QString& offset);
+
+    // offset is the first item of the browse window, see BROWSE_WINDOW_PAGES
     void getAlbum(QString id);
-    void getPlaylist(QString id);
-    void getUserPlaylists();
+    void getPlaylist(QString id, int offset = 0);
+    void getUserPlaylists(int offset = 0);
+
+    // Speculative fetches into the metadata cache, so opening a search hit is instant. They run behind all other
+    // requests and are cancelled by the next search or browse.
+    void prefetchSearchHits(const SpotifySearchResult& result);
+    void prefetchMetadata(MetadataCache::Type type, const QString& url, const QString& id);
+    void cancelPrefetch();
 
-    // Spotify API authentication
-    void refreshAccessToken();
+    // Shows the model in the media player and returns the new browse generation
+    int showBrowseModel(BrowseModel* model);
+
+    // Appends the page behind the next URL to the model, followed by the pages after it. The decoder returns the items
+    // of a page and the next URL. Loading stops when another model is shown. When the window is full, a link to the
+    // next window is appended instead: a C_GETPLAYLIST item with the id "<windowKey>@<offset>".
+    typedef std::function<QString(const QByteArray& body, QVector<BrowseItem>* items)> PageDecoder;
+    void appendPages(int generation, QPointer<BrowseModel> model, const QString& next, int pages,
+                     const PageDecoder& decode, const QString& windowKey);
+
+    // link to the browse window starting at offset
+    static BrowseItem windowLink(const QString& windowKey, int offset, const QString& title);
 
     // Spotify Connect API calls
     void getCurrentPlayer();
+    void handlePlayerReply(int statusCode, const QByteArray& body);
+    void handlePlayerState(const SpotifyPlayerState& player);
+
+    // the push provider took over from polling, or gave back to it
+    void onPushConnectedChanged(bool connected);
+    void prefetchQueueImages();
+
+    // Spotify Connect devices: the cached list is shown right away and fetched again if it is old. It is refreshed on
+    // connect and when the player reports a device which is not in the list, never polled.
+    void         showDevices();
+    void         refreshDevices(bool show);
+    BrowseModel* deviceModel() const;
+
+    // moves playback to the device; shown right away, without waiting for the device list or the next poll
+    void transferPlayback(const QString& deviceId);
+
+    // best fitting image for the width, as local file URL once it is cached
+    QString imageFor(const SpotifyImages& images, int width);
 
     void updateEntity(const QString& entity_id, const QVariantMap& attr);
+    // live is false for the snapshot restored from disk, which is shown until the first poll arrives
+    void updatePlayer(const PlayerSnapshot& next, bool live = true);
+
+    // volume, mute and seek: shown right away, sent throttled
+    void setVolume(int volume);
+    void setMuted(bool muted);
+    void seek(int seconds);
+
+    // last player state on disk, so the media player has content before the first poll
+    bool restorePlayer();
+    void storePlayer();
+
+    // Runs the function with the media player entity on the main thread, which owns the entities and shown models.
+    // Models must be moved to the main thread before they are handed over.
+    void withEntity(const std::function<void(EntityInterface* entity)>& function);
+
+    // spotify:<type>:<id>, built locally instead of looking up the object
+    static QString itemUri(const QString& type, const QString& id);
+
+    // Items of a play or queue command: a single {type, id} map, a map with a list of ids, or a list of maps
+    static QVariantList commandItems(const QVariant& param);
+
+    // Plays or queues the selected items in their order, an album or playlist with all its tracks. Playing starts all
+    // tracks with one request once they are known. The queue endpoint takes one track per request; they are sent in
+    // order, a few at a time. An album or playlist which cannot be fetched is skipped.
+    struct QueueItem {
+        QString     type;
+        QString     id;
+        QStringList uris;
+        bool        resolved = false;  // albums and playlists are resolved to their tracks asynchronously
+    };
+    struct QueueBatch {
+        QVector<QueueItem> items;
+        bool               play = false;  // replaces the playback instead of adding to the queue
+        int                offset = -1;   // play: index of the item to start with
+        int                item = 0;      // next item to send
+        int                track = 0;     // next track of that item
+        int                inFlight = 0;  // queue requests on the wire
+        QElapsedTimer      timer;
+    };
+    void sendItems(const QVariantList& items, bool play, int offset = -1);
+    void resolveQueueItem(QSharedPointer<QueueBatch> batch, int index);
+    void pumpQueue(QSharedPointer<QueueBatch> batch);
+    void playBatch(QSharedPointer<QueueBatch> batch);
 
     // get and post requests
-    void getRequest(const QString& url, const QString& params);
-    void postRequest(const QString& url, const QString& params);
-    void putRequest(const QString& url, const QString& params);  // TODO(marton): change param to QUrlQuery
-                                                                 // QUrlQuery query;
+    typedef std::function<void(const QByteArray& body)> BodyHandler;
+
+    // The handler is called with the non-empty reply body of exactly this request. A request with a supersede key
+    // cancels the previous, still running request with the same key, so stale responses are never delivered.
+    quint64 getRequest(const QString& url, const QString& params, const QString& supersedeKey,
+                       const BodyHandler& handler);
+
+    typedef WebApi::StatusHandler StatusHandler;
+
+    // Serves the object from the metadata cache if possible. With revalidate, a stale entry is shown right away and
+    // fetched again; the handler is called a second time only if the content changed. The handler returns false if the
+    // body cannot be decoded: the entry is dropped from the cache and, if it came from there, fetched again.
+    // Failed is called if the object could not be fetched or decoded, see WebApi::get().
+    typedef std::function<bool(const QByteArray& body)> CachedBodyHandler;
+    void getCached(MetadataCache::Type type, const QString& id, const QString& url, const QString& params,
+                   const QString& supersedeKey, bool revalidate, const CachedBodyHandler& handler,
+                   const StatusHandler& failed = nullptr);
+
+    // Requests with the same collapse key are sent one at a time, a waiting one is replaced by the newer one.
+    // PUTs are retried, POSTs only if they did not reach the server; without connection both wait in the offline queue.
+    void postRequest(const QString& url, const QString& params, const StatusHandler& handler = nullptr,
+                     const QString& collapseKey = QString());
+    void putRequest(const QString& url, const QString& params, const StatusHandler& handler = nullptr,
+                    const QString& collapseKey = QString());  // TODO(marton): change param to QUrlQuery
+                                                              // QUrlQuery query;
 
     //    query.addQueryItem("username", "test");
     //    query.addQueryItem("password", "test");
@@ -104,26 +304,98 @@ class Spotify : public Integration {
     //    url.setQuery(query.query());
 
  private slots:
-    void onTokenTimeOut();
     void onPollingTimerTimeout();
-    void onProgressBarTimerTimeout();
+    void onProgressChanged(int position);
 
  private:
     bool    m_startup = true;
+    bool    m_connected = false;  // between connect() and disconnect(), i.e. not in standby
     QString m_entityId;
 
-    // polling timer
-    QTimer* m_pollingTimer;
-    QTimer* m_progressBarTimer;
+    // shared HTTP client for all Web API and token requests
+    HttpClient* m_http;
+
+    // Web API requests with retries, circuit breakers and the commands waiting for the connection
+    WebApi* m_api;
+
+    // albums, playlists, artists and tracks already fetched
+    MetadataCache m_cache;
+
+    // cover art on disk
+    ImageCache* m_images;
+
+    // time from a play or queue command until the API confirmed it
+    LatencyHistogram m_commandLatency;
 
-    int m_progressBarPosition = 0;
+    // time spent in entity and model updates on the main thread
+    std::atomic<qint64> m_mainThreadNs{0};
+
+    // per endpoint timings, status codes and sizes, enabled with the telemetry config key
+    Telemetry* m_telemetry;
+
+    // time since connect() for the request rate
+    QElapsedTimer m_connectedTime;
+
+    // incremented with every browse model shown
+    int m_browseGeneration = 0;
+
+    // supersede keys of the running prefetches
+    QStringList m_prefetchKeys;
+    quint64     m_prefetched = 0;
+
+    // string data shared between browse and search items instead of being kept per item
+    qint64 m_internedBytes = 0;
+
+    // search
+    QTimer*                              m_searchTimer;
+    QString                              m_pendingSearch;
+    QString                              m_shownSearch;
+    QCache<QString, SpotifySearchResult> m_searchCache;
+
+    // polling, and the optional push connection which replaces it while it is up
+    PollScheduler*       m_pollScheduler;
+    PlayerStateProvider* m_pushProvider = nullptr;
+    bool                 m_pushConnected = false;
+    quint64              m_pushedStates = 0;
+    PlaybackProgress*    m_progress;
+
+    // continuous controls
+    ThrottledControl* m_volumeControl;
+    ThrottledControl* m_seekControl;
+    bool              m_muted = false;
+    int               m_volumeBeforeMute = 0;
+
+    // last player state pushed to the entity
+    PlayerSnapshot m_player;
+    quint64        m_updatesEmitted = 0;
+    quint64        m_updatesSuppressed = 0;
+    QString        m_playerSnapshotPath;
+
+    // player polls: bytes downloaded, parse time, and polls which needed no parsing
+    quint64                    m_polls = 0;
+    quint64                    m_pollBytes = 0;
+    qint64                     m_pollParseNs = 0;
+    quint64                    m_pollsEmpty = 0;
+    quint64                    m_pollsUnchanged = 0;
+    QByteArray                 m_lastPlayerBody;
+    PollScheduler::PlayerState m_lastPollState = PollScheduler::UNKNOWN;
+
+    // Spotify Connect devices, and the reply they were decoded from
+    QVector<SpotifyDevice> m_devices;
+    QByteArray             m_devicesBody;
+    QElapsedTimer          m_devicesFetched;
+
+    // time to first render after connect()
+    bool m_renderPending = false;
+    bool m_livePending = false;
 
     // Spotify auth stuff
-    QString m_clientId;
-    QString m_clientSecret;
-    QString m_accessToken;
-    QString m_refreshToken;
-    int     m_tokenExpire = 0;  // in seconds
-    QTimer* m_tokenTimeOutTimer;
+    QString       m_clientId;
+    QString       m_clientSecret;
+    QString       m_refreshToken;
+    TokenManager* m_tokens;
+
+    // base URLs, can be pointed to a local stand-in of the Web API with the api_url and accounts_url config keys
     QString m_apiURL = "https://api.spotify.com";
+    QString m_accountsURL = "https://accounts.spotify.com";
 };
@@ -0,0 +1,303 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "spotifytypes.h"
+
+#include <QJsonDocument>
+
+bool SpotifyDecoder::decodeAlbum(const QByteArray& json, SpotifyAlbum* album) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+    *album = readAlbum(object);
+
+    // album tracks are simplified track objects without album information
+    QJsonArray tracks = object.value("tracks").toObject().value("items").toArray();
+    album->tracks.reserve(tracks.size());
+    for (const QJsonValue& value : tracks) {
+        SpotifyTrack track = readTrack(value.toObject());
+        track.albumName = album->name;
+        track.albumImages = album->images;
+        album->tracks.append(track);
+    }
+    return true;
+}
+
+bool SpotifyDecoder::decodePlaylist(const QByteArray& json, SpotifyPlaylist* playlist) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+    *playlist = readPlaylist(object);
+
+    // first page of tracks, the rest is behind tracksNext
+    readPlaylistItems(object.value("tracks").toObject().value("items").toArray(), &playlist->tracks);
+    return true;
+}
+
+bool SpotifyDecoder::decodePlaylistTrackPage(const QByteArray& json, SpotifyTrackPage* page) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+
+    readPlaylistItems(object.value("items").toArray(), &page->items);
+    page->next = object.value("next").toString();
+    return true;
+}
+
+bool SpotifyDecoder::decodePlaylistPage(const QByteArray& json, SpotifyPlaylistPage* page) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+
+    QJsonArray items = object.value("items").toArray();
+    page->items.reserve(items.size());
+    for (const QJsonValue& value : items) {
+        page->items.append(readPlaylist(value.toObject()));
+    }
+    page->next = object.value("next").toString();
+    return true;
+}
+
+bool SpotifyDecoder::decodePlayerState(const QByteArray& json, SpotifyPlayerState* state) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+
+    QJsonObject device = object.value("device").toObject();
+    state->hasDevice = !device.isEmpty();
+    if (state->hasDevice) {
+        state->device = readDevice(device);
+    }
+
+    QJsonObject item = object.value("item").toObject();
+    state->hasItem = !item.isEmpty();
+    if (state->hasItem) {
+        state->item = readTrack(item);
+    }
+
+    state->isPlaying = object.value("is_playing").toBool();
+    state->progressMs = object.value("progress_ms").toInt();
+    return true;
+}
+
+bool SpotifyDecoder::decodeSearchResult(const QByteArray& json, SpotifySearchResult* result) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+
+    QJsonArray albums = object.value("albums").toObject().value("items").toArray();
+    result->albums.reserve(albums.size());
+    for (const QJsonValue& value : albums) {
+        result->albums.append(readAlbum(value.toObject()));
+    }
+
+    QJsonArray tracks = object.value("tracks").toObject().value("items").toArray();
+    result->tracks.reserve(tracks.size());
+    for (const QJsonValue& value : tracks) {
+        result->tracks.append(readTrack(value.toObject()));
+    }
+
+    QJsonArray artists = object.value("artists").toObject().value("items").toArray();
+    result->artists.reserve(artists.size());
+    for (const QJsonValue& value : artists) {
+        result->artists.append(readArtist(value.toObject()));
+    }
+
+    QJsonArray playlists = object.value("playlists").toObject().value("items").toArray();
+    result->playlists.reserve(playlists.size());
+    for (const QJsonValue& value : playlists) {
+        result->playlists.append(readPlaylist(value.toObject()));
+    }
+    return true;
+}
+
+bool SpotifyDecoder::decodeQueue(const QByteArray& json, QVector<SpotifyTrack>* queue) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+
+    QJsonArray items = object.value("queue").toArray();
+    queue->reserve(items.size());
+    for (const QJsonValue& value : items) {
+        queue->append(readTrack(value.toObject()));
+    }
+    return true;
+}
+
+bool SpotifyDecoder::decodeDevices(const QByteArray& json, QVector<SpotifyDevice>* devices) {
+    QJsonObject object;
+    if (!parse(json, &object)) {
+        return false;
+    }
+
+    QJsonArray items = object.value("devices").toArray();
+    devices->reserve(items.size());
+    for (const QJsonValue& value : items) {
+        devices->append(readDevice(value.toObject()));
+    }
+    return true;
+}
+
+QString SpotifyDecoder::decodeSnapshotId(const QByteArray& json) {
+    // a playlist object contains exactly one snapshot_id, its track items have none
+    int key = json.indexOf("\"snapshot_id\"");
+    if (key < 0) {
+        return QString();
+    }
+    int colon = json.indexOf(':', key);
+    int start = colon < 0 ? -1 : json.indexOf('"', colon);
+    int end = start < 0 ? -1 : json.indexOf('"', start + 1);
+    if (end < 0) {
+        return QString();
+    }
+    return QString::fromUtf8(json.mid(start + 1, end - start - 1));
+}
+
+QString SpotifyDecoder::imageUrl(const SpotifyImages& images, int width) {
+    const SpotifyImage* fit = nullptr;
+    const SpotifyImage* largest = nullptr;
+    for (const SpotifyImage& image : images) {
+        if (image.width <= 0) {
+            continue;
+        }
+        if (image.width >= width && (!fit || image.width < fit->width)) {
+            fit = &image;
+        }
+        if (!largest || image.width > largest->width) {
+            largest = &image;
+        }
+    }
+
+    if (fit) {
+        return fit->url;
+    }
+    if (largest) {
+        return largest->url;
+    }
+    return images.isEmpty() ? QString() : images.first().url;
+}
+
+bool SpotifyDecoder::parse(const QByteArray& json, QJsonObject* object) {
+    QJsonParseError parseerror;
+    QJsonDocument   doc = QJsonDocument::fromJson(json, &parseerror);
+    if (parseerror.error != QJsonParseError::NoError || !doc.isObject()) {
+        return false;
+    }
+    *object = doc.object();
+    return true;
+}
+
+SpotifyImages SpotifyDecoder::readImages(const QJsonArray& array) {
+    SpotifyImages images;
+    images.reserve(array.size());
+    for (const QJsonValue& value : array) {
+        QJsonObject  object = value.toObject();
+        SpotifyImage image;
+        image.url = object.value("url").toString();
+        image.width = object.value("width").toInt();
+        image.height = object.value("height").toInt();
+        images.append(image);
+    }
+    return images;
+}
+
+QString SpotifyDecoder::readFirstArtist(const QJsonArray& artists) {
+    if (artists.isEmpty()) {
+        return QString();
+    }
+    return artists.first().toObject().value("name").toString();
+}
+
+SpotifyTrack SpotifyDecoder::readTrack(const QJsonObject& object) {
+    SpotifyTrack track;
+    track.id = object.value("id").toString();
+    track.name = object.value("name").toString();
+    track.uri = object.value("uri").toString();
+    track.artist = readFirstArtist(object.value("artists").toArray());
+    track.durationMs = object.value("duration_ms").toInt();
+
+    QJsonObject album = object.value("album").toObject();
+    if (!album.isEmpty()) {
+        track.albumName = album.value("name").toString();
+        track.albumImages = readImages(album.value("images").toArray());
+    }
+    return track;
+}
+
+SpotifyAlbum SpotifyDecoder::readAlbum(const QJsonObject& object) {
+    SpotifyAlbum album;
+    album.id = object.value("id").toString();
+    album.name = object.value("name").toString();
+    album.uri = object.value("uri").toString();
+    album.artist = readFirstArtist(object.value("artists").toArray());
+    album.images = readImages(object.value("images").toArray());
+    return album;
+}
+
+SpotifyArtist SpotifyDecoder::readArtist(const QJsonObject& object) {
+    SpotifyArtist artist;
+    artist.id = object.value("id").toString();
+    artist.name = object.value("name").toString();
+    artist.uri = object.value("uri").toString();
+    artist.images = readImages(object.value("images").toArray());
+    return artist;
+}
+
+SpotifyPlaylist SpotifyDecoder::readPlaylist(const QJsonObject& object) {
+    SpotifyPlaylist playlist;
+    playlist.id = object.value("id").toString();
+    playlist.name = object.value("name").toString();
+    playlist.uri = object.value("uri").toString();
+    playlist.owner = object.value("owner").toObject().value("display_name").toString();
+    playlist.snapshotId = object.value("snapshot_id").toString();
+    playlist.images = readImages(object.value("images").toArray());
+
+    playlist.tracksNext = object.value("tracks").toObject().value("next").toString();
+    return playlist;
+}
+
+void SpotifyDecoder::readPlaylistItems(const QJsonArray& items, QVector<SpotifyTrack>* tracks) {
+    tracks->reserve(tracks->size() + items.size());
+    for (const QJsonValue& value : items) {
+        QJsonObject track = value.toObject().value("track").toObject();
+        // removed tracks come without track object
+        if (!track.isEmpty()) {
+            tracks->append(readTrack(track));
+        }
+    }
+}
+
+SpotifyDevice SpotifyDecoder::readDevice(const QJsonObject& object) {
+    SpotifyDevice device;
+    device.id = object.value("id").toString();
+    device.name = object.value("name").toString();
+    device.type = object.value("type").toString();
+    device.volume = object.value("volume_percent").toInt();
+    return device;
+}
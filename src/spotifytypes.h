@@ -0,0 +1,152 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// SPOTIFY WEB API TYPES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Only the fields used by the integration are decoded.
+
+struct SpotifyImage {
+    QString url;
+    int     width = 0;
+    int     height = 0;
+};
+typedef QVector<SpotifyImage> SpotifyImages;
+
+struct SpotifyTrack {
+    QString       id;
+    QString       name;
+    QString       uri;
+    QString       artist;  // first artist
+    QString       albumName;
+    SpotifyImages albumImages;
+    int           durationMs = 0;
+};
+
+struct SpotifyArtist {
+    QString       id;
+    QString       name;
+    QString       uri;
+    SpotifyImages images;
+};
+
+struct SpotifyAlbum {
+    QString               id;
+    QString               name;
+    QString               uri;
+    QString               artist;  // first artist
+    SpotifyImages         images;
+    QVector<SpotifyTrack> tracks;
+};
+
+struct SpotifyPlaylist {
+    QString               id;
+    QString               name;
+    QString               uri;
+    QString               owner;
+    QString               snapshotId;
+    SpotifyImages         images;
+    QVector<SpotifyTrack> tracks;
+    QString               tracksNext;
+};
+
+struct SpotifyTrackPage {
+    QVector<SpotifyTrack> items;
+    QString               next;
+};
+
+struct SpotifyPlaylistPage {
+    QVector<SpotifyPlaylist> items;
+    QString                  next;
+};
+
+struct SpotifyDevice {
+    QString id;
+    QString name;
+    QString type;
+    int     volume = 0;
+};
+
+struct SpotifyPlayerState {
+    bool          hasDevice = false;
+    bool          hasItem = false;
+    bool          isPlaying = false;
+    int           progressMs = 0;
+    SpotifyDevice device;
+    SpotifyTrack  item;
+};
+
+struct SpotifySearchResult {
+    QVector<SpotifyAlbum>    albums;
+    QVector<SpotifyTrack>    tracks;
+    QVector<SpotifyArtist>   artists;
+    QVector<SpotifyPlaylist> playlists;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// DECODER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Decodes Web API reply bodies straight into the types above, without building a QVariant tree.
+/// All functions return false if the body is not a valid JSON object.
+class SpotifyDecoder {
+ public:
+    static bool decodeAlbum(const QByteArray& json, SpotifyAlbum* album);
+    static bool decodePlaylist(const QByteArray& json, SpotifyPlaylist* playlist);
+    static bool decodePlaylistTrackPage(const QByteArray& json, SpotifyTrackPage* page);
+    static bool decodePlaylistPage(const QByteArray& json, SpotifyPlaylistPage* page);
+    static bool decodePlayerState(const QByteArray& json, SpotifyPlayerState* state);
+    static bool decodeSearchResult(const QByteArray& json, SpotifySearchResult* result);
+
+    // tracks in the queue of /v1/me/player/queue, without the currently playing one
+    static bool decodeQueue(const QByteArray& json, QVector<SpotifyTrack>* queue);
+
+    // Spotify Connect devices of /v1/me/player/devices
+    static bool decodeDevices(const QByteArray& json, QVector<SpotifyDevice>* devices);
+
+    // returns the snapshot_id of a playlist without parsing the whole document
+    static QString decodeSnapshotId(const QByteArray& json);
+
+    // url of the smallest image at least the given width wide, or of the largest one if none is wide enough. Images
+    // without a size (e.g. playlist mosaics) are only used if there is nothing else.
+    static QString imageUrl(const SpotifyImages& images, int width);
+
+ private:
+    static bool            parse(const QByteArray& json, QJsonObject* object);
+    static SpotifyImages   readImages(const QJsonArray& array);
+    static QString         readFirstArtist(const QJsonArray& artists);
+    static SpotifyTrack    readTrack(const QJsonObject& object);
+    static SpotifyAlbum    readAlbum(const QJsonObject& object);
+    static SpotifyArtist   readArtist(const QJsonObject& object);
+    static SpotifyPlaylist readPlaylist(const QJsonObject& object);
+    static SpotifyDevice   readDevice(const QJsonObject& object);
+    static void            readPlaylistItems(const QJsonArray& items, QVector<SpotifyTrack>* tracks);
+};
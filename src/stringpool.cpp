@@ -0,0 +1,43 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "stringpool.h"
+
+QString StringPool::intern(const QString& string) {
+    // empty strings share Qt's empty data already
+    if (string.isEmpty()) {
+        return string;
+    }
+
+    QSet<QString>::const_iterator it = m_strings.constFind(string);
+    if (it != m_strings.constEnd()) {
+        m_savedBytes += string.size() * static_cast<qint64>(sizeof(QChar));
+        return *it;
+    }
+    return *m_strings.insert(string);
+}
+
+qint64 StringPool::takeSavedBytes() {
+    qint64 saved = m_savedBytes;
+    m_savedBytes = 0;
+    return saved;
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QSet>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// STRING POOL
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Makes equal strings share one buffer. QString is implicitly shared, so every copy of an interned string refers to
+/// the same data and the duplicates decoded from a reply are freed right away. One pool is used per response, e.g. a
+/// playlist with all of its pages; the interned strings live on in the model items after the pool is gone.
+class StringPool {
+ public:
+    // returns the pooled copy of the string, adding it if it is not pooled yet
+    QString intern(const QString& string);
+
+    int size() const { return m_strings.size(); }
+
+    // bytes of string data not kept twice thanks to the pool, since the last call
+    qint64 takeSavedBytes();
+
+ private:
+    QSet<QString> m_strings;
+    qint64        m_savedBytes = 0;
+};
@@ -0,0 +1,137 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "telemetry.h"
+
+Telemetry::Telemetry(QObject* parent) : QObject(parent), m_reportTimer(new QTimer(this)) {
+    QObject::connect(m_reportTimer, &QTimer::timeout, this, &Telemetry::report);
+}
+
+void Telemetry::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    if (!enabled) {
+        m_reportTimer->stop();
+    } else if (m_reportTimer->interval() > 0) {
+        m_reportTimer->start();
+    }
+}
+
+void Telemetry::setReportInterval(int ms) {
+    m_reportTimer->setInterval(qMax(0, ms));
+    if (m_enabled && ms > 0) {
+        m_reportTimer->start();
+    } else {
+        m_reportTimer->stop();
+    }
+}
+
+void Telemetry::recordRequest(const QString& endpoint, const Request& request) {
+    if (!m_enabled) {
+        return;
+    }
+    Endpoint& stats = m_endpoints[endpoint];
+    stats.requests++;
+    stats.statusCodes[request.statusCode]++;
+    stats.bytesIn += static_cast<quint64>(request.bytesIn);
+    stats.bytesOut += static_cast<quint64>(request.bytesOut);
+    stats.queued.record(request.queuedMs);
+    if (request.handshakeMs >= 0) {
+        stats.handshake.record(request.handshakeMs);
+    }
+    if (request.firstByteMs >= 0) {
+        stats.firstByte.record(request.firstByteMs);
+    }
+    stats.total.record(request.totalMs);
+}
+
+void Telemetry::recordRetry(const QString& endpoint) {
+    if (!m_enabled) {
+        return;
+    }
+    m_endpoints[endpoint].retries++;
+}
+
+void Telemetry::recordDecode(const QString& endpoint, qint64 ns) {
+    if (!m_enabled) {
+        return;
+    }
+    Endpoint& stats = m_endpoints[endpoint];
+    stats.decodes++;
+    stats.decodeNs += ns;
+}
+
+void Telemetry::recordBuild(const QString& endpoint, qint64 ns) {
+    if (!m_enabled) {
+        return;
+    }
+    Endpoint& stats = m_endpoints[endpoint];
+    stats.builds++;
+    stats.buildNs += ns;
+}
+
+QVariantMap Telemetry::snapshot() const {
+    QVariantMap snapshot;
+    for (QHash<QString, Endpoint>::const_iterator iter = m_endpoints.constBegin(); iter != m_endpoints.constEnd();
+         ++iter) {
+        const Endpoint& stats = iter.value();
+
+        QVariantMap statusCodes;
+        for (QMap<int, quint64>::const_iterator code = stats.statusCodes.constBegin();
+             code != stats.statusCodes.constEnd(); ++code) {
+            statusCodes.insert(QString::number(code.key()), code.value());
+        }
+
+        QVariantMap endpoint;
+        endpoint.insert("requests", stats.requests);
+        endpoint.insert("retries", stats.retries);
+        endpoint.insert("bytes_in", stats.bytesIn);
+        endpoint.insert("bytes_out", stats.bytesOut);
+        endpoint.insert("status", statusCodes);
+        endpoint.insert("queued", histogram(stats.queued));
+        endpoint.insert("handshake", histogram(stats.handshake));
+        endpoint.insert("first_byte", histogram(stats.firstByte));
+        endpoint.insert("total", histogram(stats.total));
+        endpoint.insert("decodes", stats.decodes);
+        endpoint.insert("decode_us", stats.decodeNs / 1000);
+        endpoint.insert("builds", stats.builds);
+        endpoint.insert("build_us", stats.buildNs / 1000);
+        snapshot.insert(iter.key(), endpoint);
+    }
+    return snapshot;
+}
+
+void Telemetry::report() {
+    if (m_enabled) {
+        emit reported(snapshot());
+    }
+}
+
+QVariantMap Telemetry::histogram(const LatencyHistogram& histogram) {
+    QVariantMap map;
+    map.insert("n", histogram.count());
+    map.insert("mean", histogram.mean());
+    map.insert("p50", histogram.percentile(50));
+    map.insert("p90", histogram.percentile(90));
+    map.insert("p99", histogram.percentile(99));
+    map.insert("max", histogram.max());
+    return map;
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+#include "latencyhistogram.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// TELEMETRY
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Per-endpoint request telemetry: request count, latency of the request phases, status codes, retries, bytes, and the
+/// time spent decoding replies and building models. While disabled, every record call returns after one check.
+/// The snapshot is read on the thread the integration lives on; everybody else gets it with the reported() signal.
+class Telemetry : public QObject {
+    Q_OBJECT
+
+ public:
+    // one finished request, times in milliseconds; -1 for phases Qt did not report
+    struct Request {
+        int    statusCode = 0;    // 0: no HTTP reply, e.g. network error or aborted
+        qint64 queuedMs = 0;      // waiting for a free slot in the HTTP client
+        qint64 handshakeMs = -1;  // connect and TLS handshake, only for requests which opened a connection
+        qint64 firstByteMs = -1;  // until the reply headers arrived
+        qint64 totalMs = 0;       // from sending to the finished reply
+        qint64 bytesIn = 0;
+        qint64 bytesOut = 0;
+    };
+
+    struct Endpoint {
+        quint64            requests = 0;
+        quint64            retries = 0;
+        quint64            bytesIn = 0;
+        quint64            bytesOut = 0;
+        QMap<int, quint64> statusCodes;
+        LatencyHistogram   queued;
+        LatencyHistogram   handshake;
+        LatencyHistogram   firstByte;
+        LatencyHistogram   total;
+        quint64            decodes = 0;
+        qint64             decodeNs = 0;
+        quint64            builds = 0;
+        qint64             buildNs = 0;
+    };
+
+    explicit Telemetry(QObject* parent = nullptr);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    // reported() is emitted every interval while enabled; 0 only emits it on report()
+    void setReportInterval(int ms);
+
+    void recordRequest(const QString& endpoint, const Request& request);
+    void recordRetry(const QString& endpoint);
+    void recordDecode(const QString& endpoint, qint64 ns);
+    void recordBuild(const QString& endpoint, qint64 ns);
+
+    const QHash<QString, Endpoint>& endpoints() const { return m_endpoints; }
+
+    // JSON compatible map of all endpoints, e.g.
+    // {"/v1/me/player": {"requests": 12, "status": {"200": 10, "204": 2}, "total": {"n": 12, "p50": 200, ...}, ...}}
+    QVariantMap snapshot() const;
+
+ public slots:
+    // emits reported() with the current snapshot, if enabled
+    void report();
+
+ signals:
+    void reported(const QVariantMap& snapshot);
+
+ private:
+    static QVariantMap histogram(const LatencyHistogram& histogram);
+
+ private:
+    bool                     m_enabled = false;
+    QTimer*                  m_reportTimer;
+    QHash<QString, Endpoint> m_endpoints;
+};
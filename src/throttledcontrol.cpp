@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "throttledcontrol.h"
+
+ThrottledControl::ThrottledControl(int intervalMs, const Sender& sender, QObject* parent)
+    : QObject(parent), m_timer(new QTimer(this)), m_sender(sender) {
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(intervalMs);
+    QObject::connect(m_timer, &QTimer::timeout, this, &ThrottledControl::onTimeout);
+}
+
+void ThrottledControl::set(int value) {
+    m_target = value;
+    m_changed.start();
+    m_changes++;
+
+    // the first change goes out right away, the following ones with the next interval
+    if (m_timer->isActive()) {
+        m_pending = true;
+    } else {
+        send();
+    }
+}
+
+bool ThrottledControl::isSettling() const {
+    return m_changed.isValid() && (m_pending || m_changed.elapsed() < SETTLE_TIME);
+}
+
+int ThrottledControl::reconcile(int reported) {
+    if (!isSettling()) {
+        return reported;
+    }
+
+    // confirmed by the server
+    if (reported == m_target && !m_pending) {
+        m_changed.invalidate();
+        return reported;
+    }
+    return m_target;
+}
+
+void ThrottledControl::onTimeout() {
+    // changed back to the value sent at the start of the interval: nothing to send. A change after the interval is
+    // always sent, even with the same value, as it may have been changed elsewhere in the meantime.
+    if (m_pending && m_target == m_lastSent) {
+        m_pending = false;
+    } else if (m_pending) {
+        send();
+    }
+}
+
+void ThrottledControl::send() {
+    m_pending = false;
+    m_lastSent = m_target;
+    m_sent++;
+    m_sender(m_target);
+    m_timer->start();
+}
@@ -0,0 +1,75 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <functional>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// THROTTLED CONTROL
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// A continuously adjusted value like volume or seek position.
+/// The caller shows the new value right away. The value is sent at most once per interval, the latest one wins. For a
+/// short time after the last change, polled values still reflect older states and are overridden by the target, so
+/// the control does not jump back while the change is on its way.
+class ThrottledControl : public QObject {
+    Q_OBJECT
+
+ public:
+    typedef std::function<void(int value)> Sender;
+
+    ThrottledControl(int intervalMs, const Sender& sender, QObject* parent = nullptr);
+
+    void set(int value);
+
+    // a change by the user is still on its way
+    bool isSettling() const;
+    int  target() const { return m_target; }
+
+    // value to show for a polled one
+    int reconcile(int reported);
+
+    quint64 changes() const { return m_changes; }
+    quint64 sent() const { return m_sent; }
+
+ private slots:
+    void onTimeout();
+
+ private:
+    void send();
+
+ private:
+    static const int SETTLE_TIME = 3000;
+
+    QTimer*       m_timer;
+    Sender        m_sender;
+    QElapsedTimer m_changed;
+    int           m_target = -1;
+    int           m_lastSent = -1;
+    bool          m_pending = false;
+    quint64       m_changes = 0;
+    quint64       m_sent = 0;
+};
@@ -0,0 +1,186 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "tokenmanager.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+
+TokenManager::TokenManager(HttpClient* http, const QString& tokenUrl, const QString& clientId,
+                           const QString& clientSecret, const QString& refreshToken, const QString& storePath,
+                           const QLoggingCategory& logCategory, QObject* parent)
+    : QObject(parent),
+      m_http(http),
+      m_tokenUrl(tokenUrl),
+      m_clientId(clientId),
+      m_clientSecret(clientSecret),
+      m_configuredRefreshToken(refreshToken),
+      m_refreshToken(refreshToken),
+      m_storePath(storePath),
+      m_logCategory(logCategory),
+      m_timer(new QTimer(this)) {
+    m_timer->setSingleShot(true);
+    QObject::connect(m_timer, &QTimer::timeout, this, &TokenManager::refresh);
+    load();
+}
+
+QString TokenManager::accessToken() const {
+    return isValid() ? m_accessToken : QString();
+}
+
+bool TokenManager::isValid() const {
+    return !m_accessToken.isEmpty() && m_expiresAt.isValid() && QDateTime::currentDateTimeUtc() < m_expiresAt;
+}
+
+void TokenManager::start() {
+    if (isValid()) {
+        schedule();
+        emit tokenReady();
+    } else {
+        refresh();
+    }
+}
+
+void TokenManager::stop() {
+    m_timer->stop();
+    m_parked.clear();
+
+    // a cancelled request never calls its handler
+    if (m_refreshing) {
+        m_http->cancel(m_refreshRequest);
+        m_refreshing = false;
+    }
+}
+
+void TokenManager::refresh() {
+    if (m_refreshing) {
+        return;
+    }
+    m_refreshing = true;
+    m_refreshes++;
+    m_timer->stop();
+
+    QNetworkRequest request;
+
+    QByteArray postData;
+    postData.append("grant_type=refresh_token&");
+    postData.append("refresh_token=");
+    postData.append(m_refreshToken);
+
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+
+    QString header_auth;
+    header_auth.append(m_clientId).append(":").append(m_clientSecret);
+
+    request.setRawHeader("Authorization", "Basic " + header_auth.toUtf8().toBase64());
+    request.setUrl(QUrl(m_tokenUrl));
+
+    HttpClient::ReplyHandler onReply = [=](QNetworkReply* reply, const QByteArray& body) {
+        m_refreshing = false;
+
+        if (reply->error()) {
+            qCWarning(m_logCategory) << "Refresh token:" << reply->errorString();
+        }
+
+        QJsonParseError parseerror;
+        QJsonDocument   doc = QJsonDocument::fromJson(body, &parseerror);
+        QJsonObject     object = doc.object();
+        if (parseerror.error != QJsonParseError::NoError || !object.contains("access_token")) {
+            qCWarning(m_logCategory) << "No access token received, retrying in" << RETRY_INTERVAL << "seconds";
+            m_timer->start(RETRY_INTERVAL * 1000);
+            return;
+        }
+
+        m_accessToken = object.value("access_token").toString();
+        m_expiresAt = QDateTime::currentDateTimeUtc().addSecs(object.value("expires_in").toInt(3600));
+
+        // Spotify may rotate the refresh token
+        if (object.contains("refresh_token")) {
+            m_refreshToken = object.value("refresh_token").toString();
+        }
+        qCDebug(m_logCategory) << "Got new access token, valid until" << m_expiresAt;
+
+        store();
+        schedule();
+        emit tokenReady();
+
+        // replay everything which waited for the token
+        QList<Action> parked;
+        parked.swap(m_parked);
+        for (const Action& action : parked) {
+            action();
+        }
+    };
+    m_refreshRequest = m_http->send(HttpClient::POST, request, postData, onReply);
+}
+
+void TokenManager::whenValid(const Action& action) {
+    if (isValid()) {
+        action();
+        return;
+    }
+
+    if (m_parked.size() >= MAX_PARKED) {
+        qCWarning(m_logCategory) << "Too many requests waiting for a token, dropping the oldest";
+        m_parked.removeFirst();
+    }
+    m_parked.append(action);
+    m_parkedTotal++;
+    refresh();
+}
+
+void TokenManager::rejected(const QString& token) {
+    // requests still running with an old token must not start a refresh each
+    if (token != m_accessToken) {
+        return;
+    }
+    m_accessToken.clear();
+    refresh();
+}
+
+void TokenManager::schedule() {
+    // refresh ahead of expiry: 10% of the lifetime, at least a minute
+    qint64 remaining = QDateTime::currentDateTimeUtc().secsTo(m_expiresAt);
+    qint64 margin = qMax<qint64>(MIN_REFRESH_MARGIN, remaining / 10);
+    m_timer->start(static_cast<int>(qMax<qint64>(0, remaining - margin) * 1000));
+}
+
+void TokenManager::load() {
+    QSettings settings(m_storePath, QSettings::IniFormat);
+
+    // a new authorization in the configuration invalidates the stored tokens
+    if (settings.value("configured_refresh_token").toString() != m_configuredRefreshToken) {
+        return;
+    }
+    m_accessToken = settings.value("access_token").toString();
+    m_expiresAt = settings.value("expires_at").toDateTime();
+    m_refreshToken = settings.value("refresh_token", m_refreshToken).toString();
+}
+
+void TokenManager::store() {
+    QSettings settings(m_storePath, QSettings::IniFormat);
+    settings.setValue("configured_refresh_token", m_configuredRefreshToken);
+    settings.setValue("access_token", m_accessToken);
+    settings.setValue("expires_at", m_expiresAt);
+    settings.setValue("refresh_token", m_refreshToken);
+}
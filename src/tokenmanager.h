@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QDateTime>
+#include <QList>
+#include <QLoggingCategory>
+#include <QTimer>
+
+#include <functional>
+
+#include "httpclient.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// TOKEN MANAGER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Owns the Spotify access token.
+/// - at most one refresh request is in flight
+/// - the token is refreshed ahead of its expiry, derived from expires_in
+/// - requests which need a token while there is none are parked and run once a new token arrives
+/// - the last token is stored on disk, so a restart within its lifetime needs no refresh
+class TokenManager : public QObject {
+    Q_OBJECT
+
+ public:
+    typedef std::function<void()> Action;
+
+    // logs to the category of the integration
+    TokenManager(HttpClient* http, const QString& tokenUrl, const QString& clientId, const QString& clientSecret,
+                 const QString& refreshToken, const QString& storePath, const QLoggingCategory& logCategory,
+                 QObject* parent = nullptr);
+
+    // empty if there is no valid token
+    QString accessToken() const;
+    bool    isValid() const;
+
+    // Emits tokenReady() right away if the stored token is still valid, otherwise refreshes it
+    void start();
+
+    // Drops the parked actions and a running refresh: nothing is scheduled and tokenReady() is not emitted
+    void stop();
+
+    // Starts a refresh unless one is already running
+    void refresh();
+
+    // Runs the action now if there is a valid token, otherwise after the next successful refresh
+    void whenValid(const Action& action);
+
+    // The API rejected the token with 401. Only the first rejection of a token starts a refresh.
+    void rejected(const QString& token);
+
+    quint64 refreshes() const { return m_refreshes; }
+    quint64 parked() const { return m_parkedTotal; }
+
+ signals:
+    void tokenReady();
+
+ private:
+    void schedule();
+    void load();
+    void store();
+
+ private:
+    static const int MIN_REFRESH_MARGIN = 60;  // seconds
+    static const int RETRY_INTERVAL = 30;      // seconds
+    static const int MAX_PARKED = 32;
+
+    HttpClient*             m_http;
+    QString                 m_tokenUrl;
+    QString                 m_clientId;
+    QString                 m_clientSecret;
+    QString                 m_configuredRefreshToken;
+    QString                 m_refreshToken;
+    QString                 m_accessToken;
+    QDateTime               m_expiresAt;
+    QString                 m_storePath;
+    const QLoggingCategory& m_logCategory;
+    QTimer*                 m_timer;
+    bool                    m_refreshing = false;
+    quint64                 m_refreshRequest = 0;
+    QList<Action>           m_parked;
+    quint64                 m_refreshes = 0;
+    quint64                 m_parkedTotal = 0;
+};
@@ -0,0 +1,364 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "webapi.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTimer>
+
+WebApi::WebApi(HttpClient* http, TokenManager* tokens, Telemetry* telemetry, const QString& apiUrl,
+               const RetryPolicy& retry, const CircuitBreaker& breakers, const QLoggingCategory& logCategory,
+               QObject* parent)
+    : QObject(parent),
+      m_http(http),
+      m_tokens(tokens),
+      m_telemetry(telemetry),
+      m_apiURL(apiUrl),
+      m_retry(retry),
+      m_breakers(breakers),
+      m_logCategory(logCategory) {}
+
+quint64 WebApi::get(const QString& url, const QString& params, const QString& supersedeKey, const QByteArray& etag,
+                    const ReplyHandler& handler, const StatusHandler& failed, QNetworkRequest::Priority priority) {
+    return sendGet(url, params, supersedeKey, etag, handler, failed, priority, false, 0);
+}
+
+quint64 WebApi::sendGet(const QString& url, const QString& params, const QString& supersedeKey,
+                        const QByteArray& etag, const ReplyHandler& handler, const StatusHandler& failed,
+                        QNetworkRequest::Priority priority, bool replayed, int attempt) {
+    QString token = m_tokens->accessToken();
+    if (token.isEmpty()) {
+        m_tokens->whenValid(
+            [=]() { sendGet(url, params, supersedeKey, etag, handler, failed, priority, replayed, attempt); });
+        return 0;
+    }
+
+    // only the latest request of a kind is of interest: drop the previous one before its reply arrives
+    cancelSuperseded(supersedeKey);
+
+    // the endpoint is down: whatever is shown stays until it is back
+    QString endpoint = endpointName(url + params);
+    if (!m_breakers.allow(endpoint)) {
+        if (failed) {
+            failed(0);
+        }
+        return 0;
+    }
+
+    QNetworkRequest request;
+
+    // set headers
+    request.setRawHeader("Content-Type", "application/json");
+    request.setRawHeader("Authorization", "Bearer " + token.toLocal8Bit());
+    if (!etag.isEmpty()) {
+        request.setRawHeader("If-None-Match", etag);
+    }
+
+    // set the URL
+    // url = "/v1/me/player"
+    // params = "?q=stringquery&limit=20"
+    request.setUrl(QUrl(m_apiURL + url + params));
+    request.setAttribute(HttpClient::EndpointAttribute, endpoint);
+    request.setPriority(priority);
+
+    // taken when the request is sent: a retry must not outlive a newer request of the same kind or cancelRetries()
+    int generation = m_supersedeGenerations.value(supersedeKey);
+    int epoch = m_epoch;
+
+    // send the get request
+    HttpClient::ReplyHandler onReply = [=](QNetworkReply* reply, const QByteArray& body) {
+        // a coalesced reply is delivered to every caller
+        if (!supersedeKey.isEmpty()) {
+            m_latestRequests.remove(supersedeKey);
+        }
+
+        // still running at cancelRetries(), e.g. a poll at standby: nothing follows from it
+        if (epoch != m_epoch) {
+            return;
+        }
+
+        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (statusCode == 401 && !replayed) {
+            // all requests failing with the same token share one refresh
+            m_tokens->rejected(token);
+            m_telemetry->recordRetry(endpoint);
+            m_tokens->whenValid(
+                [=]() { sendGet(url, params, supersedeKey, etag, handler, failed, priority, true, attempt); });
+            return;
+        }
+
+        if (reply->error()) {
+            qCWarning(m_logCategory) << reply->errorString();
+        }
+        requestFinished(endpoint, reply);
+
+        // a GET can always be sent again, unless a newer request of the same kind replaced it in the meantime
+        int delay = m_retry.delay(reply, attempt);
+        if (delay >= 0) {
+            retryLater(endpoint, delay, [=]() {
+                if (m_epoch == epoch && m_supersedeGenerations.value(supersedeKey) == generation) {
+                    sendGet(url, params, supersedeKey, etag, handler, failed, priority, replayed, attempt + 1);
+                }
+            });
+            return;
+        }
+
+        // error replies carry an error object instead of the requested one, network errors have no status at all
+        if (statusCode == 0 || statusCode >= 400) {
+            if (failed) {
+                failed(statusCode);
+            }
+            return;
+        }
+
+        // the body is handed over as is, the handlers decode only what they need
+        if (handler) {
+            QElapsedTimer handling;
+            handling.start();
+            handler(statusCode, body, reply->rawHeader("ETag"));
+            m_stats.handlerNs += handling.nsecsElapsed();
+        }
+    };
+    quint64 id = m_http->send(HttpClient::GET, request, QByteArray(), onReply);
+
+    if (!supersedeKey.isEmpty()) {
+        m_latestRequests.insert(supersedeKey, id);
+    }
+    return id;
+}
+
+void WebApi::cancelSuperseded(const QString& supersedeKey) {
+    if (supersedeKey.isEmpty()) {
+        return;
+    }
+    // a retry waiting for its delay is superseded as well
+    m_supersedeGenerations[supersedeKey]++;
+    if (m_latestRequests.contains(supersedeKey)) {
+        m_http->cancel(m_latestRequests.take(supersedeKey));
+    }
+}
+
+void WebApi::requestFinished(const QString& endpoint, QNetworkReply* reply) {
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode == 429) {
+        int retryAfter = reply->rawHeader("Retry-After").toInt();
+        qCWarning(m_logCategory) << "Rate limited, retry after" << retryAfter << "seconds";
+        emit rateLimited(retryAfter);
+    }
+
+    if (RetryPolicy::isFailure(reply)) {
+        if (m_breakers.failed(endpoint)) {
+            qCWarning(m_logCategory) << "Endpoint failing, paused:" << endpoint;
+        }
+        return;
+    }
+    m_breakers.succeeded(endpoint);
+
+    // the API is reachable again
+    if (!m_offlineCommands.isEmpty()) {
+        replayOffline();
+    }
+}
+
+void WebApi::retryLater(const QString& endpoint, int delay, const std::function<void()>& retry) {
+    m_stats.retries++;
+    m_telemetry->recordRetry(endpoint);
+    QTimer::singleShot(delay, this, retry);
+}
+
+void WebApi::cancelRetries() {
+    // requests and retries only go on if the epoch did not change since they were sent
+    m_epoch++;
+}
+
+QString WebApi::endpointName(const QString& path) {
+    static const QRegularExpression ID("^[0-9A-Za-z]{22}$");
+
+    // empty segments are skipped by hand: the split behaviour enum moved namespaces in Qt 5.14
+    QStringList segments;
+    for (const QString& segment : path.section('?', 0, 0).split('/')) {
+        if (!segment.isEmpty()) {
+            segments.append(ID.match(segment).hasMatch() ? QStringLiteral("{id}") : segment);
+        }
+    }
+    return "/" + segments.join('/');
+}
+
+QString WebApi::commandEndpoint(HttpClient::Operation operation, const QString& url, const QString& params) {
+    // the params of a PUT are its JSON body, not part of the path
+    return endpointName(operation == HttpClient::POST ? url + params : url);
+}
+
+void WebApi::post(const QString& url, const QString& params, const StatusHandler& handler,
+                  const QString& collapseKey) {
+    sendCommand(HttpClient::POST, url, params, handler, collapseKey, 0, false);
+}
+
+void WebApi::put(const QString& url, const QString& params, const StatusHandler& handler, const QString& collapseKey) {
+    sendCommand(HttpClient::PUT, url, params, handler, collapseKey, 0, false);
+}
+
+void WebApi::sendCommand(HttpClient::Operation operation, const QString& url, const QString& params,
+                         const StatusHandler& handler, const QString& collapseKey, int attempt, bool replayed) {
+    QString token = m_tokens->accessToken();
+    if (token.isEmpty()) {
+        m_tokens->whenValid([=]() { sendCommand(operation, url, params, handler, collapseKey, attempt, replayed); });
+        return;
+    }
+
+    // a retry of an older command must not overwrite a newer one of the same kind
+    if (attempt == 0 && !collapseKey.isEmpty()) {
+        m_commandGenerations[collapseKey]++;
+    }
+    int generation = m_commandGenerations.value(collapseKey);
+    int epoch = m_epoch;
+
+    // the endpoint is down: sent once it is back, if that does not take too long
+    QString endpoint = commandEndpoint(operation, url, params);
+    if (!m_breakers.allow(endpoint)) {
+        queueOffline(operation, url, params, handler, collapseKey);
+        return;
+    }
+
+    QNetworkRequest request;
+
+    // set headers
+    request.setRawHeader("Content-Type", "application/json");
+    request.setRawHeader("Authorization", "Bearer " + token.toLocal8Bit());
+
+    // set the URL
+    // url = "/v1/me/player"
+    // params = "?q=stringquery&limit=20" for POST, the JSON body for PUT
+    QByteArray body;
+    if (operation == HttpClient::POST) {
+        request.setUrl(QUrl(m_apiURL + url + params));
+    } else {
+        request.setUrl(QUrl(m_apiURL + url));
+        body = params.toUtf8();
+    }
+    request.setAttribute(HttpClient::EndpointAttribute, endpoint);
+
+    // send the post or put request
+    HttpClient::ReplyHandler onReply = [=](QNetworkReply* reply, const QByteArray& replyBody) {
+        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+        // still running at cancelRetries(): neither replayed, retried nor kept for later
+        if (epoch != m_epoch) {
+            if (handler) {
+                handler(statusCode);
+            }
+            return;
+        }
+
+        if (statusCode == 401 && !replayed) {
+            m_tokens->rejected(token);
+            m_telemetry->recordRetry(endpoint);
+            m_tokens->whenValid([=]() { sendCommand(operation, url, params, handler, collapseKey, attempt, true); });
+            return;
+        }
+        requestFinished(endpoint, reply);
+
+        // a PUT sets a state and can be sent again, a POST only if it never reached the server
+        bool repeatable = operation == HttpClient::PUT || RetryPolicy::notSent(reply);
+        int  delay = repeatable ? m_retry.delay(reply, attempt) : -1;
+        if (delay >= 0) {
+            retryLater(endpoint, delay, [=]() {
+                if (m_epoch == epoch && m_commandGenerations.value(collapseKey) == generation) {
+                    sendCommand(operation, url, params, handler, collapseKey, attempt + 1, replayed);
+                } else if (handler) {
+                    handler(0);
+                }
+            });
+            return;
+        }
+
+        // still no connection: kept until it is back
+        if (repeatable && statusCode == 0 && RetryPolicy::isFailure(reply)) {
+            queueOffline(operation, url, params, handler, collapseKey);
+            return;
+        }
+
+        if (statusCode != 204) {
+            qCWarning(m_logCategory) << "ERROR WITH" << (operation == HttpClient::POST ? "POST" : "PUT") << "REQUEST"
+                                     << statusCode << replyBody;
+        }
+        if (handler) {
+            handler(statusCode);
+        }
+    };
+    m_http->send(operation, request, body, onReply, collapseKey);
+}
+
+void WebApi::queueOffline(HttpClient::Operation operation, const QString& url, const QString& params,
+                          const StatusHandler& handler, const QString& collapseKey) {
+    // a newer value replaces the waiting one of the same kind
+    QList<OfflineCommand> dropped;
+    for (int i = m_offlineCommands.size() - 1; i >= 0 && !collapseKey.isEmpty(); i--) {
+        if (m_offlineCommands.at(i).collapseKey == collapseKey) {
+            dropped.append(m_offlineCommands.takeAt(i));
+        }
+    }
+    if (m_offlineCommands.size() >= OFFLINE_COMMANDS) {
+        dropped.append(m_offlineCommands.takeFirst());
+        m_stats.offlineDropped++;
+    }
+
+    OfflineCommand command;
+    command.operation = operation;
+    command.url = url;
+    command.params = params;
+    command.handler = handler;
+    command.collapseKey = collapseKey;
+    command.queued.start();
+    m_offlineCommands.append(command);
+
+    // after the queue is consistent again: a handler may send the next command right away
+    for (const OfflineCommand& drop : dropped) {
+        if (drop.handler) {
+            drop.handler(0);
+        }
+    }
+}
+
+void WebApi::replayOffline() {
+    QList<OfflineCommand> commands;
+    commands.swap(m_offlineCommands);
+
+    for (const OfflineCommand& command : commands) {
+        // a pause pressed a minute ago is not expected to take effect now
+        if (command.queued.elapsed() > OFFLINE_COMMAND_MAX_AGE) {
+            m_stats.offlineDropped++;
+            if (command.handler) {
+                command.handler(0);
+            }
+            continue;
+        }
+        // its endpoint is still down
+        if (m_breakers.retryIn(commandEndpoint(command.operation, command.url, command.params)) > 0) {
+            m_offlineCommands.append(command);
+            continue;
+        }
+        m_stats.offlineReplayed++;
+        sendCommand(command.operation, command.url, command.params, command.handler, command.collapseKey, 0, false);
+    }
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QLoggingCategory>
+
+#include <functional>
+
+#include "circuitbreaker.h"
+#include "httpclient.h"
+#include "retrypolicy.h"
+#include "telemetry.h"
+#include "tokenmanager.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// WEB API
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Spotify Web API requests of one integration instance, on top of the shared HTTP client and the token manager.
+/// - without a valid token, requests wait for the refresh; a request rejected with 401 is replayed once
+/// - a request with a supersede key cancels the previous, still running request with the same key
+/// - failed GETs and PUTs are retried with a jittered backoff, POSTs only if they never reached the server
+/// - an endpoint failing again and again is not called until its circuit breaker lets a probe through
+/// - commands which could not be sent are kept until the API is reachable again, but not for long
+class WebApi : public QObject {
+    Q_OBJECT
+
+ public:
+    // Called for every successful reply: 200, 204 (no content) and 304 (not modified, empty body), together with the
+    // ETag of the reply
+    typedef std::function<void(int statusCode, const QByteArray& body, const QByteArray& etag)> ReplyHandler;
+
+    // status code of a command, 0 if it was dropped or never reached the server
+    typedef std::function<void(int statusCode)> StatusHandler;
+
+    struct Stats {
+        quint64 retries = 0;
+        quint64 offlineReplayed = 0;
+        quint64 offlineDropped = 0;
+        qint64  handlerNs = 0;  // time spent in reply handlers
+    };
+
+    // logs to the category of the integration
+    WebApi(HttpClient* http, TokenManager* tokens, Telemetry* telemetry, const QString& apiUrl,
+           const RetryPolicy& retry, const CircuitBreaker& breakers, const QLoggingCategory& logCategory,
+           QObject* parent = nullptr);
+
+    // Sends a GET to the API URL + url + params, with If-None-Match if the ETag is not empty. Low priority requests
+    // wait until no other request is waiting. Returns the id of the request, 0 if it was not sent (yet).
+    // Failed is called with the status code once the request failed for good: no retry left, or 0 if it never reached
+    // the server or its circuit breaker is open. Neither handler is called for a superseded or cancelled request.
+    quint64 get(const QString& url, const QString& params, const QString& supersedeKey, const QByteArray& etag,
+                const ReplyHandler& handler, const StatusHandler& failed = nullptr,
+                QNetworkRequest::Priority priority = QNetworkRequest::NormalPriority);
+
+    // Drops the running request and the waiting retry with the supersede key, their handlers are not called
+    void cancelSuperseded(const QString& supersedeKey);
+
+    // Requests with the same collapse key are sent one at a time, a waiting one is replaced by the newer one.
+    // Params are the query of a POST and the JSON body of a PUT.
+    void post(const QString& url, const QString& params, const StatusHandler& handler = nullptr,
+              const QString& collapseKey = QString());
+    void put(const QString& url, const QString& params, const StatusHandler& handler = nullptr,
+             const QString& collapseKey = QString());
+
+    // Sends the commands waiting for the connection, drops those which waited too long
+    void replayOffline();
+
+    // Drops the waiting retries, e.g. before standby. Requests still running are not retried or replayed either, the
+    // handlers of their GETs are not called.
+    void cancelRetries();
+
+    // ms until the circuit breaker of the endpoint lets the next request through, 0 if it is closed
+    int retryIn(const QString& url) const { return m_breakers.retryIn(endpointName(url)); }
+
+    const CircuitBreaker& breakers() const { return m_breakers; }
+    Stats                 stats() const { return m_stats; }
+
+    // path of the request with Spotify IDs replaced by {id}, e.g. /v1/playlists/{id}/tracks: telemetry and circuit
+    // breakers are kept per endpoint, not per album or playlist
+    static QString endpointName(const QString& path);
+
+    // endpoint of a POST or PUT, whose params are the query or the JSON body
+    static QString commandEndpoint(HttpClient::Operation operation, const QString& url, const QString& params);
+
+ signals:
+    // the API answered with 429
+    void rateLimited(int retryAfterSeconds);
+
+ private:
+    quint64 sendGet(const QString& url, const QString& params, const QString& supersedeKey, const QByteArray& etag,
+                    const ReplyHandler& handler, const StatusHandler& failed, QNetworkRequest::Priority priority,
+                    bool replayed, int attempt);
+    void    sendCommand(HttpClient::Operation operation, const QString& url, const QString& params,
+                        const StatusHandler& handler, const QString& collapseKey, int attempt, bool replayed);
+
+    // rate limits, circuit breaker bookkeeping and replay of the offline commands for every reply
+    void requestFinished(const QString& endpoint, QNetworkReply* reply);
+    void retryLater(const QString& endpoint, int delay, const std::function<void()>& retry);
+
+    // Commands which could not be sent, replayed with the next successful reply or dropped when too old
+    struct OfflineCommand {
+        HttpClient::Operation operation;
+        QString               url;
+        QString               params;
+        StatusHandler         handler;
+        QString               collapseKey;
+        QElapsedTimer         queued;
+    };
+    void queueOffline(HttpClient::Operation operation, const QString& url, const QString& params,
+                      const StatusHandler& handler, const QString& collapseKey);
+
+ private:
+    static const int OFFLINE_COMMANDS = 8;
+    static const int OFFLINE_COMMAND_MAX_AGE = 15000;
+
+    HttpClient*             m_http;
+    TokenManager*           m_tokens;
+    Telemetry*              m_telemetry;
+    QString                 m_apiURL;
+    RetryPolicy             m_retry;
+    CircuitBreaker          m_breakers;
+    const QLoggingCategory& m_logCategory;
+
+    // id of the latest running request per supersede key
+    QHash<QString, quint64> m_latestRequests;
+
+    // the generations tell a retry whether a newer request of the same supersede or collapse key was made in the
+    // meantime
+    QHash<QString, int>   m_supersedeGenerations;
+    QHash<QString, int>   m_commandGenerations;
+    int                   m_epoch = 0;  // changed by cancelRetries()
+    QList<OfflineCommand> m_offlineCommands;
+    Stats                 m_stats;
+};
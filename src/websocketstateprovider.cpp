@@ -0,0 +1,135 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "websocketstateprovider.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrlQuery>
+
+WebSocketStateProvider::WebSocketStateProvider(const QUrl& url, const TokenSource& token, QObject* parent)
+    : PlayerStateProvider(parent),
+      m_url(url),
+      m_token(token),
+      m_socket(new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this)),
+      m_pingTimer(new QTimer(this)),
+      m_reconnectTimer(new QTimer(this)) {
+    m_pingTimer->setInterval(PING_INTERVAL);
+    m_reconnectTimer->setSingleShot(true);
+
+    QObject::connect(m_socket, &QWebSocket::connected, this, &WebSocketStateProvider::onConnected);
+    QObject::connect(m_socket, &QWebSocket::disconnected, this, &WebSocketStateProvider::lost);
+    QObject::connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this,
+                     [=](QAbstractSocket::SocketError) { lost(); });
+    QObject::connect(m_socket, &QWebSocket::textMessageReceived, this, &WebSocketStateProvider::onTextMessageReceived);
+    QObject::connect(m_pingTimer, &QTimer::timeout, this, &WebSocketStateProvider::onPing);
+    QObject::connect(m_reconnectTimer, &QTimer::timeout, this, &WebSocketStateProvider::open);
+}
+
+void WebSocketStateProvider::start() {
+    m_active = true;
+    m_reconnectDelay = RECONNECT_BASE_DELAY;
+    open();
+}
+
+void WebSocketStateProvider::stop() {
+    m_active = false;
+    m_reconnectTimer->stop();
+    m_pingTimer->stop();
+    m_socket->close();
+    m_connected = false;
+}
+
+void WebSocketStateProvider::open() {
+    if (!m_active) {
+        return;
+    }
+
+    QUrl    url = m_url;
+    QString token = m_token ? m_token() : QString();
+    if (!token.isEmpty()) {
+        QUrlQuery query(url);
+        query.removeAllQueryItems("access_token");
+        query.addQueryItem("access_token", token);
+        url.setQuery(query);
+    }
+    m_socket->open(url);
+}
+
+void WebSocketStateProvider::lost() {
+    m_pingTimer->stop();
+    bool connected = m_connected;
+    m_connected = false;
+
+    // error() and disconnected() can both report the same loss
+    if (!m_active || m_reconnectTimer->isActive()) {
+        return;
+    }
+    if (connected) {
+        emit connectedChanged(false);
+    }
+
+    m_reconnects++;
+    m_reconnectTimer->start(m_reconnectDelay);
+    m_reconnectDelay *= 2;
+    if (m_reconnectDelay > RECONNECT_MAX_DELAY) {
+        m_reconnectDelay = RECONNECT_MAX_DELAY;
+    }
+}
+
+void WebSocketStateProvider::onConnected() {
+    m_connected = true;
+    m_pongPending = false;
+    m_reconnectDelay = RECONNECT_BASE_DELAY;
+    m_pingTimer->start();
+    emit connectedChanged(true);
+}
+
+void WebSocketStateProvider::onPing() {
+    // the last ping is still unanswered: the connection is dead without the socket noticing
+    if (m_pongPending) {
+        m_socket->abort();
+        lost();
+        return;
+    }
+    m_pongPending = true;
+    m_socket->sendTextMessage("{\"type\":\"ping\"}");
+}
+
+void WebSocketStateProvider::onTextMessageReceived(const QString& message) {
+    m_messages++;
+    m_pongPending = false;
+
+    QJsonObject object = QJsonDocument::fromJson(message.toUtf8()).object();
+    QString     type = object.value("type").toString();
+    if (type == "ping") {
+        m_socket->sendTextMessage("{\"type\":\"pong\"}");
+    } else if (type == "message") {
+        if (!object.contains("state")) {
+            emit fetchRequested();
+        } else if (object.value("state").isObject()) {
+            emit stateReceived(QJsonDocument(object.value("state").toObject()).toJson(QJsonDocument::Compact));
+        } else {
+            emit stateReceived(QByteArray());
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QTimer>
+#include <QUrl>
+#include <QWebSocket>
+
+#include <functional>
+
+#include "playerstateprovider.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// WEBSOCKET STATE PROVIDER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Push provider on a long-lived WebSocket, in the style of the dealer connection of Spotify Connect clients. It works
+/// just as well with a local stand-in server. Every message is a JSON object:
+/// - {"type": "ping"} and {"type": "pong"}: keep-alive, a ping is sent every PING_INTERVAL and must be answered
+/// - {"type": "message", "state": {...}}: the player state in the format of /v1/me/player, null if nothing is playing
+/// - any other "message": something changed, the state is fetched once
+/// The access token is sent as access_token query parameter. A lost connection is reopened with an exponential
+/// backoff; connectedChanged(false) is not emitted after stop().
+class WebSocketStateProvider : public PlayerStateProvider {
+    Q_OBJECT
+
+ public:
+    typedef std::function<QString()> TokenSource;
+
+    WebSocketStateProvider(const QUrl& url, const TokenSource& token, QObject* parent = nullptr);
+
+    void start() override;
+    void stop() override;
+    bool isActive() const override { return m_active; }
+
+    bool    isConnected() const { return m_connected; }
+    quint64 messages() const { return m_messages; }
+    quint64 reconnects() const { return m_reconnects; }
+
+ private slots:
+    void onConnected();
+    void onTextMessageReceived(const QString& message);
+    void onPing();
+
+ private:
+    void open();
+    void lost();
+
+ private:
+    static const int PING_INTERVAL = 30000;
+    static const int RECONNECT_BASE_DELAY = 1000;
+    static const int RECONNECT_MAX_DELAY = 60000;
+
+    QUrl        m_url;
+    TokenSource m_token;
+    QWebSocket* m_socket;
+    QTimer*     m_pingTimer;
+    QTimer*     m_reconnectTimer;
+    bool        m_active = false;
+    bool        m_connected = false;
+    bool        m_pongPending = false;
+    int         m_reconnectDelay = RECONNECT_BASE_DELAY;
+    quint64     m_messages = 0;
+    quint64     m_reconnects = 0;
+};
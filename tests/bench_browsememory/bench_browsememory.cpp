@@ -0,0 +1,185 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include <cstdlib>
+#include <functional>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "httpclient.h"
+#include "spotifystandin.h"
+#include "spotifytypes.h"
+#include "stringpool.h"
+
+// Peak and steady-state heap of the browse items of a 2,000-track playlist, built from the pages served by the
+// stand-in. "copies" builds every item with its own strings and command list, "interned" shares the item type and
+// command list and interns the artist names, as the integration does.
+
+// the BrowseItem of the integration, which cannot be built without the integrations.library
+struct BrowseItem {
+    QString     id;
+    QString     title;
+    QString     subtitle;
+    QString     type;
+    QString     image;
+    QStringList commands;
+};
+
+static const QString     TYPE_TRACK = QStringLiteral("track");
+static const QStringList TRACK_COMMANDS = {"PLAY", "SONGRADIO", "QUEUE"};
+
+static const int PLAYLIST_TRACKS = 2000;
+static const int PAGE_SIZE = 100;
+
+// bytes in use on the heap, -1 if unknown
+static qint64 heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return static_cast<qint64>(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    return static_cast<qint64>(info.uordblks) + info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+class BenchBrowseMemory : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void initTestCase();
+
+    void build_data();
+    void build();
+    void compare();
+
+ private:
+    struct Result {
+        qint64 peak = 0;
+        qint64 steady = 0;
+    };
+
+    QList<QByteArray>      m_pages;
+    QHash<QString, Result> m_results;
+};
+
+void BenchBrowseMemory::initTestCase() {
+    if (heapInUse() < 0) {
+        QSKIP("Heap statistics are only available with glibc");
+    }
+
+    SpotifyStandIn standIn;
+    HttpClient     http;
+    bool           done = false;
+    standIn.setPlaylistSize(PLAYLIST_TRACKS);
+    QVERIFY(standIn.listen());
+
+    // page by page, following the next links
+    std::function<void(const QString&)> fetch = [&](const QString& url) {
+        QNetworkRequest request;
+        request.setUrl(QUrl(url));
+        http.send(HttpClient::GET, request, QByteArray(), [&](QNetworkReply*, const QByteArray& body) {
+            SpotifyTrackPage page;
+            if (!SpotifyDecoder::decodePlaylistTrackPage(body, &page)) {
+                done = true;
+                return;
+            }
+            m_pages.append(body);
+            if (page.next.isEmpty()) {
+                done = true;
+            } else {
+                fetch(page.next);
+            }
+        });
+    };
+    fetch(QString("%1playlists/%2/tracks?offset=0&limit=%3")
+              .arg(standIn.apiUrl(), SpotifyStandIn::id("playlist", 1))
+              .arg(PAGE_SIZE));
+    QTRY_VERIFY_WITH_TIMEOUT(done, 30000);
+    QCOMPARE(m_pages.size(), PLAYLIST_TRACKS / PAGE_SIZE);
+}
+
+void BenchBrowseMemory::build_data() {
+    QTest::addColumn<bool>("interned");
+
+    QTest::newRow("copies") << false;
+    QTest::newRow("interned") << true;
+}
+
+void BenchBrowseMemory::build() {
+    QFETCH(bool, interned);
+
+    QVector<BrowseItem> items;
+    qint64              baseline = heapInUse();
+    Result              result;
+    {
+        // one pool for all pages of the playlist
+        QScopedPointer<StringPool> strings(new StringPool());
+        for (const QByteArray& body : m_pages) {
+            SpotifyTrackPage page;
+            QVERIFY(SpotifyDecoder::decodePlaylistTrackPage(body, &page));
+            for (const SpotifyTrack& track : page.items) {
+                if (interned) {
+                    items.append({track.id, track.name, strings->intern(track.artist), TYPE_TRACK, "", TRACK_COMMANDS});
+                } else {
+                    items.append({track.id, track.name, track.artist, QString("track"), QString(""),
+                                  QStringList() << "PLAY" << "SONGRADIO" << "QUEUE"});
+                }
+            }
+
+            // the decoded page is still alive, like while the page decoder of the integration runs
+            result.peak = qMax(result.peak, heapInUse() - baseline);
+        }
+    }
+    result.steady = heapInUse() - baseline;
+    QCOMPARE(items.size(), PLAYLIST_TRACKS);
+
+    QString tag = QString::fromLatin1(QTest::currentDataTag());
+    m_results.insert(tag, result);
+    qInfo().noquote() << QString("%1: %2 items, peak %3 KiB, steady %4 KiB (%5 bytes per item)")
+                             .arg(tag)
+                             .arg(items.size())
+                             .arg(result.peak / 1024)
+                             .arg(result.steady / 1024)
+                             .arg(result.steady / items.size());
+    QTest::setBenchmarkResult(result.steady, QTest::BytesAllocated);
+}
+
+void BenchBrowseMemory::compare() {
+    if (!m_results.contains("copies") || !m_results.contains("interned")) {
+        QSKIP("Needs the results of both builds");
+    }
+    Result copies = m_results.value("copies");
+    Result interned = m_results.value("interned");
+
+    // types, command lists and artists cost far more than 100 bytes per item when copied
+    QVERIFY(interned.steady < copies.steady);
+    QVERIFY(copies.steady - interned.steady > PLAYLIST_TRACKS * 100);
+    QVERIFY(interned.peak < copies.peak);
+}
+
+QTEST_GUILESS_MAIN(BenchBrowseMemory)
+#include "bench_browsememory.moc"
@@ -0,0 +1,206 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include <ctime>
+#include <functional>
+
+#include "httpclient.h"
+#include "spotifystandin.h"
+#include "spotifytypes.h"
+#include "telemetry.h"
+
+// Requests per second, per-endpoint latency percentiles and CPU time per request against the stand-in. The stand-in
+// runs in the same process: the CPU time includes serving the requests.
+
+class BenchPolling : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void initTestCase();
+
+    void playerPolls_data();
+    void playerPolls();
+    void browseBurst();
+
+ private:
+    static void report(const Telemetry& telemetry);
+
+ private:
+    SpotifyStandIn* m_standIn = nullptr;
+};
+
+static double cpuMs(std::clock_t start) {
+    return 1000.0 * static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+void BenchPolling::initTestCase() {
+    m_standIn = new SpotifyStandIn(this);
+    QVERIFY(m_standIn->listen());
+}
+
+void BenchPolling::report(const Telemetry& telemetry) {
+    for (auto iter = telemetry.endpoints().constBegin(); iter != telemetry.endpoints().constEnd(); ++iter) {
+        qInfo().noquote() << QString("  %1 total: %2").arg(iter.key(), iter->total.toString());
+        qInfo().noquote() << QString("  %1 first byte: %2").arg(iter.key(), iter->firstByte.toString());
+    }
+}
+
+void BenchPolling::playerPolls_data() {
+    QTest::addColumn<int>("polls");
+    QTest::addColumn<int>("delay");
+    QTest::addColumn<int>("failures");
+
+    QTest::newRow("fast") << 500 << 0 << 0;
+    QTest::newRow("slow") << 40 << 50 << 0;
+    QTest::newRow("erroring") << 500 << 0 << 100;
+}
+
+void BenchPolling::playerPolls() {
+    QFETCH(int, polls);
+    QFETCH(int, delay);
+    QFETCH(int, failures);
+
+    m_standIn->setPlayerState(SpotifyStandIn::playerState(true, 60000, 180000));
+    m_standIn->setDelay("/v1/me/player", delay);
+    m_standIn->failNext("/v1/me/player", 503, failures);
+
+    Telemetry  telemetry;
+    HttpClient http;
+    telemetry.setEnabled(true);
+    http.setTelemetry(&telemetry);
+
+    // one poll at a time, the body is only decoded when it changed
+    QNetworkRequest request;
+    request.setUrl(QUrl(m_standIn->apiUrl() + "me/player"));
+    int                   done = 0;
+    int                   decoded = 0;
+    QByteArray            last;
+    qint64                wallMs = 0;
+    double                cpu = 0;
+    QElapsedTimer         wall;
+    std::clock_t          start = 0;
+    std::function<void()> poll = [&]() {
+        http.send(HttpClient::GET, request, QByteArray(), [&](QNetworkReply* reply, const QByteArray& body) {
+            if (reply->error() == QNetworkReply::NoError && body != last) {
+                SpotifyPlayerState state;
+                if (SpotifyDecoder::decodePlayerState(body, &state)) {
+                    decoded++;
+                }
+                last = body;
+            }
+            if (++done < polls) {
+                poll();
+            } else {
+                wallMs = wall.elapsed();
+                cpu = cpuMs(start);
+            }
+        });
+    };
+
+    QBENCHMARK_ONCE {
+        wall.start();
+        start = std::clock();
+        poll();
+        QTRY_COMPARE_WITH_TIMEOUT(done, polls, 60000);
+    }
+
+    qInfo().noquote() << QString("%1 polls in %2 ms: %3 requests/s, %4 ms CPU per poll, %5 decoded")
+                             .arg(polls)
+                             .arg(wallMs)
+                             .arg(wallMs > 0 ? 1000.0 * polls / wallMs : 0.0, 0, 'f', 1)
+                             .arg(cpu / polls, 0, 'f', 3)
+                             .arg(decoded);
+    report(telemetry);
+
+    const Telemetry::Endpoint endpoint = telemetry.endpoints().value("/v1/me/player");
+    QCOMPARE(endpoint.requests, static_cast<quint64>(polls));
+    QCOMPARE(endpoint.statusCodes.value(503), static_cast<quint64>(failures));
+    QCOMPARE(decoded, 1);
+
+    m_standIn->setDelay("/v1/me/player", 0);
+}
+
+void BenchPolling::browseBurst() {
+    const int requests = 200;
+
+    Telemetry  telemetry;
+    HttpClient http;
+    telemetry.setEnabled(true);
+    http.setTelemetry(&telemetry);
+
+    // distinct URLs, nothing is coalesced; every body is decoded like in the integration
+    int  done = 0;
+    int  invalid = 0;
+    auto send = [&](const QString& path, const char* endpoint, const std::function<bool(const QByteArray&)>& decode) {
+        QNetworkRequest request;
+        request.setUrl(QUrl(m_standIn->apiUrl() + path));
+        request.setAttribute(HttpClient::EndpointAttribute, QString(endpoint));
+        http.send(HttpClient::GET, request, QByteArray(), [&, decode](QNetworkReply*, const QByteArray& body) {
+            if (!decode(body)) {
+                invalid++;
+            }
+            done++;
+        });
+    };
+
+    QElapsedTimer wall;
+    wall.start();
+    std::clock_t start = std::clock();
+    for (int i = 0; i < requests / 4; i++) {
+        send(QString("search?q=mix%1&type=album,artist,playlist,track&limit=20").arg(i), "/v1/search",
+             [](const QByteArray& body) {
+                 SpotifySearchResult result;
+                 return SpotifyDecoder::decodeSearchResult(body, &result);
+             });
+        send("albums/" + SpotifyStandIn::id("album", i), "/v1/albums/{id}", [](const QByteArray& body) {
+            SpotifyAlbum album;
+            return SpotifyDecoder::decodeAlbum(body, &album);
+        });
+        send("playlists/" + SpotifyStandIn::id("playlist", i), "/v1/playlists/{id}", [](const QByteArray& body) {
+            SpotifyPlaylist playlist;
+            return SpotifyDecoder::decodePlaylist(body, &playlist);
+        });
+        send(QString("playlists/%1/tracks?offset=100&limit=100").arg(SpotifyStandIn::id("playlist", i)),
+             "/v1/playlists/{id}/tracks", [](const QByteArray& body) {
+                 SpotifyTrackPage page;
+                 return SpotifyDecoder::decodePlaylistTrackPage(body, &page);
+             });
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(done, requests, 60000);
+    qint64 wallMs = wall.elapsed();
+    double cpu = cpuMs(start);
+
+    qInfo().noquote() << QString("%1 requests in %2 ms: %3 requests/s, %4 ms CPU per request")
+                             .arg(requests)
+                             .arg(wallMs)
+                             .arg(wallMs > 0 ? 1000.0 * requests / wallMs : 0.0, 0, 'f', 1)
+                             .arg(cpu / requests, 0, 'f', 3);
+    report(telemetry);
+
+    QCOMPARE(invalid, 0);
+    QCOMPARE(http.stats().requests, static_cast<quint64>(requests));
+}
+
+QTEST_GUILESS_MAIN(BenchPolling)
+#include "bench_polling.moc"
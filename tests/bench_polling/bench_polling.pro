@@ -0,0 +1,14 @@
+include(../tests.pri)
+include(../standin/standin.pri)
+
+TARGET = bench_polling
+
+HEADERS += $$SRC_PATH/httpclient.h \
+           $$SRC_PATH/latencyhistogram.h \
+           $$SRC_PATH/spotifytypes.h \
+           $$SRC_PATH/telemetry.h
+SOURCES += $$SRC_PATH/httpclient.cpp \
+           $$SRC_PATH/latencyhistogram.cpp \
+           $$SRC_PATH/spotifytypes.cpp \
+           $$SRC_PATH/telemetry.cpp \
+           bench_polling.cpp
@@ -0,0 +1,518 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "spotifystandin.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMetaObject>
+#include <QTcpSocket>
+#include <QTimer>
+
+// artists repeat throughout the fixtures, like in a real library
+static const int ARTISTS = 40;
+static const int ALBUM_TRACKS = 10;
+static const int PLAYLIST_PAGE_SIZE = 100;
+static const int SEARCH_TOTAL = 1000;
+
+static QByteArray reasonPhrase(int statusCode) {
+    switch (statusCode) {
+        case 200:
+            return "OK";
+        case 204:
+            return "No Content";
+        case 304:
+            return "Not Modified";
+        case 400:
+            return "Bad Request";
+        case 401:
+            return "Unauthorized";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 429:
+            return "Too Many Requests";
+        case 500:
+            return "Internal Server Error";
+        case 501:
+            return "Not Implemented";
+        case 502:
+            return "Bad Gateway";
+        case 503:
+            return "Service Unavailable";
+        default:
+            return "Unknown";
+    }
+}
+
+static QJsonArray images(const QString& id) {
+    QJsonArray array;
+    for (int size : {640, 300, 64}) {
+        QJsonObject image;
+        image.insert("url", QString("https://i.scdn.co/image/ab67616d%1%2").arg(size, 8, 10, QChar('0')).arg(id));
+        image.insert("width", size);
+        image.insert("height", size);
+        array.append(image);
+    }
+    return array;
+}
+
+static QJsonObject artist(int number) {
+    QString     artistId = SpotifyStandIn::id("artist", number % ARTISTS);
+    QJsonObject object;
+    object.insert("id", artistId);
+    object.insert("name", QString("Artist %1").arg(number % ARTISTS));
+    object.insert("uri", "spotify:artist:" + artistId);
+    return object;
+}
+
+static QJsonObject simplifiedAlbum(int number) {
+    QString     albumId = SpotifyStandIn::id("album", number);
+    QJsonObject object;
+    object.insert("id", albumId);
+    object.insert("name", QString("Album %1").arg(number));
+    object.insert("uri", "spotify:album:" + albumId);
+    object.insert("artists", QJsonArray{artist(number)});
+    object.insert("images", images(albumId));
+    return object;
+}
+
+static QJsonObject category(const QJsonArray& items) {
+    QJsonObject object;
+    object.insert("items", items);
+    object.insert("limit", items.size());
+    object.insert("offset", 0);
+    object.insert("total", SEARCH_TOTAL);
+    return object;
+}
+
+SpotifyStandIn::SpotifyStandIn(QObject* parent)
+    : QObject(parent),
+      m_server(new QTcpServer(this)),
+      m_webSocketServer(new QWebSocketServer("Spotify stand-in", QWebSocketServer::NonSecureMode, this)) {
+    QObject::connect(m_server, &QTcpServer::newConnection, this, &SpotifyStandIn::onNewConnection);
+    QObject::connect(m_webSocketServer, &QWebSocketServer::newConnection, this, &SpotifyStandIn::onNewWebSocket);
+}
+
+bool SpotifyStandIn::listen() {
+    return m_server->listen(QHostAddress::LocalHost);
+}
+
+QString SpotifyStandIn::imageUrl(int number) const {
+    return QString("%1/images/%2.jpg").arg(baseUrl()).arg(number);
+}
+
+QByteArray SpotifyStandIn::image(const QString& name) {
+    // not a real JPEG, the cache does not look into it
+    return "JPEG " + name.toUtf8() + QByteArray(4096, '\0');
+}
+
+QString SpotifyStandIn::baseUrl() const {
+    return QString("http://127.0.0.1:%1").arg(m_server->serverPort());
+}
+
+QString SpotifyStandIn::apiUrl() const {
+    return baseUrl() + "/v1/";
+}
+
+QString SpotifyStandIn::accountsUrl() const {
+    return QString("http://127.0.0.1:%1/api/token").arg(m_server->serverPort());
+}
+
+QUrl SpotifyStandIn::webSocketUrl() const {
+    return QUrl(QString("ws://127.0.0.1:%1/ws").arg(m_server->serverPort()));
+}
+
+QString SpotifyStandIn::unreachableUrl() {
+    // the port was free a moment ago and nobody listens on it anymore
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    quint16 port = server.serverPort();
+    server.close();
+    return QString("http://127.0.0.1:%1/").arg(port);
+}
+
+void SpotifyStandIn::setDelay(const QString& path, int ms) {
+    m_delays.insert(path, ms);
+}
+
+void SpotifyStandIn::failNext(const QString& path, int statusCode, int count, int retryAfter) {
+    Failure failure;
+    failure.statusCode = statusCode;
+    failure.count = count;
+    failure.retryAfter = retryAfter;
+    m_failures.insert(path, failure);
+}
+
+int SpotifyStandIn::count(const QString& path) const {
+    int n = 0;
+    for (const Request& request : m_requests) {
+        if (request.path == path) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void SpotifyStandIn::push(const QByteArray& message) {
+    for (QWebSocket* socket : m_webSockets) {
+        socket->sendTextMessage(QString::fromUtf8(message));
+    }
+}
+
+void SpotifyStandIn::dropWebSockets() {
+    // the list shrinks while the sockets disconnect
+    QList<QWebSocket*> sockets = m_webSockets;
+    for (QWebSocket* socket : sockets) {
+        socket->abort();
+    }
+}
+
+QString SpotifyStandIn::id(const QString& type, int number) {
+    // 22 base62 characters, like the real ones
+    return type.left(2) + QString::number(number).rightJustified(20, '0');
+}
+
+QJsonObject SpotifyStandIn::track(int number, bool withAlbum) {
+    QString     trackId = id("track", number);
+    QJsonObject object;
+    object.insert("id", trackId);
+    object.insert("name", QString("Track %1").arg(number));
+    object.insert("uri", "spotify:track:" + trackId);
+    object.insert("duration_ms", 180000 + number % 120 * 1000);
+    object.insert("artists", QJsonArray{artist(number)});
+    if (withAlbum) {
+        object.insert("album", simplifiedAlbum(number / ALBUM_TRACKS));
+    }
+    return object;
+}
+
+QByteArray SpotifyStandIn::playerState(bool playing, int progressMs, int durationMs) {
+    QJsonObject device;
+    device.insert("id", id("device", 1));
+    device.insert("name", "Stand-in speaker");
+    device.insert("type", "Speaker");
+    device.insert("is_active", true);
+    device.insert("volume_percent", 50);
+
+    QJsonObject item = track(1);
+    item.insert("duration_ms", durationMs);
+
+    QJsonObject state;
+    state.insert("device", device);
+    state.insert("is_playing", playing);
+    state.insert("progress_ms", progressMs);
+    state.insert("shuffle_state", false);
+    state.insert("repeat_state", "off");
+    state.insert("currently_playing_type", "track");
+    state.insert("item", item);
+    return QJsonDocument(state).toJson(QJsonDocument::Compact);
+}
+
+QByteArray SpotifyStandIn::album(const QString& albumId) const {
+    int         number = albumId.mid(2).toInt();
+    QJsonObject object = simplifiedAlbum(number);
+    object.insert("id", albumId);
+
+    // album tracks come without album
+    QJsonArray items;
+    for (int i = 0; i < ALBUM_TRACKS; i++) {
+        items.append(track(number * ALBUM_TRACKS + i, false));
+    }
+    QJsonObject tracks;
+    tracks.insert("items", items);
+    tracks.insert("next", QJsonValue());
+    tracks.insert("total", ALBUM_TRACKS);
+    object.insert("tracks", tracks);
+    return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+QByteArray SpotifyStandIn::playlist(const QString& playlistId) const {
+    QJsonObject owner;
+    owner.insert("display_name", "Stand-in");
+
+    // a mosaic of the first albums, without a size
+    QJsonObject image;
+    image.insert("url", "https://mosaic.scdn.co/640/" + playlistId);
+    image.insert("width", QJsonValue());
+    image.insert("height", QJsonValue());
+
+    QJsonObject object;
+    object.insert("id", playlistId);
+    object.insert("name", "Playlist " + playlistId);
+    object.insert("uri", "spotify:playlist:" + playlistId);
+    object.insert("owner", owner);
+    object.insert("snapshot_id", QString("snapshot-%1").arg(m_playlistSize));
+    object.insert("images", QJsonArray{image});
+    object.insert("tracks", playlistPage(playlistId, 0, PLAYLIST_PAGE_SIZE));
+    return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+QByteArray SpotifyStandIn::playlistTracks(const QString& playlistId, int offset, int limit) const {
+    return QJsonDocument(playlistPage(playlistId, offset, limit)).toJson(QJsonDocument::Compact);
+}
+
+QJsonObject SpotifyStandIn::playlistPage(const QString& playlistId, int offset, int limit) const {
+    int        end = qMin(offset + limit, m_playlistSize);
+    QJsonArray items;
+    for (int i = offset; i < end; i++) {
+        QJsonObject item;
+        item.insert("added_at", "2020-01-01T00:00:00Z");
+        item.insert("track", track(i));
+        items.append(item);
+    }
+
+    QJsonObject page;
+    page.insert("items", items);
+    page.insert("limit", limit);
+    page.insert("offset", offset);
+    page.insert("total", m_playlistSize);
+    if (end < m_playlistSize) {
+        page.insert("next", QString("%1playlists/%2/tracks?offset=%3&limit=%4")
+                                .arg(apiUrl(), playlistId)
+                                .arg(end)
+                                .arg(limit));
+    } else {
+        page.insert("next", QJsonValue());
+    }
+    return page;
+}
+
+QByteArray SpotifyStandIn::search(const QString& query, int limit) const {
+    QJsonArray albums;
+    QJsonArray tracks;
+    QJsonArray artists;
+    QJsonArray playlists;
+    for (int i = 0; i < limit; i++) {
+        albums.append(simplifiedAlbum(i));
+        tracks.append(track(i));
+
+        QJsonObject found = artist(i);
+        found.insert("images", images(found.value("id").toString()));
+        artists.append(found);
+
+        QString     playlistId = id("playlist", i);
+        QJsonObject owner;
+        owner.insert("display_name", "Stand-in");
+        QJsonObject playlist;
+        playlist.insert("id", playlistId);
+        playlist.insert("name", QString("%1 mix %2").arg(query).arg(i));
+        playlist.insert("uri", "spotify:playlist:" + playlistId);
+        playlist.insert("owner", owner);
+        playlist.insert("snapshot_id", QString("snapshot-%1").arg(i));
+        playlist.insert("images", images(playlistId));
+        playlists.append(playlist);
+    }
+
+    QJsonObject object;
+    object.insert("albums", category(albums));
+    object.insert("tracks", category(tracks));
+    object.insert("artists", category(artists));
+    object.insert("playlists", category(playlists));
+    return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+void SpotifyStandIn::onNewConnection() {
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket* socket = m_server->nextPendingConnection();
+        QObject::connect(socket, &QTcpSocket::readyRead, this, [=]() { readRequests(socket); });
+        QObject::connect(socket, &QTcpSocket::disconnected, this, [=]() { socket->deleteLater(); });
+    }
+}
+
+void SpotifyStandIn::onNewWebSocket() {
+    while (m_webSocketServer->hasPendingConnections()) {
+        QWebSocket* socket = m_webSocketServer->nextPendingConnection();
+        m_webSockets.append(socket);
+        m_lastWebSocketUrl = socket->requestUrl();
+
+        QObject::connect(socket, &QWebSocket::textMessageReceived, this, [=](const QString& message) {
+            QString type = QJsonDocument::fromJson(message.toUtf8()).object().value("type").toString();
+            if (type == "ping" && m_answerPings) {
+                socket->sendTextMessage("{\"type\":\"pong\"}");
+            }
+            emit webSocketMessageReceived(message);
+        });
+        QObject::connect(socket, &QWebSocket::disconnected, this, [=]() {
+            m_webSockets.removeOne(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void SpotifyStandIn::readRequests(QTcpSocket* socket) {
+    forever {
+        // only peeked until the request is complete: a WebSocket handshake is left to the WebSocket server
+        QByteArray pending = socket->peek(socket->bytesAvailable());
+        int        headerEnd = pending.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            return;
+        }
+
+        QList<QByteArray> lines = pending.left(headerEnd).split('\n');
+        QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+        if (requestLine.size() < 2) {
+            socket->abort();
+            return;
+        }
+
+        Request request;
+        QUrl    url(QString::fromLatin1(requestLine.at(1)));
+        request.method = requestLine.at(0);
+        request.path = url.path();
+        request.query = QUrlQuery(url);
+        for (const QByteArray& line : lines) {
+            int colon = line.indexOf(':');
+            if (colon > 0) {
+                request.headers.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+            }
+        }
+
+        // an h2c upgrade offered by Qt for cleartext HTTP/2 is ignored: the reply is plain HTTP/1.1
+        if (request.headers.value("upgrade").toLower() == "websocket") {
+            socket->disconnect(this);
+            m_webSocketServer->handleConnection(socket);
+            // the handshake is already waiting and would not be announced again
+            QMetaObject::invokeMethod(socket, "readyRead", Qt::QueuedConnection);
+            return;
+        }
+
+        int length = request.headers.value("content-length").toInt();
+        if (pending.size() < headerEnd + 4 + length) {
+            return;
+        }
+        socket->read(headerEnd + 4);
+        request.body = socket->read(length);
+        handle(socket, request);
+    }
+}
+
+void SpotifyStandIn::handle(QTcpSocket* socket, const Request& request) {
+    m_requests.append(request);
+    emit requestReceived(request.path);
+
+    int               statusCode = 200;
+    QByteArray        body;
+    QList<QByteArray> headers;
+
+    QHash<QString, Failure>::iterator failure = m_failures.find(request.path);
+    if (failure != m_failures.end() && failure->count > 0) {
+        failure->count--;
+        statusCode = failure->statusCode;
+        body = QString("{\"error\":{\"status\":%1,\"message\":\"stand-in failure\"}}").arg(statusCode).toUtf8();
+        if (failure->retryAfter > 0) {
+            headers.append("Retry-After: " + QByteArray::number(failure->retryAfter));
+        }
+    } else {
+        route(request, &statusCode, &body, &headers);
+    }
+
+    int delay = m_delays.value(request.path);
+    if (delay > 0) {
+        QTimer::singleShot(delay, socket, [=]() { reply(socket, statusCode, body, headers); });
+    } else {
+        reply(socket, statusCode, body, headers);
+    }
+}
+
+void SpotifyStandIn::route(const Request& request, int* statusCode, QByteArray* body, QList<QByteArray>* headers) {
+    const QString& path = request.path;
+
+    if (path == "/api/token" && request.method == "POST") {
+        QUrlQuery form(QString::fromUtf8(request.body));
+        if (form.queryItemValue("grant_type") != "refresh_token" || form.queryItemValue("refresh_token").isEmpty()) {
+            *statusCode = 400;
+            *body = "{\"error\":\"invalid_grant\"}";
+            return;
+        }
+        QJsonObject token;
+        token.insert("access_token", QString("token-%1").arg(++m_tokens));
+        token.insert("token_type", "Bearer");
+        token.insert("expires_in", m_tokenLifetime);
+        *body = QJsonDocument(token).toJson(QJsonDocument::Compact);
+        return;
+    }
+
+    // player commands have no reply body
+    if (path.startsWith("/v1/me/player")) {
+        if (request.method != "GET") {
+            *statusCode = 204;
+        } else if (path != "/v1/me/player") {
+            *statusCode = 404;
+        } else if (m_playerState.isEmpty()) {
+            *statusCode = 204;
+        } else {
+            *body = m_playerState;
+        }
+        return;
+    }
+
+    QStringList parts = path.mid(1).split('/');
+    if (request.method != "GET") {
+        *statusCode = 405;
+    } else if (parts.size() == 2 && parts.at(0) == "images") {
+        *body = image(parts.at(1));
+    } else if (path == "/v1/search") {
+        int limit = request.query.queryItemValue("limit").toInt();
+        *body = search(request.query.queryItemValue("q", QUrl::FullyDecoded), limit > 0 ? limit : 20);
+    } else if (parts.size() == 3 && parts.at(1) == "albums") {
+        *body = album(parts.at(2));
+    } else if (parts.size() == 3 && parts.at(1) == "playlists") {
+        // the snapshot id doubles as ETag
+        QByteArray etag = "\"snapshot-" + QByteArray::number(m_playlistSize) + "\"";
+        headers->append("ETag: " + etag);
+        if (request.headers.value("if-none-match") == etag) {
+            *statusCode = 304;
+        } else {
+            *body = playlist(parts.at(2));
+        }
+    } else if (parts.size() == 4 && parts.at(1) == "playlists" && parts.at(3) == "tracks") {
+        int offset = request.query.queryItemValue("offset").toInt();
+        int limit = request.query.queryItemValue("limit").toInt();
+        *body = playlistTracks(parts.at(2), offset, limit > 0 ? limit : PLAYLIST_PAGE_SIZE);
+    } else {
+        *statusCode = 404;
+    }
+
+    if (*statusCode >= 400) {
+        *body = QString("{\"error\":{\"status\":%1,\"message\":\"%2\"}}")
+                    .arg(*statusCode)
+                    .arg(QString::fromLatin1(reasonPhrase(*statusCode)))
+                    .toUtf8();
+    }
+}
+
+void SpotifyStandIn::reply(QTcpSocket* socket, int statusCode, const QByteArray& body,
+                           const QList<QByteArray>& headers) {
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(statusCode) + " " + reasonPhrase(statusCode) + "\r\n";
+    if (!body.isEmpty()) {
+        response += "Content-Type: application/json; charset=utf-8\r\n";
+    }
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    for (const QByteArray& header : headers) {
+        response += header + "\r\n";
+    }
+    response += "\r\n";
+    response += body;
+    socket->write(response);
+}
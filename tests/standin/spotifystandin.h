@@ -0,0 +1,148 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QTcpServer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QWebSocket>
+#include <QWebSocketServer>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// SPOTIFY STAND-IN
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Local stand-in for the Spotify Web API, the accounts service and a player state push WebSocket, all on one port of
+/// the loopback interface. It speaks just enough HTTP/1.1 for QNetworkAccessManager: keep-alive connections and
+/// requests with a Content-Length body.
+///
+/// Served endpoints:
+/// - POST /api/token: a new access token "token-<n>" for every refresh
+/// - GET /v1/me/player: the state set with setPlayerState(), 204 if there is none
+/// - PUT and POST /v1/me/player/...: 204
+/// - GET /v1/search, /v1/albums/{id}, /v1/playlists/{id} and /v1/playlists/{id}/tracks: generated fixtures
+/// - GET /images/{name}: cover art, see imageUrl()
+/// - /ws: WebSocket in the protocol of WebSocketStateProvider
+///
+/// Any path can be slowed down with setDelay() or made to fail with failNext(). Every request is logged.
+class SpotifyStandIn : public QObject {
+    Q_OBJECT
+
+ public:
+    struct Request {
+        QByteArray                    method;
+        QString                       path;
+        QUrlQuery                     query;
+        QHash<QByteArray, QByteArray> headers;  // lower case names
+        QByteArray                    body;
+    };
+
+    explicit SpotifyStandIn(QObject* parent = nullptr);
+
+    // listens on a free port of 127.0.0.1
+    bool listen();
+
+    QString baseUrl() const;      // http://127.0.0.1:<port>, the api_url of the integration
+    QString apiUrl() const;       // http://127.0.0.1:<port>/v1/
+    QString accountsUrl() const;  // http://127.0.0.1:<port>/api/token
+    QUrl    webSocketUrl() const;
+
+    // a port nobody listens on: requests fail with a connection refused error
+    static QString unreachableUrl();
+
+    // body of GET /v1/me/player, empty for 204
+    void setPlayerState(const QByteArray& body) { m_playerState = body; }
+
+    void setPlaylistSize(int tracks) { m_playlistSize = tracks; }
+    void setTokenLifetime(int seconds) { m_tokenLifetime = seconds; }
+
+    // every reply on the path is sent after the given time
+    void setDelay(const QString& path, int ms);
+
+    // The next count requests on the path are answered with the status code, with a Retry-After header if retryAfter
+    // is not 0.
+    void failNext(const QString& path, int statusCode, int count = 1, int retryAfter = 0);
+
+    const QList<Request>& requests() const { return m_requests; }
+    int                   count(const QString& path) const;
+    void                  clearRequests() { m_requests.clear(); }
+
+    // WebSocket
+    void push(const QByteArray& message);
+    void setAnswerPings(bool answer) { m_answerPings = answer; }
+    void dropWebSockets();
+    int  webSockets() const { return m_webSockets.size(); }
+    QUrl lastWebSocketUrl() const { return m_lastWebSocketUrl; }
+
+    // fixtures, also used by the tests directly
+    static QString     id(const QString& type, int number);
+    static QJsonObject track(int number, bool withAlbum = true);
+    static QByteArray  playerState(bool playing, int progressMs, int durationMs);
+    QByteArray         album(const QString& albumId) const;
+    QByteArray         playlist(const QString& playlistId) const;
+    QByteArray         playlistTracks(const QString& playlistId, int offset, int limit) const;
+    QByteArray         search(const QString& query, int limit) const;
+
+    // cover art served by the stand-in, unlike the image URLs in the fixtures
+    QString           imageUrl(int number) const;
+    static QByteArray image(const QString& name);
+
+ signals:
+    void requestReceived(const QString& path);
+    void webSocketMessageReceived(const QString& message);
+
+ private slots:
+    void onNewConnection();
+    void onNewWebSocket();
+
+ private:
+    struct Failure {
+        int statusCode = 500;
+        int count = 0;
+        int retryAfter = 0;
+    };
+
+    void readRequests(QTcpSocket* socket);
+    void handle(QTcpSocket* socket, const Request& request);
+    void route(const Request& request, int* statusCode, QByteArray* body, QList<QByteArray>* headers);
+    void reply(QTcpSocket* socket, int statusCode, const QByteArray& body, const QList<QByteArray>& headers);
+
+    QJsonObject playlistPage(const QString& playlistId, int offset, int limit) const;
+
+ private:
+    QTcpServer*             m_server;
+    QWebSocketServer*       m_webSocketServer;
+    QList<QWebSocket*>      m_webSockets;
+    QUrl                    m_lastWebSocketUrl;
+    bool                    m_answerPings = true;
+    QList<Request>          m_requests;
+    QHash<QString, int>     m_delays;
+    QHash<QString, Failure> m_failures;
+    QByteArray              m_playerState;
+    int                     m_playlistSize = 250;
+    int                     m_tokenLifetime = 3600;
+    int                     m_tokens = 0;
+};
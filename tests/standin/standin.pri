@@ -0,0 +1,6 @@
+# Local stand-in of the Spotify Web API, the accounts service and a push WebSocket
+QT += websockets
+
+INCLUDEPATH += $$PWD
+HEADERS += $$PWD/spotifystandin.h
+SOURCES += $$PWD/spotifystandin.cpp
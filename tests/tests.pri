@@ -0,0 +1,10 @@
+# Common settings of every test project
+TEMPLATE = app
+QT      += core network testlib
+QT      -= gui
+CONFIG  += testcase console c++14
+CONFIG  -= app_bundle
+
+# sources of the plugin are compiled into each test, only the ones the test needs
+SRC_PATH = $$clean_path($$PWD/../src)
+INCLUDEPATH += $$SRC_PATH
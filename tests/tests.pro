@@ -0,0 +1,21 @@
+# Unit tests and benchmarks of the parts of the plugin which do not depend on the integrations.library.
+# They run against a local stand-in of the Spotify Web API, so neither an account nor a network connection is needed:
+#   qmake tests/tests.pro && make && make check
+TEMPLATE = subdirs
+
+SUBDIRS += bench_browsememory \
+           bench_polling \
+           tst_circuitbreaker \
+           tst_httpclient \
+           tst_imagecache \
+           tst_latencyhistogram \
+           tst_metadatacache \
+           tst_playbackprogress \
+           tst_pollscheduler \
+           tst_retrypolicy \
+           tst_spotifydecoder \
+           tst_stringpool \
+           tst_throttledcontrol \
+           tst_tokenmanager \
+           tst_webapi \
+           tst_websocketstateprovider
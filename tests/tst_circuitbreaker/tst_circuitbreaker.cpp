@@ -0,0 +1,107 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "circuitbreaker.h"
+
+class TestCircuitBreaker : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void opensAtThreshold();
+    void successCloses();
+    void probeAfterCoolDown();
+    void coolDownIsCapped();
+};
+
+void TestCircuitBreaker::opensAtThreshold() {
+    CircuitBreaker breaker(3, 1000, 5000);
+
+    QVERIFY(!breaker.failed("/v1/search"));
+    QVERIFY(!breaker.failed("/v1/search"));
+    QVERIFY(breaker.allow("/v1/search"));
+    QVERIFY(breaker.failed("/v1/search"));
+    QCOMPARE(breaker.opened(), quint64(1));
+
+    QVERIFY(!breaker.allow("/v1/search"));
+    QCOMPARE(breaker.rejected(), quint64(1));
+    QVERIFY(breaker.retryIn("/v1/search") > 0);
+    QVERIFY(breaker.retryIn("/v1/search") <= 1000);
+
+    // every endpoint has its own breaker
+    QVERIFY(breaker.allow("/v1/me/player"));
+    QCOMPARE(breaker.retryIn("/v1/me/player"), 0);
+}
+
+void TestCircuitBreaker::successCloses() {
+    CircuitBreaker breaker(2, 1000, 5000);
+
+    // failures in between successes do not add up
+    breaker.failed("/v1/albums");
+    breaker.succeeded("/v1/albums");
+    QVERIFY(!breaker.failed("/v1/albums"));
+
+    QVERIFY(breaker.failed("/v1/albums"));
+    QVERIFY(!breaker.allow("/v1/albums"));
+    breaker.succeeded("/v1/albums");
+    QVERIFY(breaker.allow("/v1/albums"));
+    QCOMPARE(breaker.retryIn("/v1/albums"), 0);
+}
+
+void TestCircuitBreaker::probeAfterCoolDown() {
+    CircuitBreaker breaker(1, 100, 1000);
+
+    QVERIFY(breaker.failed("/v1/playlists"));
+    QVERIFY(!breaker.allow("/v1/playlists"));
+    QTest::qWait(150);
+
+    // a single probe is let through
+    QVERIFY(breaker.allow("/v1/playlists"));
+    QVERIFY(!breaker.allow("/v1/playlists"));
+
+    // the probe failed: twice the cool-down, and it does not count as a new opening
+    QVERIFY(!breaker.failed("/v1/playlists"));
+    QCOMPARE(breaker.opened(), quint64(1));
+    QVERIFY(breaker.retryIn("/v1/playlists") > 100);
+    QVERIFY(breaker.retryIn("/v1/playlists") <= 200);
+
+    QTest::qWait(250);
+    QVERIFY(breaker.allow("/v1/playlists"));
+    breaker.succeeded("/v1/playlists");
+    QVERIFY(breaker.allow("/v1/playlists"));
+    QVERIFY(breaker.allow("/v1/playlists"));
+}
+
+void TestCircuitBreaker::coolDownIsCapped() {
+    CircuitBreaker breaker(1, 100, 150);
+
+    breaker.failed("/v1/search");
+    QTest::qWait(150);
+    QVERIFY(breaker.allow("/v1/search"));
+    breaker.failed("/v1/search");
+    QVERIFY(breaker.retryIn("/v1/search") > 100);
+    QVERIFY(breaker.retryIn("/v1/search") <= 150);
+}
+
+QTEST_GUILESS_MAIN(TestCircuitBreaker)
+#include "tst_circuitbreaker.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_circuitbreaker
+
+HEADERS += $$SRC_PATH/circuitbreaker.h
+SOURCES += $$SRC_PATH/circuitbreaker.cpp \
+           tst_circuitbreaker.cpp
@@ -0,0 +1,296 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include <algorithm>
+
+#include "httpclient.h"
+#include "spotifystandin.h"
+#include "telemetry.h"
+
+class TestHttpClient : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void initTestCase();
+    void init();
+
+    void identicalGetsShareOneRequest();
+    void conditionalGetsAreNotShared();
+    void sharedGetSurvivesOneCancel();
+    void collapsedPutsSendLatestValue();
+    void concurrencyIsCapped();
+    void lowPriorityGoesLast();
+    void joiningLiftsPriority();
+    void cancelQueued();
+    void cancelRunning();
+    void errorsReachTheHandler();
+    void telemetry();
+
+ private:
+    QNetworkRequest request(const QString& path) const;
+    QString         album(int number) const { return "albums/" + SpotifyStandIn::id("album", number); }
+    QStringList     requestedPaths() const;
+
+ private:
+    SpotifyStandIn* m_standIn = nullptr;
+};
+
+void TestHttpClient::initTestCase() {
+    m_standIn = new SpotifyStandIn(this);
+    QVERIFY(m_standIn->listen());
+}
+
+void TestHttpClient::init() {
+    m_standIn->clearRequests();
+}
+
+QNetworkRequest TestHttpClient::request(const QString& path) const {
+    return QNetworkRequest(QUrl(m_standIn->apiUrl() + path));
+}
+
+QStringList TestHttpClient::requestedPaths() const {
+    QStringList paths;
+    for (const SpotifyStandIn::Request& request : m_standIn->requests()) {
+        paths.append(request.path);
+    }
+    return paths;
+}
+
+void TestHttpClient::identicalGetsShareOneRequest() {
+    HttpClient        http;
+    QList<QByteArray> bodies;
+    auto              handler = [&](QNetworkReply*, const QByteArray& body) { bodies.append(body); };
+
+    http.send(HttpClient::GET, request(album(1)), QByteArray(), handler);
+    http.send(HttpClient::GET, request(album(1)), QByteArray(), handler);
+    QTRY_COMPARE(bodies.size(), 2);
+
+    QVERIFY(!bodies.at(0).isEmpty());
+    QCOMPARE(bodies.at(0), bodies.at(1));
+    QCOMPARE(m_standIn->count("/v1/" + album(1)), 1);
+    QCOMPARE(http.stats().requests, quint64(1));
+    QCOMPARE(http.stats().coalesced, quint64(1));
+}
+
+void TestHttpClient::conditionalGetsAreNotShared() {
+    HttpClient http;
+    QList<int> statusCodes;
+    auto       handler = [&](QNetworkReply* reply, const QByteArray&) {
+        statusCodes.append(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    };
+
+    QString         playlist = "playlists/" + SpotifyStandIn::id("playlist", 1);
+    QNetworkRequest revalidation = request(playlist);
+    revalidation.setRawHeader("If-None-Match", "\"snapshot-250\"");
+    http.send(HttpClient::GET, revalidation, QByteArray(), handler);
+    http.send(HttpClient::GET, request(playlist), QByteArray(), handler);
+    QTRY_COMPARE(statusCodes.size(), 2);
+
+    std::sort(statusCodes.begin(), statusCodes.end());
+    QCOMPARE(statusCodes, QList<int>() << 200 << 304);
+    QCOMPARE(http.stats().coalesced, quint64(0));
+}
+
+void TestHttpClient::sharedGetSurvivesOneCancel() {
+    HttpClient http;
+    int        first = 0;
+    int        second = 0;
+    m_standIn->setDelay("/v1/" + album(2), 200);
+
+    quint64 id = http.send(HttpClient::GET, request(album(2)), QByteArray(),
+                           [&](QNetworkReply*, const QByteArray&) { first++; });
+    http.send(HttpClient::GET, request(album(2)), QByteArray(), [&](QNetworkReply*, const QByteArray&) { second++; });
+    QVERIFY(http.cancel(id));
+
+    QTRY_COMPARE(second, 1);
+    QCOMPARE(first, 0);
+    QCOMPARE(m_standIn->count("/v1/" + album(2)), 1);
+}
+
+void TestHttpClient::collapsedPutsSendLatestValue() {
+    HttpClient http;
+    int        handled = 0;
+    m_standIn->setDelay("/v1/me/player/volume", 200);
+
+    // the first one is sent right away, 20 waits for it and is replaced by 30
+    for (int volume : {10, 20, 30}) {
+        http.send(HttpClient::PUT, request(QString("me/player/volume?volume_percent=%1").arg(volume)), QByteArray(),
+                  [&](QNetworkReply*, const QByteArray&) { handled++; }, "volume");
+    }
+    QTRY_COMPARE(handled, 3);
+
+    const QList<SpotifyStandIn::Request>& requests = m_standIn->requests();
+    QCOMPARE(requests.size(), 2);
+    QCOMPARE(requests.at(0).query.queryItemValue("volume_percent"), QString("10"));
+    QCOMPARE(requests.at(1).query.queryItemValue("volume_percent"), QString("30"));
+    QCOMPARE(http.stats().collapsed, quint64(1));
+}
+
+void TestHttpClient::concurrencyIsCapped() {
+    HttpClient http;
+    int        handled = 0;
+    http.setMaxConcurrentRequests(2);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 10; i < 15; i++) {
+        m_standIn->setDelay("/v1/" + album(i), 200);
+        http.send(HttpClient::GET, request(album(i)), QByteArray(),
+                  [&](QNetworkReply*, const QByteArray&) { handled++; });
+    }
+    QCOMPARE(http.stats().inFlight, 2);
+    QCOMPARE(http.stats().queued, 3);
+
+    // three rounds
+    QTRY_COMPARE(handled, 5);
+    QVERIFY(timer.elapsed() >= 550);
+    QCOMPARE(http.stats().inFlight, 0);
+    QCOMPARE(http.stats().requests, quint64(5));
+}
+
+void TestHttpClient::lowPriorityGoesLast() {
+    HttpClient http;
+    int        handled = 0;
+    auto       handler = [&](QNetworkReply*, const QByteArray&) { handled++; };
+    http.setMaxConcurrentRequests(1);
+    m_standIn->setDelay("/v1/" + album(20), 200);
+
+    http.send(HttpClient::GET, request(album(20)), QByteArray(), handler);
+    QNetworkRequest prefetch = request(album(21));
+    prefetch.setPriority(QNetworkRequest::LowPriority);
+    http.send(HttpClient::GET, prefetch, QByteArray(), handler);
+    http.send(HttpClient::GET, request(album(22)), QByteArray(), handler);
+    QTRY_COMPARE(handled, 3);
+
+    QCOMPARE(requestedPaths(), QStringList() << "/v1/" + album(20) << "/v1/" + album(22) << "/v1/" + album(21));
+    QCOMPARE(http.stats().lowPriority, quint64(1));
+}
+
+void TestHttpClient::joiningLiftsPriority() {
+    HttpClient http;
+    int        handled = 0;
+    auto       handler = [&](QNetworkReply*, const QByteArray&) { handled++; };
+    http.setMaxConcurrentRequests(1);
+    m_standIn->setDelay("/v1/" + album(30), 200);
+
+    http.send(HttpClient::GET, request(album(30)), QByteArray(), handler);
+    QNetworkRequest prefetch = request(album(31));
+    prefetch.setPriority(QNetworkRequest::LowPriority);
+    http.send(HttpClient::GET, prefetch, QByteArray(), handler);
+
+    // the user opened the prefetched album
+    http.send(HttpClient::GET, request(album(31)), QByteArray(), handler);
+    QTRY_COMPARE(handled, 3);
+
+    QCOMPARE(m_standIn->count("/v1/" + album(31)), 1);
+    QCOMPARE(http.stats().coalesced, quint64(1));
+    QCOMPARE(http.stats().lowPriority, quint64(0));
+}
+
+void TestHttpClient::cancelQueued() {
+    HttpClient http;
+    int        handled = 0;
+    http.setMaxConcurrentRequests(1);
+    m_standIn->setDelay("/v1/" + album(40), 200);
+
+    http.send(HttpClient::GET, request(album(40)), QByteArray(), [&](QNetworkReply*, const QByteArray&) { handled++; });
+    quint64 id = http.send(HttpClient::GET, request(album(41)), QByteArray(),
+                           [&](QNetworkReply*, const QByteArray&) { QFAIL("cancelled request was handled"); });
+    QVERIFY(http.cancel(id));
+    QVERIFY(!http.cancel(id));
+    QCOMPARE(http.stats().queued, 0);
+
+    QTRY_COMPARE(handled, 1);
+    QTest::qWait(100);
+    QCOMPARE(m_standIn->count("/v1/" + album(41)), 0);
+    QCOMPARE(http.stats().cancelled, quint64(1));
+}
+
+void TestHttpClient::cancelRunning() {
+    HttpClient http;
+    m_standIn->setDelay("/v1/" + album(50), 300);
+
+    quint64 id = http.send(HttpClient::GET, request(album(50)), QByteArray(),
+                           [&](QNetworkReply*, const QByteArray&) { QFAIL("cancelled request was handled"); });
+    QTRY_COMPARE(m_standIn->count("/v1/" + album(50)), 1);
+    QVERIFY(http.cancel(id));
+    QTest::qWait(500);
+    QCOMPARE(http.stats().inFlight, 0);
+
+    // a new identical GET does not join the aborted one
+    int handled = 0;
+    http.send(HttpClient::GET, request(album(50)), QByteArray(), [&](QNetworkReply*, const QByteArray&) { handled++; });
+    QTRY_COMPARE(handled, 1);
+    QCOMPARE(m_standIn->count("/v1/" + album(50)), 2);
+}
+
+void TestHttpClient::errorsReachTheHandler() {
+    HttpClient                         http;
+    QList<int>                         statusCodes;
+    QList<QNetworkReply::NetworkError> errors;
+    auto                               handler = [&](QNetworkReply* reply, const QByteArray&) {
+        statusCodes.append(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+        errors.append(reply->error());
+    };
+
+    m_standIn->failNext("/v1/search", 503);
+    http.send(HttpClient::GET, request("search?q=error&type=track"), QByteArray(), handler);
+    QTRY_COMPARE(statusCodes.size(), 1);
+    QCOMPARE(statusCodes.at(0), 503);
+
+    http.send(HttpClient::GET, QNetworkRequest(QUrl(SpotifyStandIn::unreachableUrl() + "v1/search?q=error")),
+              QByteArray(), handler);
+    QTRY_COMPARE(statusCodes.size(), 2);
+    QCOMPARE(statusCodes.at(1), 0);
+    QCOMPARE(errors.at(1), QNetworkReply::ConnectionRefusedError);
+    QCOMPARE(http.stats().inFlight, 0);
+}
+
+void TestHttpClient::telemetry() {
+    Telemetry  telemetry;
+    HttpClient http;
+    int        handled = 0;
+    telemetry.setEnabled(true);
+    http.setTelemetry(&telemetry);
+    m_standIn->setDelay("/v1/" + album(60), 100);
+
+    QNetworkRequest named = request(album(60));
+    named.setAttribute(HttpClient::EndpointAttribute, "/v1/albums/{id}");
+    http.send(HttpClient::GET, named, QByteArray(), [&](QNetworkReply*, const QByteArray&) { handled++; });
+    http.send(HttpClient::GET, request("me/player"), QByteArray(),
+              [&](QNetworkReply*, const QByteArray&) { handled++; });
+    QTRY_COMPARE(handled, 2);
+
+    const Telemetry::Endpoint& albums = telemetry.endpoints().value("/v1/albums/{id}");
+    QCOMPARE(albums.requests, quint64(1));
+    QCOMPARE(albums.statusCodes.value(200), quint64(1));
+    QVERIFY(albums.total.max() >= 100);
+    QVERIFY(albums.bytesIn > 0);
+
+    // without a name, the path is the endpoint
+    QCOMPARE(telemetry.endpoints().value("/v1/me/player").statusCodes.value(204), quint64(1));
+}
+
+QTEST_GUILESS_MAIN(TestHttpClient)
+#include "tst_httpclient.moc"
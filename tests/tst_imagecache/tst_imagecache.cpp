@@ -0,0 +1,154 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "imagecache.h"
+#include "spotifystandin.h"
+
+class TestImageCache : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void init();
+    void cleanup();
+
+    void browsedTwice();
+    void missIsDownloadedOnce();
+    void prefetch();
+    void failedDownloadIsRetried();
+    void knownAfterRestart();
+    void emptyUrl();
+
+ private:
+    SpotifyStandIn* m_standIn = nullptr;
+    QTemporaryDir*  m_dir = nullptr;
+};
+
+void TestImageCache::init() {
+    m_standIn = new SpotifyStandIn(this);
+    m_dir = new QTemporaryDir();
+    QVERIFY(m_standIn->listen());
+    QVERIFY(m_dir->isValid());
+}
+
+void TestImageCache::cleanup() {
+    delete m_standIn;
+    delete m_dir;
+}
+
+void TestImageCache::browsedTwice() {
+    ImageCache  cache(m_dir->path());
+    QStringList art;
+    for (int i = 1; i <= 3; i++) {
+        art.append(m_standIn->imageUrl(i));
+    }
+
+    // first view of the album: the UI loads the remote art, the cache fetches it in the background
+    for (const QString& url : art) {
+        QCOMPARE(cache.resolve(url), url);
+    }
+    QTRY_COMPARE(cache.stats().downloads, quint64(3));
+
+    // second view: local files, nothing is downloaded again
+    for (int i = 0; i < art.size(); i++) {
+        QString local = cache.resolve(art.at(i));
+        QVERIFY(local.startsWith("file://"));
+        QFile file(QUrl(local).toLocalFile());
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), SpotifyStandIn::image(QString("%1.jpg").arg(i + 1)));
+    }
+    QTest::qWait(100);
+    QCOMPARE(m_standIn->requests().size(), 3);
+    QCOMPARE(cache.stats().misses, quint64(3));
+    QCOMPARE(cache.stats().hits, quint64(3));
+}
+
+void TestImageCache::missIsDownloadedOnce() {
+    ImageCache cache(m_dir->path());
+    QString    url = m_standIn->imageUrl(1);
+    m_standIn->setDelay("/images/1.jpg", 200);
+
+    // the list is scrolled back and forth while the download runs
+    for (int i = 0; i < 3; i++) {
+        QCOMPARE(cache.resolve(url), url);
+    }
+    QTRY_COMPARE(cache.stats().downloads, quint64(1));
+    QCOMPARE(m_standIn->count("/images/1.jpg"), 1);
+}
+
+void TestImageCache::prefetch() {
+    ImageCache cache(m_dir->path());
+    QString    url = m_standIn->imageUrl(7);
+
+    cache.prefetch(url);
+    QTRY_COMPARE(cache.stats().downloads, quint64(1));
+    QVERIFY(cache.resolve(url).startsWith("file://"));
+    QCOMPARE(cache.stats().misses, quint64(0));
+
+    // already cached
+    cache.prefetch(url);
+    QTest::qWait(100);
+    QCOMPARE(m_standIn->count("/images/7.jpg"), 1);
+}
+
+void TestImageCache::failedDownloadIsRetried() {
+    ImageCache cache(m_dir->path());
+    QString    url = m_standIn->imageUrl(2);
+    m_standIn->failNext("/images/2.jpg", 404);
+
+    QCOMPARE(cache.resolve(url), url);
+    QTRY_COMPARE(m_standIn->count("/images/2.jpg"), 1);
+    QTest::qWait(100);
+    QCOMPARE(cache.stats().downloads, quint64(0));
+
+    // nothing was stored: the next view tries again
+    QCOMPARE(cache.resolve(url), url);
+    QTRY_COMPARE(cache.stats().downloads, quint64(1));
+    QVERIFY(cache.resolve(url).startsWith("file://"));
+}
+
+void TestImageCache::knownAfterRestart() {
+    QString url = m_standIn->imageUrl(3);
+    {
+        ImageCache cache(m_dir->path());
+        cache.prefetch(url);
+        QTRY_COMPARE(cache.stats().downloads, quint64(1));
+    }
+
+    // the files on disk are listed once, not looked up per image
+    ImageCache cache(m_dir->path());
+    QVERIFY(cache.resolve(url).startsWith("file://"));
+    QCOMPARE(cache.stats().hits, quint64(1));
+    QCOMPARE(m_standIn->count("/images/3.jpg"), 1);
+}
+
+void TestImageCache::emptyUrl() {
+    ImageCache cache(m_dir->path());
+    QCOMPARE(cache.resolve(QString()), QString());
+    QCOMPARE(cache.stats().misses, quint64(0));
+    QTest::qWait(50);
+    QVERIFY(m_standIn->requests().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestImageCache)
+#include "tst_imagecache.moc"
@@ -0,0 +1,14 @@
+include(../tests.pri)
+include(../standin/standin.pri)
+
+TARGET = tst_imagecache
+
+HEADERS += $$SRC_PATH/httpclient.h \
+           $$SRC_PATH/imagecache.h \
+           $$SRC_PATH/latencyhistogram.h \
+           $$SRC_PATH/telemetry.h
+SOURCES += $$SRC_PATH/httpclient.cpp \
+           $$SRC_PATH/imagecache.cpp \
+           $$SRC_PATH/latencyhistogram.cpp \
+           $$SRC_PATH/telemetry.cpp \
+           tst_imagecache.cpp
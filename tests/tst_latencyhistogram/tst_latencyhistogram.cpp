@@ -0,0 +1,99 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "latencyhistogram.h"
+
+class TestLatencyHistogram : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void empty();
+    void percentiles();
+    void bucketBoundaries();
+    void reset();
+};
+
+void TestLatencyHistogram::empty() {
+    LatencyHistogram histogram;
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.mean(), qint64(0));
+    QCOMPARE(histogram.percentile(50), qint64(0));
+    QCOMPARE(histogram.toString(), QString("n=0 mean=0 p50<=0 p90<=0 p99<=0 max=0"));
+}
+
+void TestLatencyHistogram::percentiles() {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 50; i++) {
+        histogram.record(10);
+    }
+    for (int i = 0; i < 40; i++) {
+        histogram.record(150);
+    }
+    for (int i = 0; i < 9; i++) {
+        histogram.record(900);
+    }
+    histogram.record(20000);
+
+    QCOMPARE(histogram.count(), quint64(100));
+    QCOMPARE(histogram.mean(), qint64(346));
+    QCOMPARE(histogram.max(), qint64(20000));
+    QCOMPARE(histogram.percentile(50), qint64(25));
+    QCOMPARE(histogram.percentile(90), qint64(200));
+    QCOMPARE(histogram.percentile(99), qint64(1000));
+
+    // the last bucket has no upper limit: the maximum is the best bound there is
+    QCOMPARE(histogram.percentile(100), qint64(20000));
+    QCOMPARE(histogram.toString(), QString("n=100 mean=346 p50<=25 p90<=200 p99<=1000 max=20000"));
+}
+
+void TestLatencyHistogram::bucketBoundaries() {
+    LatencyHistogram histogram;
+    histogram.record(25);
+    QCOMPARE(histogram.percentile(100), qint64(25));
+    histogram.record(26);
+    QCOMPARE(histogram.percentile(100), qint64(50));
+    histogram.record(10000);
+    QCOMPARE(histogram.percentile(100), qint64(10000));
+    histogram.record(10001);
+    QCOMPARE(histogram.percentile(100), qint64(10001));
+
+    // out of range percentiles are clamped
+    QCOMPARE(histogram.percentile(-5), histogram.percentile(0));
+    QCOMPARE(histogram.percentile(150), histogram.percentile(100));
+}
+
+void TestLatencyHistogram::reset() {
+    LatencyHistogram histogram;
+    histogram.record(500);
+    histogram.reset();
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.max(), qint64(0));
+    QCOMPARE(histogram.percentile(99), qint64(0));
+
+    histogram.record(40);
+    QCOMPARE(histogram.percentile(50), qint64(50));
+}
+
+QTEST_GUILESS_MAIN(TestLatencyHistogram)
+#include "tst_latencyhistogram.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_latencyhistogram
+
+HEADERS += $$SRC_PATH/latencyhistogram.h
+SOURCES += $$SRC_PATH/latencyhistogram.cpp \
+           tst_latencyhistogram.cpp
@@ -0,0 +1,221 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "metadatacache.h"
+
+class TestMetadataCache : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void init();
+    void cleanup();
+
+    void memoryHit();
+    void diskHitAfterRestart();
+    void miss();
+    void remove();
+    void memoryIsBounded();
+    void diskIsPruned();
+    void staleEntry();
+    void touchRevalidates();
+    void emptyFileIsMiss();
+    void idIsSanitized();
+
+ private:
+    static void age(const QString& path, int seconds);
+
+ private:
+    QTemporaryDir* m_dir = nullptr;
+};
+
+void TestMetadataCache::init() {
+    m_dir = new QTemporaryDir();
+    QVERIFY(m_dir->isValid());
+}
+
+void TestMetadataCache::cleanup() {
+    delete m_dir;
+    m_dir = nullptr;
+}
+
+void TestMetadataCache::age(const QString& path, int seconds) {
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.setFileTime(QDateTime::currentDateTimeUtc().addSecs(-seconds), QFileDevice::FileModificationTime));
+}
+
+void TestMetadataCache::memoryHit() {
+    MetadataCache cache(m_dir->path());
+    cache.insert(MetadataCache::PLAYLIST, "p1", "{\"id\":\"p1\"}", "snap", "\"etag\"");
+
+    MetadataCache::Entry entry;
+    QVERIFY(cache.lookup(MetadataCache::PLAYLIST, "p1", &entry));
+    QCOMPARE(entry.body, QByteArray("{\"id\":\"p1\"}"));
+    QCOMPARE(entry.snapshotId, QString("snap"));
+    QCOMPARE(entry.etag, QByteArray("\"etag\""));
+    QVERIFY(cache.isFresh(MetadataCache::PLAYLIST, entry));
+    QCOMPARE(cache.stats().memoryHits, quint64(1));
+    QCOMPARE(cache.stats().diskHits, quint64(0));
+
+    // the type is part of the key
+    QVERIFY(!cache.lookup(MetadataCache::ALBUM, "p1", &entry));
+}
+
+void TestMetadataCache::diskHitAfterRestart() {
+    {
+        MetadataCache cache(m_dir->path());
+        cache.insert(MetadataCache::PLAYLIST, "p1", "{\"id\":\"p1\"}", "snap", "\"etag\"");
+    }
+
+    MetadataCache        cache(m_dir->path());
+    MetadataCache::Entry entry;
+    QVERIFY(cache.lookup(MetadataCache::PLAYLIST, "p1", &entry));
+    QCOMPARE(entry.body, QByteArray("{\"id\":\"p1\"}"));
+    QCOMPARE(entry.snapshotId, QString("snap"));
+    QCOMPARE(entry.etag, QByteArray("\"etag\""));
+    QVERIFY(cache.isFresh(MetadataCache::PLAYLIST, entry));
+    QCOMPARE(cache.stats().diskHits, quint64(1));
+
+    // loaded into memory
+    QVERIFY(cache.lookup(MetadataCache::PLAYLIST, "p1", &entry));
+    QCOMPARE(cache.stats().memoryHits, quint64(1));
+}
+
+void TestMetadataCache::miss() {
+    MetadataCache        cache(m_dir->path());
+    MetadataCache::Entry entry;
+    QVERIFY(!cache.lookup(MetadataCache::TRACK, "t1", &entry));
+    QCOMPARE(cache.stats().misses, quint64(1));
+}
+
+void TestMetadataCache::remove() {
+    MetadataCache cache(m_dir->path());
+    cache.insert(MetadataCache::ALBUM, "a1", "{}");
+    cache.remove(MetadataCache::ALBUM, "a1");
+
+    MetadataCache::Entry entry;
+    QVERIFY(!cache.lookup(MetadataCache::ALBUM, "a1", &entry));
+    QVERIFY(QDir(m_dir->path()).entryList(QDir::Files).isEmpty());
+}
+
+void TestMetadataCache::memoryIsBounded() {
+    MetadataCache cache(m_dir->path(), 100);
+    cache.insert(MetadataCache::TRACK, "t1", QByteArray(60, 'x'));
+    cache.insert(MetadataCache::TRACK, "t2", QByteArray(60, 'y'));
+
+    // evicted from memory, but still on disk
+    MetadataCache::Entry entry;
+    QVERIFY(cache.lookup(MetadataCache::TRACK, "t1", &entry));
+    QCOMPARE(entry.body, QByteArray(60, 'x'));
+    QCOMPARE(cache.stats().diskHits, quint64(1));
+
+    // bigger than the whole memory tier: only on disk
+    cache.insert(MetadataCache::TRACK, "t3", QByteArray(200, 'z'));
+    QVERIFY(cache.lookup(MetadataCache::TRACK, "t3", &entry));
+    QCOMPARE(entry.body.size(), 200);
+    QCOMPARE(cache.stats().diskHits, quint64(2));
+}
+
+void TestMetadataCache::diskIsPruned() {
+    MetadataCache cache(m_dir->path(), 1024 * 1024, 1000);
+    for (int i = 0; i < 25; i++) {
+        cache.insert(MetadataCache::TRACK, QString("t%1").arg(i), QByteArray(100, 'x'));
+
+        // files written within the same clock tick have the same time
+        if (i < 10) {
+            age(m_dir->filePath(QString("track_t%1.json").arg(i)), 60 - i);
+        }
+    }
+
+    // pruned once after 20 writes, oldest first
+    QDir dir(m_dir->path());
+    QVERIFY(dir.entryList(QDir::Files).size() < 25);
+    QVERIFY(!dir.exists("track_t0.json"));
+    QVERIFY(!dir.exists("track_t9.json"));
+    QVERIFY(dir.exists("track_t24.json"));
+}
+
+void TestMetadataCache::staleEntry() {
+    MetadataCache::Entry entry;
+    entry.fetched = QDateTime::currentDateTimeUtc().addSecs(-MetadataCache::ttl(MetadataCache::PLAYLIST) - 1);
+
+    MetadataCache cache(m_dir->path());
+    QVERIFY(!cache.isFresh(MetadataCache::PLAYLIST, entry));
+    QVERIFY(cache.isFresh(MetadataCache::ALBUM, entry));
+    QVERIFY(!cache.isFresh(MetadataCache::ALBUM, MetadataCache::Entry()));
+
+    QVERIFY(MetadataCache::ttl(MetadataCache::TRACK) > MetadataCache::ttl(MetadataCache::PLAYLIST));
+    QVERIFY(MetadataCache::ttl(MetadataCache::PLAYLIST) > MetadataCache::ttl(MetadataCache::USER_PLAYLISTS));
+}
+
+void TestMetadataCache::touchRevalidates() {
+    {
+        MetadataCache cache(m_dir->path());
+        cache.insert(MetadataCache::PLAYLIST, "p1", "{\"id\":\"p1\"}", "snap");
+    }
+    age(m_dir->filePath("playlist_p1.json"), MetadataCache::ttl(MetadataCache::PLAYLIST) + 10);
+
+    MetadataCache        cache(m_dir->path());
+    MetadataCache::Entry entry;
+    QVERIFY(cache.lookup(MetadataCache::PLAYLIST, "p1", &entry));
+    QVERIFY(!cache.isFresh(MetadataCache::PLAYLIST, entry));
+
+    // the server answered 304: fresh again in memory and on disk, the body is untouched
+    cache.notModified(MetadataCache::PLAYLIST, "p1");
+    QCOMPARE(cache.stats().notModified, quint64(1));
+    QVERIFY(cache.lookup(MetadataCache::PLAYLIST, "p1", &entry));
+    QVERIFY(cache.isFresh(MetadataCache::PLAYLIST, entry));
+
+    MetadataCache restarted(m_dir->path());
+    QVERIFY(restarted.lookup(MetadataCache::PLAYLIST, "p1", &entry));
+    QVERIFY(restarted.isFresh(MetadataCache::PLAYLIST, entry));
+    QCOMPARE(entry.body, QByteArray("{\"id\":\"p1\"}"));
+    QCOMPARE(entry.snapshotId, QString("snap"));
+}
+
+void TestMetadataCache::emptyFileIsMiss() {
+    QFile file(m_dir->filePath("album_a1.json"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("snap\t\n");
+    file.close();
+
+    MetadataCache        cache(m_dir->path());
+    MetadataCache::Entry entry;
+    QVERIFY(!cache.lookup(MetadataCache::ALBUM, "a1", &entry));
+}
+
+void TestMetadataCache::idIsSanitized() {
+    MetadataCache cache(m_dir->path());
+    cache.insert(MetadataCache::USER_PLAYLISTS, "../me?offset=50", "{}");
+
+    QStringList files = QDir(m_dir->path()).entryList(QDir::Files);
+    QCOMPARE(files, QStringList() << "user_playlists____me_offset_50.json");
+
+    MetadataCache        restarted(m_dir->path());
+    MetadataCache::Entry entry;
+    QVERIFY(restarted.lookup(MetadataCache::USER_PLAYLISTS, "../me?offset=50", &entry));
+}
+
+QTEST_GUILESS_MAIN(TestMetadataCache)
+#include "tst_metadatacache.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_metadatacache
+
+HEADERS += $$SRC_PATH/metadatacache.h
+SOURCES += $$SRC_PATH/metadatacache.cpp \
+           tst_metadatacache.cpp
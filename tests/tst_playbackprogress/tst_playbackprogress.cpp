@@ -0,0 +1,118 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "playbackprogress.h"
+
+class TestPlaybackProgress : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void pausedDoesNotWakeUp();
+    void playingEmitsEverySecond();
+    void granularity();
+    void endOfTrack();
+    void stop();
+};
+
+void TestPlaybackProgress::pausedDoesNotWakeUp() {
+    PlaybackProgress progress;
+    QSignalSpy       spy(&progress, &PlaybackProgress::positionChanged);
+
+    progress.update(5500, 180000, false);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toInt(), 5);
+    QCOMPARE(progress.position(), qint64(5500));
+    QCOMPARE(progress.remaining(), qint64(174500));
+
+    QTest::qWait(1200);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(progress.position(), qint64(5500));
+    QCOMPARE(progress.wakeups(), quint64(0));
+
+    // the same second again: nothing to show
+    progress.update(5900, 180000, false);
+    QCOMPARE(spy.count(), 1);
+}
+
+void TestPlaybackProgress::playingEmitsEverySecond() {
+    PlaybackProgress progress;
+    QSignalSpy       spy(&progress, &PlaybackProgress::positionChanged);
+
+    progress.update(0, 180000, true);
+    QTRY_VERIFY_WITH_TIMEOUT(spy.count() >= 3, 3500);
+    QCOMPARE(spy.at(0).at(0).toInt(), 0);
+    QCOMPARE(spy.at(1).at(0).toInt(), 1);
+    QCOMPARE(spy.at(2).at(0).toInt(), 2);
+
+    // one wake-up per second, not a ticking timer
+    QVERIFY(progress.wakeups() <= static_cast<quint64>(spy.count()));
+    QVERIFY(progress.position() >= 2000);
+}
+
+void TestPlaybackProgress::granularity() {
+    PlaybackProgress progress;
+    progress.setGranularity(200);
+    QCOMPARE(progress.granularity(), 1000);
+
+    progress.setGranularity(5000);
+    QSignalSpy spy(&progress, &PlaybackProgress::positionChanged);
+    progress.update(0, 180000, true);
+    QTest::qWait(2500);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(progress.wakeups(), quint64(0));
+}
+
+void TestPlaybackProgress::endOfTrack() {
+    PlaybackProgress progress;
+    QSignalSpy       spy(&progress, &PlaybackProgress::positionChanged);
+
+    progress.update(179500, 180000, true);
+    QCOMPARE(spy.at(0).at(0).toInt(), 179);
+    QTRY_COMPARE_WITH_TIMEOUT(spy.last().at(0).toInt(), 180, 2000);
+
+    // the position stays at the end until the next poll
+    QTest::qWait(1200);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(progress.position(), qint64(180000));
+    QCOMPARE(progress.remaining(), qint64(0));
+}
+
+void TestPlaybackProgress::stop() {
+    PlaybackProgress progress;
+    QSignalSpy       spy(&progress, &PlaybackProgress::positionChanged);
+
+    progress.update(60000, 180000, true);
+    progress.stop();
+    QCOMPARE(progress.position(), qint64(0));
+    QTest::qWait(1200);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(progress.wakeups(), quint64(0));
+
+    // position 0 is shown again after a stop
+    progress.update(0, 180000, false);
+    QCOMPARE(spy.count(), 2);
+}
+
+QTEST_GUILESS_MAIN(TestPlaybackProgress)
+#include "tst_playbackprogress.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_playbackprogress
+
+HEADERS += $$SRC_PATH/playbackprogress.h
+SOURCES += $$SRC_PATH/playbackprogress.cpp \
+           tst_playbackprogress.cpp
@@ -0,0 +1,227 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "pollscheduler.h"
+#include "spotifystandin.h"
+#include "spotifytypes.h"
+#include "webapi.h"
+
+static Q_LOGGING_CATEGORY(CLASS_LC, "yio.test.pollscheduler");
+
+class TestPollScheduler : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void firstPollRightAway();
+    void playingFollowsTrackEnd();
+    void commandSentPollsFast();
+    void backoffWhileIdle();
+    void missedReplyCountsAsIdle();
+    void rateLimited();
+    void stopped();
+    void againstStandIn();
+
+ private:
+    // the poll timer fired
+    static void poll(PollScheduler* scheduler);
+};
+
+void TestPollScheduler::poll(PollScheduler* scheduler) {
+    QVERIFY(QMetaObject::invokeMethod(scheduler, "onTimeout"));
+}
+
+void TestPollScheduler::firstPollRightAway() {
+    PollScheduler scheduler;
+    QSignalSpy    fetch(&scheduler, &PollScheduler::fetchRequested);
+    QSignalSpy    interval(&scheduler, &PollScheduler::intervalChanged);
+
+    scheduler.start();
+    QVERIFY(scheduler.isActive());
+    QVERIFY(fetch.wait(500));
+
+    // nothing known yet: polled like a playing player
+    QCOMPARE(scheduler.currentInterval(), 10000);
+    QCOMPARE(interval.count(), 1);
+    QCOMPARE(scheduler.hits(PollScheduler::UNKNOWN), quint64(1));
+}
+
+void TestPollScheduler::playingFollowsTrackEnd() {
+    PollScheduler scheduler;
+    scheduler.start();
+    poll(&scheduler);
+
+    scheduler.playerStateReceived(PollScheduler::PLAYING, 60000);
+    QCOMPARE(scheduler.currentInterval(), 10000);
+
+    // polled right after the track ends
+    scheduler.playerStateReceived(PollScheduler::PLAYING, 3000);
+    QCOMPARE(scheduler.currentInterval(), 3500);
+
+    scheduler.playerStateReceived(PollScheduler::PLAYING);
+    QCOMPARE(scheduler.currentInterval(), 10000);
+}
+
+void TestPollScheduler::commandSentPollsFast() {
+    PollScheduler scheduler;
+    scheduler.start();
+    poll(&scheduler);
+    scheduler.playerStateReceived(PollScheduler::PAUSED);
+    QCOMPARE(scheduler.currentInterval(), 15000);
+
+    scheduler.commandSent();
+    QCOMPARE(scheduler.currentInterval(), 1000);
+    for (int i = 0; i < 2; i++) {
+        poll(&scheduler);
+        scheduler.playerStateReceived(PollScheduler::PAUSED);
+        QCOMPARE(scheduler.currentInterval(), 1000);
+    }
+
+    // back to the backoff of the state, starting over
+    poll(&scheduler);
+    scheduler.playerStateReceived(PollScheduler::PAUSED);
+    QCOMPARE(scheduler.currentInterval(), 15000);
+}
+
+void TestPollScheduler::backoffWhileIdle() {
+    PollScheduler scheduler;
+    scheduler.start();
+    poll(&scheduler);
+    scheduler.playerStateReceived(PollScheduler::PAUSED);
+    QCOMPARE(scheduler.currentInterval(), 15000);
+
+    const QList<int> intervals = {30000, 60000, 120000, 120000};
+    for (int interval : intervals) {
+        poll(&scheduler);
+        scheduler.playerStateReceived(PollScheduler::PAUSED);
+        QCOMPARE(scheduler.currentInterval(), interval);
+    }
+
+    // playing again
+    scheduler.playerStateReceived(PollScheduler::PLAYING);
+    QCOMPARE(scheduler.currentInterval(), 10000);
+}
+
+void TestPollScheduler::missedReplyCountsAsIdle() {
+    PollScheduler scheduler;
+    scheduler.start();
+    poll(&scheduler);
+    scheduler.playerStateReceived(PollScheduler::PLAYING);
+
+    poll(&scheduler);
+    QCOMPARE(scheduler.currentInterval(), 10000);
+
+    // no state for the last poll, e.g. a network error
+    poll(&scheduler);
+    QCOMPARE(scheduler.currentInterval(), 30000);
+    QCOMPARE(scheduler.hits(PollScheduler::PLAYING), quint64(2));
+}
+
+void TestPollScheduler::rateLimited() {
+    PollScheduler scheduler;
+    scheduler.start();
+    poll(&scheduler);
+    scheduler.playerStateReceived(PollScheduler::PLAYING);
+
+    // not even a fast poll before Retry-After
+    scheduler.commandSent();
+    scheduler.rateLimited(5);
+    QVERIFY(scheduler.currentInterval() > 4000);
+    QVERIFY(scheduler.currentInterval() <= 5000);
+
+    // a shorter pause does not cut a longer one short
+    scheduler.pause(20000);
+    QVERIFY(scheduler.currentInterval() > 19000);
+    scheduler.pause(1000);
+    QVERIFY(scheduler.currentInterval() > 19000);
+}
+
+void TestPollScheduler::stopped() {
+    PollScheduler scheduler;
+    scheduler.start();
+    scheduler.stop();
+    QVERIFY(!scheduler.isActive());
+
+    // only start() polls again
+    scheduler.playerStateReceived(PollScheduler::PLAYING);
+    scheduler.commandSent();
+    scheduler.pause(1000);
+    QVERIFY(!scheduler.isActive());
+
+    QCOMPARE(QString(PollScheduler::stateName(PollScheduler::NO_DEVICE)), QString("no_device"));
+}
+
+void TestPollScheduler::againstStandIn() {
+    SpotifyStandIn standIn;
+    QVERIFY(standIn.listen());
+    standIn.setPlayerState(SpotifyStandIn::playerState(true, 178000, 180000));
+
+    // the poll loop of the integration: fetch through its request layer, decode and report back
+    QTemporaryDir dir;
+    HttpClient    http;
+    Telemetry     telemetry;
+    TokenManager  tokens(&http, standIn.accountsUrl(), "client", "secret", "refresh", dir.filePath("tokens.ini"),
+                        CLASS_LC());
+    WebApi        api(&http, &tokens, &telemetry, standIn.baseUrl(), RetryPolicy(), CircuitBreaker(), CLASS_LC());
+    PollScheduler scheduler;
+    int           replies = 0;
+    WebApi::ReplyHandler onState = [&](int statusCode, const QByteArray& body, const QByteArray&) {
+        replies++;
+        SpotifyPlayerState state;
+        if (statusCode == 204 || !SpotifyDecoder::decodePlayerState(body, &state)) {
+            scheduler.playerStateReceived(PollScheduler::NO_DEVICE);
+            return;
+        }
+        scheduler.playerStateReceived(state.isPlaying ? PollScheduler::PLAYING : PollScheduler::PAUSED,
+                                      state.item.durationMs - state.progressMs);
+    };
+    QObject::connect(&api, &WebApi::rateLimited, &scheduler, &PollScheduler::rateLimited);
+    QObject::connect(&scheduler, &PollScheduler::fetchRequested,
+                     [&]() { api.get("/v1/me/player", "", "player", QByteArray(), onState); });
+
+    // 2 s left in the track: the next poll catches the track change
+    tokens.start();
+    scheduler.start();
+    QTRY_COMPARE_WITH_TIMEOUT(scheduler.currentInterval(), 2500, 2000);
+    standIn.setPlayerState(SpotifyStandIn::playerState(true, 0, 180000));
+    QTRY_COMPARE_WITH_TIMEOUT(replies, 2, 4000);
+    QTRY_COMPARE_WITH_TIMEOUT(scheduler.currentInterval(), 10000, 1000);
+
+    // the user stopped playback elsewhere, and a command is sent: fast polls see the empty player
+    standIn.setPlayerState(QByteArray());
+    scheduler.commandSent();
+    QTRY_COMPARE_WITH_TIMEOUT(replies, 3, 2500);
+    QCOMPARE(scheduler.currentInterval(), 1000);
+
+    // throttled: no request before Retry-After, despite the fast polls left and the retry of the request layer
+    standIn.failNext("/v1/me/player", 429, 1, 3);
+    QTRY_VERIFY_WITH_TIMEOUT(scheduler.currentInterval() > 2000, 2500);
+    int requests = standIn.count("/v1/me/player");
+    QTest::qWait(1500);
+    QCOMPARE(standIn.count("/v1/me/player"), requests);
+
+    scheduler.stop();
+}
+
+QTEST_GUILESS_MAIN(TestPollScheduler)
+#include "tst_pollscheduler.moc"
@@ -0,0 +1,178 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "retrypolicy.h"
+#include "spotifystandin.h"
+
+class TestRetryPolicy : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void initTestCase();
+
+    void serverError();
+    void backoffIsCapped();
+    void rateLimited_data();
+    void rateLimited();
+    void notImplemented();
+    void clientError();
+    void success();
+    void connectionRefused();
+    void cancelled();
+
+ private:
+    // finished reply of a GET, deleted with the manager
+    QNetworkReply* get(const QString& url);
+
+ private:
+    SpotifyStandIn*        m_standIn = nullptr;
+    QNetworkAccessManager* m_manager = nullptr;
+};
+
+void TestRetryPolicy::initTestCase() {
+    m_standIn = new SpotifyStandIn(this);
+    m_manager = new QNetworkAccessManager(this);
+    QVERIFY(m_standIn->listen());
+}
+
+QNetworkReply* TestRetryPolicy::get(const QString& url) {
+    QNetworkReply* reply = m_manager->get(QNetworkRequest(QUrl(url)));
+    QSignalSpy finished(reply, &QNetworkReply::finished);
+    finished.wait(5000);
+    return reply;
+}
+
+void TestRetryPolicy::serverError() {
+    m_standIn->failNext("/v1/search", 503);
+    QNetworkReply* reply = get(m_standIn->apiUrl() + "search?q=a&type=track");
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 503);
+
+    RetryPolicy policy(3, 500, 8000);
+    QVERIFY(RetryPolicy::isFailure(reply));
+    QVERIFY(!RetryPolicy::notSent(reply));
+
+    // full jitter: anything between 0 and the exponential backoff
+    for (int attempt = 0; attempt < 3; attempt++) {
+        for (int i = 0; i < 100; i++) {
+            int delay = policy.delay(reply, attempt);
+            QVERIFY(delay >= 0);
+            QVERIFY(delay <= 500 << attempt);
+        }
+    }
+    QCOMPARE(policy.delay(reply, 3), -1);
+}
+
+void TestRetryPolicy::backoffIsCapped() {
+    m_standIn->failNext("/v1/search", 500);
+    QNetworkReply* reply = get(m_standIn->apiUrl() + "search?q=b&type=track");
+    QVERIFY(reply->isFinished());
+
+    RetryPolicy policy(40, 500, 8000);
+    int         longest = 0;
+    for (int i = 0; i < 200; i++) {
+        longest = qMax(longest, policy.delay(reply, 35));
+    }
+    QVERIFY(longest <= 8000);
+    QVERIFY(longest > 4000);
+}
+
+void TestRetryPolicy::rateLimited_data() {
+    QTest::addColumn<int>("retryAfter");
+    QTest::addColumn<int>("delay");
+
+    QTest::newRow("Retry-After") << 2 << 2000;
+    QTest::newRow("no Retry-After") << 0 << 1000;
+    QTest::newRow("longer than the maximum delay") << 20 << -1;
+}
+
+void TestRetryPolicy::rateLimited() {
+    QFETCH(int, retryAfter);
+    QFETCH(int, delay);
+
+    m_standIn->failNext("/v1/me/player", 429, 1, retryAfter);
+    QNetworkReply* reply = get(m_standIn->apiUrl() + "me/player");
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 429);
+
+    RetryPolicy policy(3, 500, 8000);
+    QCOMPARE(policy.delay(reply, 0), delay);
+
+    // the server is fine, it only wants less requests
+    QVERIFY(!RetryPolicy::isFailure(reply));
+}
+
+void TestRetryPolicy::notImplemented() {
+    m_standIn->failNext("/v1/me/player/queue", 501);
+    QNetworkReply* reply = get(m_standIn->apiUrl() + "me/player/queue");
+    QVERIFY(reply->isFinished());
+
+    QVERIFY(RetryPolicy::isFailure(reply));
+    QCOMPARE(RetryPolicy().delay(reply, 0), -1);
+}
+
+void TestRetryPolicy::clientError() {
+    QNetworkReply* reply = get(m_standIn->apiUrl() + "nothing/here");
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 404);
+
+    QVERIFY(!RetryPolicy::isFailure(reply));
+    QVERIFY(!RetryPolicy::notSent(reply));
+    QCOMPARE(RetryPolicy().delay(reply, 0), -1);
+}
+
+void TestRetryPolicy::success() {
+    QNetworkReply* reply = get(m_standIn->apiUrl() + "albums/" + SpotifyStandIn::id("album", 1));
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->error(), QNetworkReply::NoError);
+
+    QVERIFY(!RetryPolicy::isFailure(reply));
+    QCOMPARE(RetryPolicy().delay(reply, 0), -1);
+}
+
+void TestRetryPolicy::connectionRefused() {
+    QNetworkReply* reply = get(SpotifyStandIn::unreachableUrl() + "v1/me/player/play");
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->error(), QNetworkReply::ConnectionRefusedError);
+
+    // safe to send again, even a command
+    QVERIFY(RetryPolicy::notSent(reply));
+    QVERIFY(RetryPolicy::isFailure(reply));
+    QVERIFY(RetryPolicy().delay(reply, 0) >= 0);
+}
+
+void TestRetryPolicy::cancelled() {
+    m_standIn->setDelay("/v1/albums/slow", 1000);
+    QNetworkReply* reply = m_manager->get(QNetworkRequest(QUrl(m_standIn->apiUrl() + "albums/slow")));
+    reply->abort();
+    QCOMPARE(reply->error(), QNetworkReply::OperationCanceledError);
+
+    QVERIFY(!RetryPolicy::isFailure(reply));
+    QVERIFY(!RetryPolicy::notSent(reply));
+    QCOMPARE(RetryPolicy().delay(reply, 0), -1);
+    reply->deleteLater();
+}
+
+QTEST_GUILESS_MAIN(TestRetryPolicy)
+#include "tst_retrypolicy.moc"
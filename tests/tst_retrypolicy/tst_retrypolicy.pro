@@ -0,0 +1,8 @@
+include(../tests.pri)
+include(../standin/standin.pri)
+
+TARGET = tst_retrypolicy
+
+HEADERS += $$SRC_PATH/retrypolicy.h
+SOURCES += $$SRC_PATH/retrypolicy.cpp \
+           tst_retrypolicy.cpp
@@ -0,0 +1,252 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "spotifytypes.h"
+
+class TestSpotifyDecoder : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void album();
+    void playlist();
+    void playlistTrackPage();
+    void playlistPage();
+    void playerState();
+    void emptyPlayerState();
+    void searchResult();
+    void queueAndDevices();
+    void snapshotId();
+    void imageUrl_data();
+    void imageUrl();
+    void invalidJson_data();
+    void invalidJson();
+};
+
+static const QByteArray IMAGES =
+    "[{\"url\":\"https://i.scdn.co/640\",\"width\":640,\"height\":640},"
+    "{\"url\":\"https://i.scdn.co/300\",\"width\":300,\"height\":300},"
+    "{\"url\":\"https://i.scdn.co/64\",\"width\":64,\"height\":64}]";
+
+static QByteArray track(const char* id, const char* name, const char* artist, bool withAlbum) {
+    QByteArray json = "{\"id\":\"" + QByteArray(id) + "\",\"name\":\"" + name + "\",\"uri\":\"spotify:track:" + id +
+                      "\",\"duration_ms\":201000,\"artists\":[{\"name\":\"" + artist +
+                      "\"},{\"name\":\"Featured\"}]";
+    if (withAlbum) {
+        json += ",\"album\":{\"name\":\"Album\",\"images\":" + IMAGES + "}";
+    }
+    return json + "}";
+}
+
+void TestSpotifyDecoder::album() {
+    QByteArray json = "{\"id\":\"a1\",\"name\":\"Album\",\"uri\":\"spotify:album:a1\","
+                      "\"artists\":[{\"name\":\"Band\"}],\"images\":" +
+                      IMAGES + ",\"tracks\":{\"items\":[" + track("t1", "One", "Band", false) + "," +
+                      track("t2", "Two", "Guest", false) + "]}}";
+
+    SpotifyAlbum album;
+    QVERIFY(SpotifyDecoder::decodeAlbum(json, &album));
+    QCOMPARE(album.id, QString("a1"));
+    QCOMPARE(album.uri, QString("spotify:album:a1"));
+    QCOMPARE(album.artist, QString("Band"));
+    QCOMPARE(album.images.size(), 3);
+    QCOMPARE(album.tracks.size(), 2);
+
+    // album tracks take name and images from the album
+    QCOMPARE(album.tracks.at(1).name, QString("Two"));
+    QCOMPARE(album.tracks.at(1).artist, QString("Guest"));
+    QCOMPARE(album.tracks.at(1).albumName, QString("Album"));
+    QCOMPARE(album.tracks.at(1).albumImages.size(), 3);
+    QCOMPARE(album.tracks.at(1).durationMs, 201000);
+}
+
+void TestSpotifyDecoder::playlist() {
+    QByteArray json = "{\"id\":\"p1\",\"name\":\"Mix\",\"uri\":\"spotify:playlist:p1\",\"snapshot_id\":\"s1\","
+                      "\"owner\":{\"display_name\":\"Owner\"},\"images\":[{\"url\":\"https://mosaic\",\"width\":null}],"
+                      "\"tracks\":{\"items\":[{\"track\":" +
+                      track("t1", "One", "Band", true) + "},{\"track\":null},{\"track\":" +
+                      track("t2", "Two", "Band", true) + "}],\"next\":\"https://api/next\"}}";
+
+    SpotifyPlaylist playlist;
+    QVERIFY(SpotifyDecoder::decodePlaylist(json, &playlist));
+    QCOMPARE(playlist.name, QString("Mix"));
+    QCOMPARE(playlist.owner, QString("Owner"));
+    QCOMPARE(playlist.snapshotId, QString("s1"));
+    QCOMPARE(playlist.tracksNext, QString("https://api/next"));
+    QCOMPARE(playlist.images.size(), 1);
+
+    // removed tracks are skipped
+    QCOMPARE(playlist.tracks.size(), 2);
+    QCOMPARE(playlist.tracks.at(1).id, QString("t2"));
+    QCOMPARE(playlist.tracks.at(1).albumName, QString("Album"));
+}
+
+void TestSpotifyDecoder::playlistTrackPage() {
+    QByteArray json = "{\"items\":[{\"track\":" + track("t3", "Three", "Band", true) + "}],\"next\":null}";
+
+    SpotifyTrackPage page;
+    QVERIFY(SpotifyDecoder::decodePlaylistTrackPage(json, &page));
+    QCOMPARE(page.items.size(), 1);
+    QCOMPARE(page.items.at(0).uri, QString("spotify:track:t3"));
+    QVERIFY(page.next.isEmpty());
+}
+
+void TestSpotifyDecoder::playlistPage() {
+    QByteArray json = "{\"items\":[{\"id\":\"p1\",\"name\":\"One\",\"tracks\":{\"total\":3}},"
+                      "{\"id\":\"p2\",\"name\":\"Two\"}],\"next\":\"https://api/next\"}";
+
+    SpotifyPlaylistPage page;
+    QVERIFY(SpotifyDecoder::decodePlaylistPage(json, &page));
+    QCOMPARE(page.items.size(), 2);
+    QCOMPARE(page.items.at(1).name, QString("Two"));
+    QCOMPARE(page.next, QString("https://api/next"));
+}
+
+void TestSpotifyDecoder::playerState() {
+    QByteArray json = "{\"device\":{\"id\":\"d1\",\"name\":\"Kitchen\",\"type\":\"Speaker\",\"volume_percent\":35},"
+                      "\"is_playing\":true,\"progress_ms\":12345,\"item\":" +
+                      track("t1", "One", "Band", true) + "}";
+
+    SpotifyPlayerState state;
+    QVERIFY(SpotifyDecoder::decodePlayerState(json, &state));
+    QVERIFY(state.hasDevice);
+    QVERIFY(state.hasItem);
+    QVERIFY(state.isPlaying);
+    QCOMPARE(state.progressMs, 12345);
+    QCOMPARE(state.device.name, QString("Kitchen"));
+    QCOMPARE(state.device.volume, 35);
+    QCOMPARE(state.item.artist, QString("Band"));
+    QCOMPARE(state.item.albumImages.size(), 3);
+}
+
+void TestSpotifyDecoder::emptyPlayerState() {
+    SpotifyPlayerState state;
+    QVERIFY(SpotifyDecoder::decodePlayerState("{\"device\":null,\"item\":null,\"is_playing\":false}", &state));
+    QVERIFY(!state.hasDevice);
+    QVERIFY(!state.hasItem);
+    QVERIFY(!state.isPlaying);
+}
+
+void TestSpotifyDecoder::searchResult() {
+    QByteArray albums = "{\"items\":[{\"id\":\"a1\",\"name\":\"Album\",\"artists\":[{\"name\":\"Band\"}]}]}";
+    QByteArray tracks = "{\"items\":[" + track("t1", "One", "Band", true) + "," + track("t2", "Two", "Band", true) +
+                        "]}";
+    QByteArray artists = "{\"items\":[{\"id\":\"r1\",\"name\":\"Band\",\"images\":" + IMAGES + "}]}";
+    QByteArray playlists = "{\"items\":[{\"id\":\"p1\",\"name\":\"Mix\",\"owner\":{\"display_name\":\"Me\"}}]}";
+    QByteArray json = "{\"albums\":" + albums + ",\"tracks\":" + tracks + ",\"artists\":" + artists +
+                      ",\"playlists\":" + playlists + "}";
+
+    SpotifySearchResult result;
+    QVERIFY(SpotifyDecoder::decodeSearchResult(json, &result));
+    QCOMPARE(result.albums.size(), 1);
+    QCOMPARE(result.albums.at(0).artist, QString("Band"));
+    QCOMPARE(result.tracks.size(), 2);
+    QCOMPARE(result.artists.size(), 1);
+    QCOMPARE(result.artists.at(0).images.size(), 3);
+    QCOMPARE(result.playlists.size(), 1);
+    QCOMPARE(result.playlists.at(0).owner, QString("Me"));
+
+    // categories which were not searched for are missing
+    SpotifySearchResult tracksOnly;
+    QVERIFY(SpotifyDecoder::decodeSearchResult("{\"tracks\":{\"items\":[]}}", &tracksOnly));
+    QVERIFY(tracksOnly.albums.isEmpty());
+    QVERIFY(tracksOnly.tracks.isEmpty());
+}
+
+void TestSpotifyDecoder::queueAndDevices() {
+    QVector<SpotifyTrack> queue;
+    QByteArray            queueJson = "{\"currently_playing\":" + track("t0", "Now", "Band", true) + ",\"queue\":[" +
+                           track("t1", "One", "Band", true) + "," + track("t2", "Two", "Band", true) + "]}";
+    QVERIFY(SpotifyDecoder::decodeQueue(queueJson, &queue));
+    QCOMPARE(queue.size(), 2);
+    QCOMPARE(queue.at(0).id, QString("t1"));
+
+    QVector<SpotifyDevice> devices;
+    QVERIFY(SpotifyDecoder::decodeDevices("{\"devices\":[{\"id\":\"d1\",\"name\":\"Kitchen\",\"type\":\"Speaker\","
+                                          "\"volume_percent\":20},{\"id\":\"d2\",\"name\":\"Phone\"}]}",
+                                          &devices));
+    QCOMPARE(devices.size(), 2);
+    QCOMPARE(devices.at(0).type, QString("Speaker"));
+    QCOMPARE(devices.at(0).volume, 20);
+    QCOMPARE(devices.at(1).name, QString("Phone"));
+}
+
+void TestSpotifyDecoder::snapshotId() {
+    QCOMPARE(SpotifyDecoder::decodeSnapshotId("{\"id\":\"p1\",\"snapshot_id\" : \"MTAsZGVm\",\"tracks\":{}}"),
+             QString("MTAsZGVm"));
+    QVERIFY(SpotifyDecoder::decodeSnapshotId("{\"id\":\"p1\"}").isEmpty());
+    QVERIFY(SpotifyDecoder::decodeSnapshotId("{\"snapshot_id\":\"trunc").isEmpty());
+}
+
+void TestSpotifyDecoder::imageUrl_data() {
+    QTest::addColumn<QByteArray>("images");
+    QTest::addColumn<int>("width");
+    QTest::addColumn<QString>("url");
+
+    QTest::newRow("smallest wide enough") << IMAGES << 200 << "https://i.scdn.co/300";
+    QTest::newRow("exact") << IMAGES << 64 << "https://i.scdn.co/64";
+    QTest::newRow("largest if none fits") << IMAGES << 1000 << "https://i.scdn.co/640";
+    QTest::newRow("sized before unsized")
+        << QByteArray("[{\"url\":\"mosaic\"},{\"url\":\"small\",\"width\":64}]") << 300 << "small";
+    QTest::newRow("unsized only") << QByteArray("[{\"url\":\"mosaic\"}]") << 300 << "mosaic";
+    QTest::newRow("none") << QByteArray("[]") << 300 << "";
+}
+
+void TestSpotifyDecoder::imageUrl() {
+    QFETCH(QByteArray, images);
+    QFETCH(int, width);
+    QFETCH(QString, url);
+
+    SpotifySearchResult result;
+    QVERIFY(SpotifyDecoder::decodeSearchResult("{\"artists\":{\"items\":[{\"images\":" + images + "}]}}", &result));
+    QCOMPARE(SpotifyDecoder::imageUrl(result.artists.at(0).images, width), url);
+}
+
+void TestSpotifyDecoder::invalidJson_data() {
+    QTest::addColumn<QByteArray>("json");
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("truncated") << QByteArray("{\"items\":[");
+    QTest::newRow("array") << QByteArray("[]");
+    QTest::newRow("html") << QByteArray("<html>Bad Gateway</html>");
+}
+
+void TestSpotifyDecoder::invalidJson() {
+    QFETCH(QByteArray, json);
+
+    SpotifyAlbum        album;
+    SpotifyPlaylist     playlist;
+    SpotifyTrackPage    trackPage;
+    SpotifyPlaylistPage playlistPage;
+    SpotifyPlayerState  state;
+    SpotifySearchResult result;
+    QVERIFY(!SpotifyDecoder::decodeAlbum(json, &album));
+    QVERIFY(!SpotifyDecoder::decodePlaylist(json, &playlist));
+    QVERIFY(!SpotifyDecoder::decodePlaylistTrackPage(json, &trackPage));
+    QVERIFY(!SpotifyDecoder::decodePlaylistPage(json, &playlistPage));
+    QVERIFY(!SpotifyDecoder::decodePlayerState(json, &state));
+    QVERIFY(!SpotifyDecoder::decodeSearchResult(json, &result));
+}
+
+QTEST_GUILESS_MAIN(TestSpotifyDecoder)
+#include "tst_spotifydecoder.moc"
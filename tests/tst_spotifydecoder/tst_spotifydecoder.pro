@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_spotifydecoder
+
+HEADERS += $$SRC_PATH/spotifytypes.h
+SOURCES += $$SRC_PATH/spotifytypes.cpp \
+           tst_spotifydecoder.cpp
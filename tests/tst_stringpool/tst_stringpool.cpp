@@ -0,0 +1,86 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "stringpool.h"
+
+class TestStringPool : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void sharesEqualStrings();
+    void keepsDistinctStrings();
+    void ignoresEmptyStrings();
+    void outlivesThePool();
+};
+
+// a new buffer each time, like a string decoded from JSON
+static QString decoded(const char* text) {
+    return QString::fromUtf8(QByteArray(text));
+}
+
+void TestStringPool::sharesEqualStrings() {
+    StringPool pool;
+    QString    first = pool.intern(decoded("Artist 1"));
+    QString    second = pool.intern(decoded("Artist 1"));
+
+    QCOMPARE(first, second);
+    QCOMPARE(first.constData(), second.constData());
+    QCOMPARE(pool.size(), 1);
+    QCOMPARE(pool.takeSavedBytes(), qint64(8 * sizeof(QChar)));
+    QCOMPARE(pool.takeSavedBytes(), qint64(0));
+}
+
+void TestStringPool::keepsDistinctStrings() {
+    StringPool pool;
+    QString    first = pool.intern(decoded("Artist 1"));
+    QString    second = pool.intern(decoded("Artist 2"));
+
+    QVERIFY(first.constData() != second.constData());
+    QCOMPARE(pool.size(), 2);
+    QCOMPARE(pool.takeSavedBytes(), qint64(0));
+}
+
+void TestStringPool::ignoresEmptyStrings() {
+    StringPool pool;
+    QVERIFY(pool.intern(QString()).isEmpty());
+    QVERIFY(pool.intern(decoded("")).isEmpty());
+    QCOMPARE(pool.size(), 0);
+    QCOMPARE(pool.takeSavedBytes(), qint64(0));
+}
+
+void TestStringPool::outlivesThePool() {
+    QStringList artists;
+    {
+        StringPool pool;
+        for (int i = 0; i < 100; i++) {
+            artists.append(pool.intern(decoded(i % 2 ? "Artist 1" : "Artist 2")));
+        }
+        QCOMPARE(pool.size(), 2);
+    }
+    QCOMPARE(artists.at(1), QString("Artist 1"));
+    QCOMPARE(artists.at(1).constData(), artists.at(99).constData());
+}
+
+QTEST_GUILESS_MAIN(TestStringPool)
+#include "tst_stringpool.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_stringpool
+
+HEADERS += $$SRC_PATH/stringpool.h
+SOURCES += $$SRC_PATH/stringpool.cpp \
+           tst_stringpool.cpp
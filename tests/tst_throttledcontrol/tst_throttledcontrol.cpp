@@ -0,0 +1,120 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "throttledcontrol.h"
+
+class TestThrottledControl : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void latestValueWins();
+    void changeBackIsNotSent();
+    void sameValueAfterInterval();
+    void reconcile();
+    void pendingIsNotConfirmed();
+    void settles();
+};
+
+static const int INTERVAL = 100;
+
+void TestThrottledControl::latestValueWins() {
+    QList<int>       sent;
+    ThrottledControl control(INTERVAL, [&](int value) { sent.append(value); });
+
+    // the first change goes out right away
+    control.set(10);
+    QCOMPARE(sent, QList<int>() << 10);
+
+    control.set(20);
+    control.set(30);
+    QCOMPARE(sent, QList<int>() << 10);
+    QTRY_COMPARE_WITH_TIMEOUT(sent, QList<int>() << 10 << 30, 1000);
+
+    QCOMPARE(control.changes(), quint64(3));
+    QCOMPARE(control.sent(), quint64(2));
+}
+
+void TestThrottledControl::changeBackIsNotSent() {
+    QList<int>       sent;
+    ThrottledControl control(INTERVAL, [&](int value) { sent.append(value); });
+
+    control.set(10);
+    control.set(20);
+    control.set(10);
+    QTest::qWait(3 * INTERVAL);
+    QCOMPARE(sent, QList<int>() << 10);
+    QCOMPARE(control.target(), 10);
+}
+
+void TestThrottledControl::sameValueAfterInterval() {
+    QList<int>       sent;
+    ThrottledControl control(INTERVAL, [&](int value) { sent.append(value); });
+
+    // it may have been changed elsewhere in the meantime
+    control.set(10);
+    QTest::qWait(2 * INTERVAL);
+    control.set(10);
+    QCOMPARE(sent, QList<int>() << 10 << 10);
+}
+
+void TestThrottledControl::reconcile() {
+    ThrottledControl control(INTERVAL, [](int) {});
+    QVERIFY(!control.isSettling());
+    QCOMPARE(control.reconcile(30), 30);
+
+    // older polled values do not undo the change
+    control.set(50);
+    QVERIFY(control.isSettling());
+    QCOMPARE(control.reconcile(30), 50);
+
+    // confirmed by the server
+    QCOMPARE(control.reconcile(50), 50);
+    QVERIFY(!control.isSettling());
+    QCOMPARE(control.reconcile(30), 30);
+}
+
+void TestThrottledControl::pendingIsNotConfirmed() {
+    QList<int>       sent;
+    ThrottledControl control(INTERVAL, [&](int value) { sent.append(value); });
+
+    control.set(10);
+    control.set(20);
+
+    // 20 is not sent yet: the server can only have seen it from somewhere else
+    QCOMPARE(control.reconcile(20), 20);
+    QVERIFY(control.isSettling());
+    QTRY_COMPARE_WITH_TIMEOUT(sent, QList<int>() << 10 << 20, 1000);
+}
+
+void TestThrottledControl::settles() {
+    ThrottledControl control(INTERVAL, [](int) {});
+    control.set(50);
+
+    // without confirmation, polled values are shown again after the settle time
+    QTRY_VERIFY_WITH_TIMEOUT(!control.isSettling(), 5000);
+    QCOMPARE(control.reconcile(30), 30);
+}
+
+QTEST_GUILESS_MAIN(TestThrottledControl)
+#include "tst_throttledcontrol.moc"
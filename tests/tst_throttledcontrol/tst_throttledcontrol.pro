@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_throttledcontrol
+
+HEADERS += $$SRC_PATH/throttledcontrol.h
+SOURCES += $$SRC_PATH/throttledcontrol.cpp \
+           tst_throttledcontrol.cpp
@@ -0,0 +1,255 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "spotifystandin.h"
+#include "tokenmanager.h"
+
+static Q_LOGGING_CATEGORY(CLASS_LC, "yio.test.tokenmanager");
+
+class TestTokenManager : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void init();
+    void cleanup();
+
+    void refresh();
+    void singleFlight();
+    void parkedUntilValid();
+    void storedToken();
+    void newAuthorizationDropsStoredToken();
+    void rejected();
+    void refreshedAheadOfExpiry();
+    void slowRefresh();
+    void failedRefresh();
+    void unreachable();
+    void stopDropsRunningRefresh();
+
+ private:
+    TokenManager* create(const QString& refreshToken = "refresh", const QString& tokenUrl = QString());
+
+ private:
+    SpotifyStandIn* m_standIn = nullptr;
+    HttpClient*     m_http = nullptr;
+    QTemporaryDir*  m_dir = nullptr;
+};
+
+void TestTokenManager::init() {
+    m_standIn = new SpotifyStandIn(this);
+    m_http = new HttpClient(this);
+    m_dir = new QTemporaryDir();
+    QVERIFY(m_standIn->listen());
+    QVERIFY(m_dir->isValid());
+}
+
+void TestTokenManager::cleanup() {
+    delete m_http;
+    delete m_standIn;
+    delete m_dir;
+}
+
+TokenManager* TestTokenManager::create(const QString& refreshToken, const QString& tokenUrl) {
+    return new TokenManager(m_http, tokenUrl.isEmpty() ? m_standIn->accountsUrl() : tokenUrl, "client", "secret",
+                            refreshToken, m_dir->filePath("tokens.ini"), CLASS_LC(), m_http);
+}
+
+void TestTokenManager::refresh() {
+    TokenManager* tokens = create();
+    QSignalSpy    ready(tokens, &TokenManager::tokenReady);
+    QVERIFY(!tokens->isValid());
+    QVERIFY(tokens->accessToken().isEmpty());
+
+    tokens->start();
+    QVERIFY(ready.wait(5000));
+    QVERIFY(tokens->isValid());
+    QCOMPARE(tokens->accessToken(), QString("token-1"));
+
+    const SpotifyStandIn::Request& request = m_standIn->requests().last();
+    QCOMPARE(request.method, QByteArray("POST"));
+    QCOMPARE(request.headers.value("authorization"), "Basic " + QByteArray("client:secret").toBase64());
+    QUrlQuery form(QString::fromUtf8(request.body));
+    QCOMPARE(form.queryItemValue("grant_type"), QString("refresh_token"));
+    QCOMPARE(form.queryItemValue("refresh_token"), QString("refresh"));
+}
+
+void TestTokenManager::singleFlight() {
+    TokenManager* tokens = create();
+    QSignalSpy    ready(tokens, &TokenManager::tokenReady);
+    m_standIn->setDelay("/api/token", 200);
+
+    tokens->refresh();
+    tokens->refresh();
+    tokens->refresh();
+    QVERIFY(ready.wait(5000));
+    QTest::qWait(100);
+    QCOMPARE(m_standIn->count("/api/token"), 1);
+    QCOMPARE(tokens->refreshes(), quint64(1));
+    QCOMPARE(ready.count(), 1);
+}
+
+void TestTokenManager::parkedUntilValid() {
+    TokenManager* tokens = create();
+    QStringList   used;
+    for (int i = 0; i < 3; i++) {
+        tokens->whenValid([=, &used]() { used.append(tokens->accessToken()); });
+    }
+    QVERIFY(used.isEmpty());
+    QCOMPARE(tokens->parked(), quint64(3));
+
+    // replayed in order with the new token, by a single refresh
+    QTRY_COMPARE(used.size(), 3);
+    QCOMPARE(used, QStringList() << "token-1" << "token-1" << "token-1");
+    QCOMPARE(tokens->refreshes(), quint64(1));
+
+    // runs right away with a valid token
+    tokens->whenValid([&]() { used.append("now"); });
+    QCOMPARE(used.size(), 4);
+}
+
+void TestTokenManager::storedToken() {
+    TokenManager* first = create();
+    first->start();
+    QTRY_VERIFY(first->isValid());
+
+    // a restart within the lifetime of the token needs no refresh
+    TokenManager* second = create();
+    QSignalSpy    ready(second, &TokenManager::tokenReady);
+    QVERIFY(second->isValid());
+    QCOMPARE(second->accessToken(), QString("token-1"));
+    second->start();
+    QCOMPARE(ready.count(), 1);
+    QCOMPARE(m_standIn->count("/api/token"), 1);
+}
+
+void TestTokenManager::newAuthorizationDropsStoredToken() {
+    TokenManager* first = create();
+    first->start();
+    QTRY_VERIFY(first->isValid());
+
+    TokenManager* second = create("another refresh");
+    QVERIFY(!second->isValid());
+    second->start();
+    QTRY_COMPARE(second->accessToken(), QString("token-2"));
+}
+
+void TestTokenManager::rejected() {
+    TokenManager* tokens = create();
+    tokens->start();
+    QTRY_VERIFY(tokens->isValid());
+
+    // several requests fail with the same token: one refresh
+    tokens->rejected("token-1");
+    tokens->rejected("token-1");
+    QVERIFY(!tokens->isValid());
+    QTRY_COMPARE(tokens->accessToken(), QString("token-2"));
+
+    // a late 401 of the old token
+    tokens->rejected("token-1");
+    QVERIFY(tokens->isValid());
+    QCOMPARE(tokens->refreshes(), quint64(2));
+}
+
+void TestTokenManager::refreshedAheadOfExpiry() {
+    // refreshed a minute ahead: a second after the first refresh
+    m_standIn->setTokenLifetime(62);
+    TokenManager* tokens = create();
+    tokens->start();
+    QTRY_COMPARE(tokens->accessToken(), QString("token-1"));
+
+    m_standIn->setTokenLifetime(3600);
+    QTRY_COMPARE_WITH_TIMEOUT(tokens->accessToken(), QString("token-2"), 4000);
+    QCOMPARE(tokens->refreshes(), quint64(2));
+}
+
+void TestTokenManager::slowRefresh() {
+    TokenManager* tokens = create();
+    bool          ran = false;
+    m_standIn->setDelay("/api/token", 500);
+
+    QElapsedTimer timer;
+    timer.start();
+    tokens->whenValid([&]() { ran = true; });
+    QTRY_VERIFY_WITH_TIMEOUT(ran, 5000);
+    QVERIFY(timer.elapsed() >= 450);
+}
+
+void TestTokenManager::failedRefresh() {
+    TokenManager* tokens = create();
+    QSignalSpy    ready(tokens, &TokenManager::tokenReady);
+    bool          ran = false;
+    m_standIn->failNext("/api/token", 500);
+
+    tokens->whenValid([&]() { ran = true; });
+    QTRY_COMPARE(m_standIn->count("/api/token"), 1);
+    QTest::qWait(100);
+    QVERIFY(!tokens->isValid());
+    QVERIFY(!ran);
+    QCOMPARE(ready.count(), 0);
+
+    // the parked request survives until a refresh succeeds
+    tokens->refresh();
+    QTRY_VERIFY(ran);
+    QCOMPARE(ready.count(), 1);
+}
+
+void TestTokenManager::unreachable() {
+    TokenManager* tokens = create("refresh", SpotifyStandIn::unreachableUrl() + "api/token");
+    QSignalSpy    ready(tokens, &TokenManager::tokenReady);
+
+    tokens->start();
+    QTest::qWait(300);
+    QVERIFY(!tokens->isValid());
+    QCOMPARE(ready.count(), 0);
+
+    // a new refresh can be started, the failed one is not stuck
+    QCOMPARE(tokens->refreshes(), quint64(1));
+    tokens->refresh();
+    QCOMPARE(tokens->refreshes(), quint64(2));
+}
+
+void TestTokenManager::stopDropsRunningRefresh() {
+    TokenManager* tokens = create();
+    QSignalSpy    ready(tokens, &TokenManager::tokenReady);
+    bool          ran = false;
+    m_standIn->setDelay("/api/token", 200);
+
+    // standby while the refresh is on its way: no token, no parked request, no timer
+    tokens->whenValid([&]() { ran = true; });
+    QTRY_COMPARE(m_standIn->count("/api/token"), 1);
+    tokens->stop();
+    QTest::qWait(400);
+    QCOMPARE(ready.count(), 0);
+    QVERIFY(!tokens->isValid());
+    QVERIFY(!ran);
+
+    // the next start refreshes again instead of waiting for the dropped one
+    tokens->start();
+    QVERIFY(ready.wait(5000));
+    QCOMPARE(tokens->accessToken(), QString("token-2"));
+    QCOMPARE(tokens->refreshes(), quint64(2));
+    QVERIFY(!ran);
+}
+
+QTEST_GUILESS_MAIN(TestTokenManager)
+#include "tst_tokenmanager.moc"
@@ -0,0 +1,14 @@
+include(../tests.pri)
+include(../standin/standin.pri)
+
+TARGET = tst_tokenmanager
+
+HEADERS += $$SRC_PATH/httpclient.h \
+           $$SRC_PATH/latencyhistogram.h \
+           $$SRC_PATH/telemetry.h \
+           $$SRC_PATH/tokenmanager.h
+SOURCES += $$SRC_PATH/httpclient.cpp \
+           $$SRC_PATH/latencyhistogram.cpp \
+           $$SRC_PATH/telemetry.cpp \
+           $$SRC_PATH/tokenmanager.cpp \
+           tst_tokenmanager.cpp
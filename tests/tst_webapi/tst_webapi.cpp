@@ -0,0 +1,478 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "spotifystandin.h"
+#include "webapi.h"
+
+static Q_LOGGING_CATEGORY(CLASS_LC, "yio.test.webapi");
+
+// The request layer of the integration against the stand-in: tokens, 401 replay, supersede keys, retries, circuit
+// breakers and the offline command queue.
+class TestWebApi : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void init();
+    void cleanup();
+
+    void get();
+    void waitsForToken();
+    void replaysUnauthorized();
+    void supersedes();
+    void conditional();
+    void retriesServerErrors();
+    void clientErrorIsNotRetried();
+    void failureReported();
+    void failureReportedAfterRetries();
+    void failureReportedWhileBreakerOpen();
+    void supersededIsNotReported();
+    void rateLimited();
+    void putIsRetried();
+    void postIsNotRetried();
+    void breakerOpens();
+    void offlineCommandReplayed();
+    void cancelRetries();
+    void runningRequestNotRetried();
+    void runningCommandNotRetried();
+    void endpointName_data();
+    void endpointName();
+    void putBodyIsNotAnEndpoint();
+
+ private:
+    WebApi* create(int failureThreshold = 5, int maxRetries = 3);
+    void    startTokens();
+
+ private:
+    SpotifyStandIn* m_standIn = nullptr;
+    HttpClient*     m_http = nullptr;
+    Telemetry*      m_telemetry = nullptr;
+    TokenManager*   m_tokens = nullptr;
+    QTemporaryDir*  m_dir = nullptr;
+};
+
+void TestWebApi::init() {
+    m_standIn = new SpotifyStandIn(this);
+    m_http = new HttpClient(this);
+    m_telemetry = new Telemetry(this);
+    m_dir = new QTemporaryDir();
+    QVERIFY(m_standIn->listen());
+    QVERIFY(m_dir->isValid());
+    m_telemetry->setEnabled(true);
+    m_http->setTelemetry(m_telemetry);
+    m_tokens = new TokenManager(m_http, m_standIn->accountsUrl(), "client", "secret", "refresh",
+                                m_dir->filePath("tokens.ini"), CLASS_LC(), m_http);
+}
+
+void TestWebApi::cleanup() {
+    delete m_http;
+    delete m_telemetry;
+    delete m_standIn;
+    delete m_dir;
+}
+
+WebApi* TestWebApi::create(int failureThreshold, int maxRetries) {
+    // short backoff, so the tests do not wait for the delays of the integration; long enough for a Retry-After of 1
+    return new WebApi(m_http, m_tokens, m_telemetry, m_standIn->baseUrl(), RetryPolicy(maxRetries, 20, 2000),
+                      CircuitBreaker(failureThreshold, 300, 1000), CLASS_LC(), m_http);
+}
+
+void TestWebApi::startTokens() {
+    m_tokens->start();
+    QTRY_VERIFY(m_tokens->isValid());
+}
+
+void TestWebApi::get() {
+    startTokens();
+    WebApi*    api = create();
+    QByteArray state = SpotifyStandIn::playerState(true, 1000, 180000);
+    m_standIn->setPlayerState(state);
+
+    int        statusCode = 0;
+    QByteArray body;
+    api->get("/v1/me/player", "", "player", QByteArray(), [&](int status, const QByteArray& reply, const QByteArray&) {
+        statusCode = status;
+        body = reply;
+    });
+    QTRY_COMPARE(statusCode, 200);
+    QCOMPARE(body, state);
+    QCOMPARE(m_standIn->requests().last().headers.value("authorization"), QByteArray("Bearer token-1"));
+    QVERIFY(m_telemetry->endpoints().contains("/v1/me/player"));
+
+    // no active device
+    m_standIn->setPlayerState(QByteArray());
+    api->get("/v1/me/player", "", "player", QByteArray(), [&](int status, const QByteArray& reply, const QByteArray&) {
+        statusCode = status;
+        body = reply;
+    });
+    QTRY_COMPARE(statusCode, 204);
+    QVERIFY(body.isEmpty());
+}
+
+void TestWebApi::waitsForToken() {
+    WebApi* api = create();
+    int     statusCode = 0;
+
+    // sent once the refresh it started is done
+    api->put("/v1/me/player/pause", "", [&](int status) { statusCode = status; });
+    QTRY_COMPARE(statusCode, 204);
+    QCOMPARE(m_standIn->requests().at(0).path, QString("/api/token"));
+    QCOMPARE(m_standIn->requests().at(1).path, QString("/v1/me/player/pause"));
+    QCOMPARE(m_tokens->parked(), quint64(1));
+}
+
+void TestWebApi::replaysUnauthorized() {
+    startTokens();
+    WebApi* api = create();
+    int     replies = 0;
+    int     statusCode = 0;
+    m_standIn->setPlayerState(SpotifyStandIn::playerState(false, 0, 180000));
+    m_standIn->failNext("/v1/me/player", 401);
+
+    api->get("/v1/me/player", "", "", QByteArray(), [&](int status, const QByteArray&, const QByteArray&) {
+        replies++;
+        statusCode = status;
+    });
+    QTRY_COMPARE(replies, 1);
+    QCOMPARE(statusCode, 200);
+    QCOMPARE(m_standIn->count("/api/token"), 2);
+    QCOMPARE(m_standIn->requests().last().headers.value("authorization"), QByteArray("Bearer token-2"));
+
+    // a second 401 with the new token is not replayed again
+    m_standIn->failNext("/v1/me/player/play", 401, 2);
+    statusCode = 0;
+    api->put("/v1/me/player/play", "", [&](int status) { statusCode = status; });
+    QTRY_COMPARE(statusCode, 401);
+    QCOMPARE(m_standIn->count("/v1/me/player/play"), 2);
+}
+
+void TestWebApi::supersedes() {
+    startTokens();
+    WebApi*     api = create();
+    QStringList shown;
+    m_standIn->setDelay("/v1/albums/" + SpotifyStandIn::id("album", 1), 200);
+
+    // the first album is still on its way when the second one is opened
+    for (int i = 1; i <= 2; i++) {
+        QString id = SpotifyStandIn::id("album", i);
+        api->get("/v1/albums/", id, "browse", QByteArray(),
+                 [&, id](int, const QByteArray&, const QByteArray&) { shown.append(id); });
+    }
+    QTRY_COMPARE(shown.size(), 1);
+    QTest::qWait(300);
+    QCOMPARE(shown, QStringList() << SpotifyStandIn::id("album", 2));
+}
+
+void TestWebApi::conditional() {
+    startTokens();
+    WebApi*    api = create();
+    QString    id = SpotifyStandIn::id("playlist", 1);
+    int        statusCode = 0;
+    QByteArray etag;
+
+    api->get("/v1/playlists/", id, "", QByteArray(), [&](int status, const QByteArray&, const QByteArray& tag) {
+        statusCode = status;
+        etag = tag;
+    });
+    QTRY_COMPARE(statusCode, 200);
+    QVERIFY(!etag.isEmpty());
+
+    // unchanged: handed over as 304 without a body
+    QByteArray body = "unchanged";
+    api->get("/v1/playlists/", id, "", etag, [&](int status, const QByteArray& reply, const QByteArray&) {
+        statusCode = status;
+        body = reply;
+    });
+    QTRY_COMPARE(statusCode, 304);
+    QVERIFY(body.isEmpty());
+    QCOMPARE(m_standIn->requests().last().headers.value("if-none-match"), etag);
+}
+
+void TestWebApi::retriesServerErrors() {
+    startTokens();
+    WebApi* api = create();
+    int     statusCode = 0;
+    m_standIn->setPlayerState(SpotifyStandIn::playerState(true, 0, 180000));
+    m_standIn->failNext("/v1/me/player", 503, 2);
+
+    api->get("/v1/me/player", "", "player", QByteArray(),
+             [&](int status, const QByteArray&, const QByteArray&) { statusCode = status; });
+    QTRY_COMPARE(statusCode, 200);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 3);
+    QCOMPARE(api->stats().retries, quint64(2));
+    QCOMPARE(m_telemetry->endpoints().value("/v1/me/player").retries, quint64(2));
+}
+
+void TestWebApi::clientErrorIsNotRetried() {
+    startTokens();
+    WebApi* api = create();
+    bool    called = false;
+
+    api->get("/v1/unknown", "", "", QByteArray(), [&](int, const QByteArray&, const QByteArray&) { called = true; });
+    QTRY_COMPARE(m_standIn->count("/v1/unknown"), 1);
+    QTest::qWait(200);
+    QCOMPARE(m_standIn->count("/v1/unknown"), 1);
+    QVERIFY(!called);
+    QCOMPARE(api->stats().retries, quint64(0));
+}
+
+void TestWebApi::failureReported() {
+    startTokens();
+    WebApi*    api = create();
+    QList<int> failures;
+
+    api->get("/v1/unknown", "", "", QByteArray(), nullptr, [&](int statusCode) { failures.append(statusCode); });
+    QTRY_COMPARE(failures, QList<int>() << 404);
+}
+
+void TestWebApi::failureReportedAfterRetries() {
+    startTokens();
+    WebApi*    api = create(5, 2);
+    QList<int> failures;
+    m_standIn->failNext("/v1/me/player", 503, 3);
+
+    // once, when no retry is left
+    api->get("/v1/me/player", "", "", QByteArray(), nullptr, [&](int statusCode) { failures.append(statusCode); });
+    QTRY_COMPARE(failures, QList<int>() << 503);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 3);
+    QTest::qWait(200);
+    QCOMPARE(failures.size(), 1);
+}
+
+void TestWebApi::failureReportedWhileBreakerOpen() {
+    startTokens();
+    WebApi*    api = create(1, 0);
+    QList<int> failures;
+    m_standIn->failNext("/v1/me/player", 500);
+
+    api->get("/v1/me/player", "", "", QByteArray(), nullptr, [&](int statusCode) { failures.append(statusCode); });
+    QTRY_COMPARE(failures, QList<int>() << 500);
+
+    // not sent at all
+    api->get("/v1/me/player", "", "", QByteArray(), nullptr, [&](int statusCode) { failures.append(statusCode); });
+    QCOMPARE(failures, QList<int>() << 500 << 0);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 1);
+}
+
+void TestWebApi::supersededIsNotReported() {
+    startTokens();
+    WebApi*               api = create();
+    QList<int>            failures;
+    WebApi::StatusHandler failed = [&](int statusCode) { failures.append(statusCode); };
+    m_standIn->failNext("/v1/me/player", 503);
+    m_standIn->setDelay("/v1/me/player", 100);
+
+    api->get("/v1/me/player", "", "player", QByteArray(), nullptr, failed);
+    QTRY_COMPARE(m_standIn->count("/v1/me/player"), 1);
+    api->cancelSuperseded("player");
+    QTest::qWait(300);
+    QVERIFY(failures.isEmpty());
+}
+
+void TestWebApi::rateLimited() {
+    startTokens();
+    WebApi*    api = create();
+    QSignalSpy limited(api, &WebApi::rateLimited);
+    m_standIn->failNext("/v1/me/player", 429, 1, 1);
+
+    api->get("/v1/me/player", "", "player", QByteArray(), nullptr);
+    QVERIFY(limited.wait(5000));
+    QCOMPARE(limited.at(0).at(0).toInt(), 1);
+
+    // retried after Retry-After, not earlier
+    QTest::qWait(500);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 1);
+    QTRY_COMPARE_WITH_TIMEOUT(m_standIn->count("/v1/me/player"), 2, 2000);
+}
+
+void TestWebApi::putIsRetried() {
+    startTokens();
+    WebApi* api = create();
+    int     statusCode = 0;
+    m_standIn->failNext("/v1/me/player/pause", 502);
+
+    api->put("/v1/me/player/pause", "", [&](int status) { statusCode = status; });
+    QTRY_COMPARE(statusCode, 204);
+    QCOMPARE(m_standIn->count("/v1/me/player/pause"), 2);
+}
+
+void TestWebApi::postIsNotRetried() {
+    startTokens();
+    WebApi* api = create();
+    int     statusCode = 0;
+    m_standIn->failNext("/v1/me/player/next", 502);
+
+    // the server may have skipped already: skipping again would skip two tracks
+    api->post("/v1/me/player/next", "", [&](int status) { statusCode = status; });
+    QTRY_COMPARE(statusCode, 502);
+    QTest::qWait(200);
+    QCOMPARE(m_standIn->count("/v1/me/player/next"), 1);
+}
+
+void TestWebApi::breakerOpens() {
+    startTokens();
+    WebApi* api = create(2, 0);
+    m_standIn->failNext("/v1/me/player", 500, 2);
+    m_standIn->setPlayerState(SpotifyStandIn::playerState(true, 0, 180000));
+
+    for (int i = 0; i < 2; i++) {
+        api->get("/v1/me/player", "", "", QByteArray(), nullptr);
+        QTRY_COMPARE(m_standIn->count("/v1/me/player"), i + 1);
+    }
+    QTRY_COMPARE(api->breakers().opened(), quint64(1));
+    QVERIFY(api->retryIn("/v1/me/player") > 0);
+
+    // held back until the cool-down has passed, then a probe closes it again
+    bool called = false;
+    api->get("/v1/me/player", "", "", QByteArray(), [&](int, const QByteArray&, const QByteArray&) { called = true; });
+    QTest::qWait(100);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 2);
+    QVERIFY(!called);
+    QTRY_COMPARE(api->retryIn("/v1/me/player"), 0);
+    api->get("/v1/me/player", "", "", QByteArray(), [&](int, const QByteArray&, const QByteArray&) { called = true; });
+    QTRY_VERIFY(called);
+    QCOMPARE(api->retryIn("/v1/me/player"), 0);
+}
+
+void TestWebApi::offlineCommandReplayed() {
+    startTokens();
+    WebApi* api = create(1, 0);
+    int     first = 0;
+    int     second = 0;
+    m_standIn->failNext("/v1/me/player/pause", 503);
+
+    // the failure opens the breaker: the next command waits for the endpoint
+    api->put("/v1/me/player/pause", "", [&](int status) { first = status; });
+    QTRY_COMPARE(first, 503);
+    api->put("/v1/me/player/pause", "", [&](int status) { second = status; });
+    QTest::qWait(100);
+    QCOMPARE(m_standIn->count("/v1/me/player/pause"), 1);
+    QCOMPARE(second, 0);
+
+    QTRY_COMPARE(api->retryIn("/v1/me/player/pause"), 0);
+    api->replayOffline();
+    QTRY_COMPARE(second, 204);
+    QCOMPARE(m_standIn->count("/v1/me/player/pause"), 2);
+    QCOMPARE(api->stats().offlineReplayed, quint64(1));
+}
+
+void TestWebApi::cancelRetries() {
+    startTokens();
+    WebApi* api = create();
+    bool    called = false;
+
+    // a Retry-After makes the delay of the retry predictable
+    m_standIn->failNext("/v1/me/player", 429, 1, 1);
+
+    api->get("/v1/me/player", "", "player", QByteArray(), [&](int, const QByteArray&, const QByteArray&) {
+        called = true;
+    });
+    QTRY_COMPARE(api->stats().retries, quint64(1));
+    api->cancelRetries();
+    QTest::qWait(1500);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 1);
+    QVERIFY(!called);
+}
+
+void TestWebApi::runningRequestNotRetried() {
+    startTokens();
+    WebApi* api = create();
+    bool    called = false;
+    m_standIn->failNext("/v1/me/player", 503, 1);
+    m_standIn->setDelay("/v1/me/player", 200);
+
+    // the reply arrives after the standby started
+    api->get("/v1/me/player", "", "player", QByteArray(), [&](int, const QByteArray&, const QByteArray&) {
+        called = true;
+    });
+    QTRY_COMPARE(m_standIn->count("/v1/me/player"), 1);
+    api->cancelRetries();
+    QTest::qWait(500);
+    QCOMPARE(m_standIn->count("/v1/me/player"), 1);
+    QCOMPARE(api->stats().retries, quint64(0));
+    QVERIFY(!called);
+}
+
+void TestWebApi::runningCommandNotRetried() {
+    startTokens();
+    WebApi*    api = create();
+    QList<int> replies;
+    m_standIn->failNext("/v1/me/player/pause", 503, 1);
+    m_standIn->setDelay("/v1/me/player/pause", 200);
+
+    // the status is still reported, but the PUT is not sent again
+    api->put("/v1/me/player/pause", "", [&](int statusCode) { replies.append(statusCode); });
+    QTRY_COMPARE(m_standIn->count("/v1/me/player/pause"), 1);
+    api->cancelRetries();
+    QTRY_COMPARE(replies, QList<int>() << 503);
+    QTest::qWait(300);
+    QCOMPARE(m_standIn->count("/v1/me/player/pause"), 1);
+    QCOMPARE(api->stats().retries, quint64(0));
+}
+
+void TestWebApi::endpointName_data() {
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<QString>("name");
+
+    QTest::newRow("plain") << "/v1/me/player" << "/v1/me/player";
+    QTest::newRow("query") << "/v1/search?q=abc&type=album" << "/v1/search";
+    QTest::newRow("id") << "/v1/albums/" + SpotifyStandIn::id("album", 1) << "/v1/albums/{id}";
+    QTest::newRow("nested id") << "/v1/playlists/" + SpotifyStandIn::id("playlist", 7) + "/tracks?offset=100"
+                               << "/v1/playlists/{id}/tracks";
+    QTest::newRow("not an id") << "/v1/me/player/devices" << "/v1/me/player/devices";
+}
+
+void TestWebApi::endpointName() {
+    QFETCH(QString, path);
+    QFETCH(QString, name);
+    QCOMPARE(WebApi::endpointName(path), name);
+}
+
+void TestWebApi::putBodyIsNotAnEndpoint() {
+    startTokens();
+    WebApi* api = create(2, 0);
+    int     replies = 0;
+    m_standIn->failNext("/v1/me/player/play", 503, 2);
+
+    // every play command has a different body: one endpoint, one breaker
+    for (int i = 1; i <= 2; i++) {
+        QString body = QString("{\"uris\":[\"spotify:track:%1\"]}").arg(SpotifyStandIn::id("track", i));
+        api->put("/v1/me/player/play", body, [&](int) { replies++; });
+        QTRY_COMPARE(replies, i);
+    }
+    QCOMPARE(m_standIn->requests().last().body, QByteArray("{\"uris\":[\"spotify:track:tr00000000000000000002\"]}"));
+    QCOMPARE(api->breakers().opened(), quint64(1));
+    QVERIFY(api->retryIn("/v1/me/player/play") > 0);
+    QStringList endpoints = m_telemetry->endpoints().keys();
+    endpoints.sort();
+    QCOMPARE(endpoints, QStringList() << "/api/token" << "/v1/me/player/play");
+
+    // the transfer body stays out as well, the query of a POST is dropped by endpointName()
+    QCOMPARE(WebApi::commandEndpoint(HttpClient::PUT, "/v1/me/player", "{\"device_ids\":[\"a\"],\"play\":true}"),
+             QString("/v1/me/player"));
+    QCOMPARE(WebApi::commandEndpoint(HttpClient::POST, "/v1/me/player/queue", "?uri=spotify:track:abc"),
+             QString("/v1/me/player/queue"));
+}
+
+QTEST_GUILESS_MAIN(TestWebApi)
+#include "tst_webapi.moc"
@@ -0,0 +1,20 @@
+include(../tests.pri)
+include(../standin/standin.pri)
+
+TARGET = tst_webapi
+
+HEADERS += $$SRC_PATH/circuitbreaker.h \
+           $$SRC_PATH/httpclient.h \
+           $$SRC_PATH/latencyhistogram.h \
+           $$SRC_PATH/retrypolicy.h \
+           $$SRC_PATH/telemetry.h \
+           $$SRC_PATH/tokenmanager.h \
+           $$SRC_PATH/webapi.h
+SOURCES += $$SRC_PATH/circuitbreaker.cpp \
+           $$SRC_PATH/httpclient.cpp \
+           $$SRC_PATH/latencyhistogram.cpp \
+           $$SRC_PATH/retrypolicy.cpp \
+           $$SRC_PATH/telemetry.cpp \
+           $$SRC_PATH/tokenmanager.cpp \
+           $$SRC_PATH/webapi.cpp \
+           tst_webapi.cpp
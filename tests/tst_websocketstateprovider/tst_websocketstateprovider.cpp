@@ -0,0 +1,179 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2019 Marton Borzak <hello@martonborzak.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include <QtTest>
+
+#include "spotifystandin.h"
+#include "websocketstateprovider.h"
+
+class TestWebSocketStateProvider : public QObject {
+    Q_OBJECT
+
+ private slots:
+    void init();
+    void cleanup();
+
+    void connects();
+    void stateMessages();
+    void fetchMessages();
+    void answersPings();
+    void reconnects();
+    void stopIsQuiet();
+    void unreachable();
+
+ private:
+    WebSocketStateProvider* connectedProvider();
+
+ private:
+    SpotifyStandIn* m_standIn = nullptr;
+};
+
+void TestWebSocketStateProvider::init() {
+    m_standIn = new SpotifyStandIn(this);
+    QVERIFY(m_standIn->listen());
+}
+
+void TestWebSocketStateProvider::cleanup() {
+    delete m_standIn;
+    m_standIn = nullptr;
+}
+
+WebSocketStateProvider* TestWebSocketStateProvider::connectedProvider() {
+    WebSocketStateProvider* provider =
+        new WebSocketStateProvider(m_standIn->webSocketUrl(), []() { return QString("token-1"); }, m_standIn);
+    QSignalSpy connected(provider, &PlayerStateProvider::connectedChanged);
+    provider->start();
+    connected.wait(5000);
+    return provider;
+}
+
+void TestWebSocketStateProvider::connects() {
+    WebSocketStateProvider provider(m_standIn->webSocketUrl(), []() { return QString("token-1"); });
+    QSignalSpy             connected(&provider, &PlayerStateProvider::connectedChanged);
+
+    provider.start();
+    QVERIFY(provider.isActive());
+    QVERIFY(connected.wait(5000));
+    QCOMPARE(connected.at(0).at(0).toBool(), true);
+    QVERIFY(provider.isConnected());
+
+    // the token goes along as query parameter
+    QTRY_COMPARE(m_standIn->webSockets(), 1);
+    QCOMPARE(QUrlQuery(m_standIn->lastWebSocketUrl()).queryItemValue("access_token"), QString("token-1"));
+    provider.stop();
+}
+
+void TestWebSocketStateProvider::stateMessages() {
+    WebSocketStateProvider* provider = connectedProvider();
+    QVERIFY(provider->isConnected());
+    QSignalSpy states(provider, &PlayerStateProvider::stateReceived);
+    QSignalSpy fetches(provider, &PlayerStateProvider::fetchRequested);
+
+    m_standIn->push("{\"type\":\"message\",\"state\":" + SpotifyStandIn::playerState(true, 1000, 180000) + "}");
+    QVERIFY(states.wait(2000));
+    QJsonObject state = QJsonDocument::fromJson(states.at(0).at(0).toByteArray()).object();
+    QCOMPARE(state.value("is_playing").toBool(), true);
+    QCOMPARE(state.value("progress_ms").toInt(), 1000);
+
+    // nothing is playing anymore
+    m_standIn->push("{\"type\":\"message\",\"state\":null}");
+    QVERIFY(states.wait(2000));
+    QVERIFY(states.at(1).at(0).toByteArray().isEmpty());
+
+    QCOMPARE(fetches.count(), 0);
+    QCOMPARE(provider->messages(), quint64(2));
+}
+
+void TestWebSocketStateProvider::fetchMessages() {
+    WebSocketStateProvider* provider = connectedProvider();
+    QVERIFY(provider->isConnected());
+    QSignalSpy states(provider, &PlayerStateProvider::stateReceived);
+    QSignalSpy fetches(provider, &PlayerStateProvider::fetchRequested);
+
+    // something changed, without the state
+    m_standIn->push("{\"type\":\"message\",\"uri\":\"spotify:track:1\"}");
+    QVERIFY(fetches.wait(2000));
+
+    // unknown messages are ignored
+    m_standIn->push("{\"type\":\"hello\"}");
+    QTRY_COMPARE(provider->messages(), quint64(2));
+    QCOMPARE(fetches.count(), 1);
+    QCOMPARE(states.count(), 0);
+}
+
+void TestWebSocketStateProvider::answersPings() {
+    WebSocketStateProvider* provider = connectedProvider();
+    QVERIFY(provider->isConnected());
+    QSignalSpy received(m_standIn, &SpotifyStandIn::webSocketMessageReceived);
+
+    m_standIn->push("{\"type\":\"ping\"}");
+    QVERIFY(received.wait(2000));
+    QCOMPARE(received.at(0).at(0).toString(), QString("{\"type\":\"pong\"}"));
+}
+
+void TestWebSocketStateProvider::reconnects() {
+    WebSocketStateProvider* provider = connectedProvider();
+    QVERIFY(provider->isConnected());
+    QSignalSpy changes(provider, &PlayerStateProvider::connectedChanged);
+
+    // the poller takes over in the meantime
+    m_standIn->dropWebSockets();
+    QTRY_COMPARE(changes.count(), 1);
+    QCOMPARE(changes.at(0).at(0).toBool(), false);
+    QCOMPARE(provider->reconnects(), quint64(1));
+
+    // back after the first reconnect delay
+    QTRY_VERIFY_WITH_TIMEOUT(provider->isConnected(), 3000);
+    QCOMPARE(changes.count(), 2);
+    QCOMPARE(changes.at(1).at(0).toBool(), true);
+    QTRY_COMPARE(m_standIn->webSockets(), 1);
+}
+
+void TestWebSocketStateProvider::stopIsQuiet() {
+    WebSocketStateProvider* provider = connectedProvider();
+    QVERIFY(provider->isConnected());
+    QSignalSpy changes(provider, &PlayerStateProvider::connectedChanged);
+
+    provider->stop();
+    QVERIFY(!provider->isActive());
+    QTRY_COMPARE(m_standIn->webSockets(), 0);
+    QTest::qWait(1500);
+    QCOMPARE(changes.count(), 0);
+    QCOMPARE(provider->reconnects(), quint64(0));
+}
+
+void TestWebSocketStateProvider::unreachable() {
+    QUrl url(SpotifyStandIn::unreachableUrl());
+    url.setScheme("ws");
+    WebSocketStateProvider provider(url, []() { return QString("token-1"); });
+    QSignalSpy             changes(&provider, &PlayerStateProvider::connectedChanged);
+
+    // keeps trying, but never was connected
+    provider.start();
+    QTRY_VERIFY_WITH_TIMEOUT(provider.reconnects() >= 2, 4000);
+    QVERIFY(!provider.isConnected());
+    QCOMPARE(changes.count(), 0);
+    provider.stop();
+}
+
+QTEST_GUILESS_MAIN(TestWebSocketStateProvider)
+#include "tst_websocketstateprovider.moc"
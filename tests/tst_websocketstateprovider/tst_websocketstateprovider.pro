@@ -0,0 +1,9 @@
+include(../tests.pri)
+include(../standin/standin.pri)
+
+TARGET = tst_websocketstateprovider
+
+HEADERS += $$SRC_PATH/playerstateprovider.h \
+           $$SRC_PATH/websocketstateprovider.h
+SOURCES += $$SRC_PATH/websocketstateprovider.cpp \
+           tst_websocketstateprovider.cpp